@@ -0,0 +1,23 @@
+#ifndef _ALTITUDE_H_
+#define _ALTITUDE_H_
+
+#include <stdint.h>
+
+// plain C++ (no Arduino dependencies) pressure to altitude conversion
+namespace ALTITUDE
+{
+    // standard sea level pressure
+    static const float ISA_SEA_LEVEL_HPA = 1013.25f;
+
+    // ISA altitude in cm for a pressure in Pa (Q24.8, as returned by the
+    // BMP280 integer compensation), standard sea level pressure.
+    // Same formula as Adafruit_BMP280::readAltitude(), from a table in
+    // 10 hPa steps (300..1100 hPa) with linear interpolation; the error
+    // is below 0.75 m between 0 and 9000 m.
+    int32_t isaAltitude(uint32_t pressure_q8);
+
+    // the same in m, for a sea level pressure in hPa
+    float altitude(uint32_t pressure_q8, float seaLevelhPa);
+}
+
+#endif
@@ -2,7 +2,6 @@
 #define _CONFIG_H_
 
 #include <Arduino.h>
-#include <IniFile.h>
 
 // Config
 
@@ -17,31 +16,84 @@ CallSign=SAL
 Class=Two Seater
 
 [gps]
-; baudrate of GPS, default is 9600 Bd
+; baudrate of GPS (1200..115200), default is 9600 Bd
 Baudrate=38400
 Type=Beitian BN-880Q
 
 [config]
 liftoff_detection=true
+; climb in m/s that counts as liftoff (0.1..10)
 liftoff_threshold=1.5
+; vario filter time constant in seconds (0.1..60)
+vario_filter=1.5
+; ground speed in km/h above which the logger is moving (1..300)
+takeoff_speed=10
+; close the IGC file after this many seconds on the ground, within 50 m of
+; the takeoff altitude (baro or GPS), 0..3600, 0 = never
+landing_time=30
+; seconds between B records (1..3600)
 log_interval=2
+; log every log_interval_min seconds while taking off, climbing, circling or
+; low, every log_interval_max seconds in straight cruise
+adaptive_logging=false
+log_interval_min=1
+log_interval_max=4
+; keep the IGC file open during the flight and sync every n records/seconds
+; (0..1000/0..3600, 0 = off),
+; off by default: open and close the file for every record
+keep_file_open=false
+sync_records=10
+sync_interval=30
+; pre-allocate the IGC file for a flight of this many hours (0..24, 0 = off)
+max_flight_hours=10
+; max. seconds a B record is kept in RAM before it is written to SD (0..30)
+flush_interval=15
+; write the G-record at landing/shutdown only, with a checkpoint every n minutes
+; (0..1440, 0 = none),
+; off by default: rewrite the G-record after every record
+grecord_deferred=false
+grecord_checkpoint=5
+; write a binary journal (lgNNN.bin) instead of IGC text, convert it on
+; a PC with tools/bin2igc
+journal=false
 */
 
+// read once at startup, the strings point into one arena allocated by
+// readConfig() and sized to fit
 typedef struct __attribute__((__packed__))
 {
-    char pilot[80];
-    char copilot[80];
-    char type[40];
-    char reg[10];
-    char cs[10];
-    char cls[20];
-    char gps[50];
+    // [igcheader]
+    const char *pilot;
+    const char *copilot;
+    const char *type;
+    const char *reg;
+    const char *cs;
+    const char *cls;
+    // [gps]
+    const char *gps;
     unsigned long baudrate;
-    bool liftoff_detection;
-    double liftoff_threshold;
+    // [config]
+    float liftoff_threshold;
+    float vario_filter;
+    int takeoff_speed;
+    int landing_time;
     int log_interval;
+    int log_interval_min;
+    int log_interval_max;
+    int sync_records;
+    int sync_interval;
+    int flush_interval;
+    int max_flight_hours;
+    int grecord_checkpoint;
+    bool liftoff_detection;
+    bool adaptive_logging;
+    bool keep_file_open;
+    bool grecord_deferred;
+    bool journal;
 } config_t;
 
+// single pass over the ini file, keys not found get their default;
+// false if the file could not be read (all defaults)
 bool readConfig(const char* iniFilename, config_t &config);
 void printConfig(const config_t &config);
 
@@ -0,0 +1,14 @@
+#ifndef _EEPROM_LAYOUT_H_
+#define _EEPROM_LAYOUT_H_
+
+// use of the 4 KB EEPROM of the AtMega2560
+
+// binary snapshot of config.ini, see config.cpp
+#define EEPROM_CONFIG_ADDR      0
+#define EEPROM_CONFIG_SIZE      512
+
+// IGC file counter, ring of slots, see index.cpp
+#define EEPROM_INDEX_ADDR       (EEPROM_CONFIG_ADDR + EEPROM_CONFIG_SIZE)
+#define EEPROM_INDEX_SLOTS      32
+
+#endif
@@ -0,0 +1,95 @@
+#ifndef _FLIGHT_H_
+#define _FLIGHT_H_
+
+#include <stdint.h>
+
+// plain C++ (no Arduino dependencies) vario filter and flight detection,
+// the caller passes the time in ms
+namespace FLIGHT
+{
+    // alpha-beta filter on the baro altitude. The gains follow from the
+    // time constant and the time since the last sample (critically damped
+    // fading memory filter), so the response does not depend on how often
+    // it is called.
+    typedef struct
+    {
+        float altitude;         // m
+        float rate;             // m/s
+        unsigned long last;     // ms of last sample
+        bool valid;
+    } vario_t;
+
+    void varioUpdate(vario_t &vario, float altitude, unsigned long now, float time_constant);
+
+    enum state_t
+    {
+        GROUND,     // waiting for takeoff
+        TAKEOFF,    // takeoff detected, not yet confirmed (logging)
+        FLYING,     // in flight (logging)
+        LANDED      // flight ended, file closed, GROUND on the next update
+    };
+
+    typedef struct
+    {
+        float liftoff_threshold;    // m/s climb
+        float takeoff_speed;        // km/h ground speed
+        uint16_t confirm_time;      // s moving before takeoff is confirmed
+        uint16_t landing_time;      // s not moving before landing
+        float landing_height;       // m from takeoff altitude for a landing (0 = any)
+    } params_t;
+
+    // sensor values of one update
+    typedef struct
+    {
+        float vario;                // m/s, filtered baro rate
+        float altitude;             // m, filtered baro altitude
+        bool gps_valid;             // recent fix, speed and gps_altitude valid
+        float speed;                // km/h ground speed
+        float gps_altitude;         // m
+    } sample_t;
+
+    typedef struct
+    {
+        state_t state;
+        unsigned long since;        // ms, state entered
+        unsigned long moving;       // ms, last time moving
+        unsigned long stopped;      // ms, last time not moving
+        float takeoff_alt;          // m, baro altitude at takeoff
+        float takeoff_gps_alt;      // m, GPS altitude at takeoff
+        // detection latencies: takeoff = detection to confirmation,
+        // landing = stop to landing detection
+        unsigned long takeoff_latency;
+        unsigned long landing_latency;
+    } flight_t;
+
+    // start in GROUND, or in FLYING when takeoff detection is disabled
+    void begin(flight_t &flight, bool detect, unsigned long now);
+    // true when the state changed. gps_valid is false without a recent
+    // fix, the state is held until the next one. A flight lands after
+    // landing_time without moving within landing_height of the takeoff
+    // altitude, baro or GPS; slow soaring above the takeoff keeps flying.
+    bool update(flight_t &flight, const params_t &params, const sample_t &sample,
+                unsigned long now);
+    // B records are written in these states
+    inline bool logging(const flight_t &flight)
+    {
+        return flight.state == TAKEOFF || flight.state == FLYING;
+    }
+    const char *stateName(state_t state);
+
+    typedef struct
+    {
+        uint16_t min_interval;      // s
+        uint16_t max_interval;      // s
+        float climb;                // m/s, fast above this climb rate
+        float turn_rate;            // deg/s, fast above this turn rate
+        float low_height;           // m, fast within this height of takeoff
+    } log_params_t;
+
+    // adaptive B record interval in s: fast while taking off, climbing,
+    // circling or close to the takeoff altitude, slow in straight cruise
+    uint16_t logInterval(const flight_t &flight, const log_params_t &params,
+                         float vario, float turn_rate, float height);
+}
+
+#endif
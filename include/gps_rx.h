@@ -0,0 +1,36 @@
+#ifndef _GPS_RX_H_
+#define _GPS_RX_H_
+
+#include <Arduino.h>
+
+// Interrupt driven receiver for the GPS on USART1, replaces Serial1.
+// The RX interrupt stores every byte in a single producer/single consumer
+// ring, loop() reads it at its own pace. Sized for the worst case SD card
+// stall: 1024 bytes is ~260 ms at 38400 Bd.
+#ifndef GPS_RX_BUFFER_SIZE
+#define GPS_RX_BUFFER_SIZE 1024 // power of 2
+#endif
+
+namespace GPS_RX
+{
+    typedef struct
+    {
+        uint16_t overruns;      // bytes lost in the USART (data overrun)
+        uint16_t framing;       // framing errors
+        uint16_t dropped;       // bytes lost because the ring was full
+        uint16_t max_used;      // max. bytes in ring
+    } gps_rx_stats_t;
+
+    void begin(unsigned long baud);
+    int available();
+    int read();
+    void getStats(gps_rx_stats_t &stats);
+
+#ifdef NATIVE
+    // host build: bytes as the RX interrupt would store them
+    void hostReceive(const uint8_t *data, uint16_t size);
+    void hostReset();
+#endif
+}
+
+#endif
@@ -0,0 +1,105 @@
+#ifndef _HAL_H_
+#define _HAL_H_
+
+#include <stdint.h>
+#include <Arduino.h>
+#ifdef NATIVE
+#include "posix_file.h"
+#else
+#include <SD.h>
+#endif
+
+// Thin hardware abstraction for the parts of the logger that talk to the
+// board directly: clock, battery ADC, baro sensor, GPS port, SD card file
+// system and the debug port.
+// hal_arduino.cpp implements it for the AtMega2560 build, hal_replay.cpp
+// replaces the sensors by recorded traces and hal_posix.cpp runs the
+// logger on a PC ([env:native]).
+namespace HAL
+{
+#ifdef NATIVE
+    typedef PosixFile File;
+#else
+    typedef ::File File;
+#endif
+
+    // clock
+    unsigned long millis();
+    unsigned long micros();
+
+    // battery voltage in V
+    float readBatteryVoltage();
+
+    // baro sensor, the getters return the last sample read by baroUpdate()
+    bool baroBegin();
+    bool baroUpdate();                  // true if a new sample was read
+    float baroTemperature();            // degrees C
+    float baroPressure();               // Pa
+    float baroAltitude(float seaLevelhPa); // m, ISA
+
+    // GPS serial port
+    void gpsBegin(unsigned long baud);
+    int gpsAvailable();
+    int gpsRead();                      // -1 if no data
+
+    // SD card, paths are "name" or "folder/name" (8.3 names)
+    bool fsBegin(uint8_t cs_pin);
+    File fsOpen(const char *path, uint8_t mode = FILE_READ);
+    bool fsExists(const char *path);
+    bool fsMkdir(const char *path);
+    bool fsRemove(const char *path);
+    // date and time stamps of new and written files
+    void fsDateTimeCallback(void (*callback)(uint16_t *date, uint16_t *time));
+
+    // debug port, consoleBegin() waits until it is connected
+    void consoleBegin(unsigned long baud);
+    Stream &console();
+
+    // called while busy waiting
+    void idle();
+    // stop until reset
+    void powerDown();
+
+#ifdef REPLAY
+    // hal_replay.cpp: all GPS data of the trace has been delivered
+    bool replayFinished();
+#endif
+
+#ifdef NATIVE
+    // hal_posix.cpp: root is the folder used as SD card, the console
+    // goes to stdout if echo is set
+    void hostBegin(const char *root, bool echo = true);
+    // advance the virtual clock, like the time spent in a blocking call
+    void hostAdvance(unsigned long ms);
+    // micros() goes on from us, it wraps at 2^32 like the AVR counter
+    void hostMicros(uint32_t us);
+    // powerDown() was called
+    bool hostHalted();
+
+    // card access counters, a cluster is counted when a file grows into it
+    typedef struct
+    {
+        uint32_t opens;
+        uint32_t closes;
+        uint32_t seeks;
+        uint32_t writes;
+        uint32_t bytes_written;
+        uint32_t reads;
+        uint32_t bytes_read;
+        uint32_t syncs;
+        uint32_t clusters;      // FAT updates by file growth
+        uint32_t preallocs;     // contiguous allocations
+    } fs_stats_t;
+
+    static const uint32_t HOST_CLUSTER_SIZE = 32768;
+
+    void hostFsStats(fs_stats_t &stats);
+    void hostFsResetStats();
+    // every card write and sync takes ms on the virtual clock
+    void hostFsWriteDelay(unsigned long ms);
+    // card writes fail while set, like a card pulled out
+    void hostFsFailWrites(bool fail);
+#endif
+}
+
+#endif
@@ -13,6 +13,7 @@
 #define _LOGGER_IGC_FILE_WRITER_H_
 
 #include <Arduino.h>
+#include "hal.h"
 #include "MD5.h"
 
 // for testing!
@@ -29,22 +30,105 @@ class igc_file_writer final {
 
 public:
 
-  igc_file_writer(const char *file, bool grecord);
+  // file access counters, to measure the cost of the SD layer per record
+  typedef struct {
+    uint16_t open;
+    uint16_t seek;
+    uint16_t close;
+    uint16_t sync;
+    uint16_t grecords;
+    uint32_t records;
+    uint32_t write_calls;     /** write() calls to the SD layer */
+    uint32_t bytes_written;
+    uint16_t sector_rewrites; /** writes to a sector that was partly written before */
+  } stats_t;
 
+  // keep_open: open the file once and keep the handle for the whole flight,
+  // otherwise the file is opened and closed for every record.
+  // sync_records/sync_seconds: with keep_open, flush the file to the card
+  // every n records or n seconds, whichever comes first (0 = not used).
+  // defer_grecord: only write the G-record on close, and every
+  // checkpoint_minutes during the flight (0 = no checkpoints), instead of
+  // rewriting it after every record.
+  igc_file_writer(const char *file, bool grecord, bool keep_open = false,
+                  uint16_t sync_records = 0, uint16_t sync_seconds = 0,
+                  bool defer_grecord = false, uint16_t checkpoint_minutes = 0);
+  ~igc_file_writer();
+
+  // append, append_raw and sync return false if the card reported an
+  // error, for this record or for staged data written along with it
   template <size_t size> 
   bool append(const char (&data)[size]) {
     static_assert(size > 0, "invalid size");
     return append(data, size);
   }
 
+  // binary data, not sanitised nor hashed (journal mode, no G-record)
+  bool append_raw(const uint8_t *data, size_t size);
+
+  // file was created with its full expected size (see sdPreallocate),
+  // write it from the start and truncate it on close
+  void set_preallocated() { preallocated = true; }
+
+  bool sync();
+  // write pending G-record and close file
+  void close();
+  // close and delete the file without writing staged data or G-record
+  // (takeoff not confirmed); reset() starts the next one
+  void discard();
+  // close the current file and start over with a new one, same settings
+  void reset(const char *file);
+
+  // append a G-record to a file left unsigned by a power loss, a file
+  // that ends in a G-record block is left as it is
+  static bool recover(const char *path);
+  // re-hash the whole file and compare the G-record
+  static bool verify(const char *path);
+
+  const stats_t &stats() const { return file_stats; }
+  void print_stats() const;
+
 private:
+  static uint32_t hash_records(HAL::File &file, uint32_t size, MD5::MD5_CTX (&md5)[4]);
   bool append(const char *data, size_t size);
+  bool open_file();
+  bool close_file();
+  bool sync_due() const;
+  bool checkpoint_due() const;
+  bool write_grecords();
+  bool stage_record(const char *data, size_t size);
+  bool stage_raw(const uint8_t *data, size_t size);
+  bool next_sector();
+  bool write_stage();
 
   const char *file_path; /** full path of target igc file */
   const bool add_grecord; /** true if G record must be added to file */
+  const bool keep_open; /** true if file handle is kept open between records */
+  const uint16_t sync_records; /** sync after this many records (0 = off) */
+  const uint16_t sync_seconds; /** sync after this many seconds (0 = off) */
+  const bool defer_grecord; /** true if G record is only written on close/checkpoint */
+  const uint16_t checkpoint_minutes; /** G record checkpoint interval (0 = off) */
+
+  HAL::File igcFile; /** file handle, open between records when keep_open is set */
 
   long next_record_position = 0; /** position of G record */
 
+  // output is assembled per 512 byte sector of the file, full sectors are
+  // written at once, partial sectors only when the file is synced/closed.
+  static const uint16_t sector_size = 512;
+  uint8_t stage[sector_size];
+  uint32_t stage_start = 0; /** file offset of stage[0], sector aligned */
+  uint16_t stage_fill = 0; /** bytes in stage */
+  uint16_t stage_flushed = 0; /** bytes of stage written to the file */
+
+  uint16_t records_since_sync = 0;
+  unsigned long last_sync = 0; /** millis() of last sync */
+  unsigned long last_checkpoint = 0; /** millis() of last G record */
+  bool grecord_pending = false; /** records written after last G record */
+  bool preallocated = false; /** file has its final size already */
+
+  stats_t file_stats = {};
+
   MD5::MD5_CTX md5_a; //= {0x63e54c01, 0x25adab89, 0x44baecfe, 0x60f25476};
   MD5::MD5_CTX md5_b; //= {0x41e24d03, 0x23b8ebea, 0x4a4bfc9e, 0x640ed89a};
   MD5::MD5_CTX md5_c; //= {0x61e54e01, 0x22cdab89, 0x48b20cfe, 0x62125476};
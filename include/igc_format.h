@@ -0,0 +1,54 @@
+#ifndef _IGC_FORMAT_H_
+#define _IGC_FORMAT_H_
+
+#include <stdint.h>
+
+// plain C++ (no Arduino dependencies) IGC record formatting
+namespace IGC
+{
+    typedef union __attribute__((__packed__))
+    {
+        // IGC B record
+        struct __attribute__((__packed__))
+        {
+            char b ;        // 'B'
+            char time[6];   // YYMMDD
+            char lat[8];    // DDMMmmmN/S
+            char lng[9];    // DDDMMmmmE/W
+            char a;         // 'A'
+            char pAlt[5];   // pressure altitude
+            char gAlt[5];   // GPS altitude
+            char fxa[3];    // 2 sigma FXA (Fix Accuracy)
+            char siu[2];    // satellites in use
+        };
+        char raw[1+6+8+9+1+5+5+3+2+1]; // +1 for NULL terminator
+    }igc_t;
+
+    // fix flags
+    static const uint8_t FIX_SOUTH = 0x01;
+    static const uint8_t FIX_WEST  = 0x02;
+
+    // one GPS fix in integer units, everything a B record needs
+    typedef struct
+    {
+        uint8_t hour;
+        uint8_t minute;
+        uint8_t second;
+        uint8_t flags;      // FIX_SOUTH, FIX_WEST
+        uint32_t lat;       // thousandths of minutes, absolute value
+        uint32_t lng;       // thousandths of minutes, absolute value
+        int16_t pAlt;       // pressure altitude in meters
+        int16_t gAlt;       // GPS altitude in meters
+        uint16_t fxa;       // fix accuracy in meters
+        uint8_t siu;        // satellites in use
+    } fix_t;
+
+    // degrees + billionths (TinyGPS++ RawDegrees) to thousandths of minutes,
+    // truncated like the IGC DDMMmmm notation
+    uint32_t degreesToMilliMinutes(uint16_t deg, uint32_t billionths);
+
+    // format a B record from a fix, output is NULL terminated
+    void formatBRecord(const fix_t &fix, igc_t &igc);
+}
+
+#endif
@@ -0,0 +1,31 @@
+#ifndef _IGC_GRECORD_H_
+#define _IGC_GRECORD_H_
+
+#include <stddef.h>
+#include "MD5.h"
+
+// plain C++ (no Arduino dependencies) G-record security, shared by the
+// logger and the host side journal converter
+namespace IGC
+{
+    // "G<16 hex>\r\nG<16 hex>\r\n", one G-record block per MD5 context
+    static const size_t G_RECORD_SIZE = 2 * (1 + 16 + 2);
+
+    // return c if valid char for IGC files, space if not
+    char cleanChar(char c);
+
+    // the four MD5 contexts with their LK8000 start values
+    void initGRecord(MD5::MD5_CTX &md5_a, MD5::MD5_CTX &md5_b,
+                     MD5::MD5_CTX &md5_c, MD5::MD5_CTX &md5_d);
+
+    // sanitise a record in place and, if md5 is set, add it to the four
+    // G-record hashes with one update per span of characters.
+    // CR/LF are not part of the hash.
+    void cleanRecord(char *record, size_t len, void *const md5[4]);
+
+    // G-record block of one context, the context itself is not finalised
+    // so hashing can continue with the next record
+    void formatGRecord(const MD5::MD5_CTX &md5, char (&line)[G_RECORD_SIZE + 1]);
+}
+
+#endif
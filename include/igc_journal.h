@@ -0,0 +1,87 @@
+#ifndef _IGC_JOURNAL_H_
+#define _IGC_JOURNAL_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include "igc_format.h"
+
+// plain C++ (no Arduino dependencies) binary flight journal, written by
+// the logger instead of IGC text and expanded into the IGC file on a PC
+// (tools/bin2igc.cpp).
+//
+// File: "IGCJ", version, followed by entries starting with a tag byte,
+// multi-byte values little endian:
+//   'T' len, len chars     IGC record without CR/LF (A, H, ... records)
+//   'K' 19 bytes           keyframe, complete fix: seconds of the UTC
+//                          day (3 bytes), flags, lat, lng, pAlt, gAlt,
+//                          fxa, siu
+//   0x80 | mask ...        fix as the difference to the previous one,
+//                          varints (7 bits per byte, low bits first):
+//                          [dt] dlat dlng dpAlt dgAlt [dfxa] [siu]
+//                          signed values zigzag encoded, the fields in
+//                          [] are only present when the mask says so,
+//                          without dt the previous time step is used,
+//                          the first delta after a keyframe always has dt
+// A keyframe is written for the first fix, every JOURNAL_KEY_INTERVAL
+// fixes and when the hemisphere changes, so a damaged journal can be
+// decoded again from the next keyframe on.
+namespace IGC
+{
+    static const uint8_t JOURNAL_VERSION = 3;
+    static const uint8_t JOURNAL_HEADER_SIZE = 5;
+    static const uint16_t JOURNAL_KEY_INTERVAL = 60;
+    // max. bytes journalFix() writes
+    static const uint8_t JOURNAL_FIX_MAX = 1 + 3 + 5 + 5 + 3 + 3 + 3 + 1;
+    // bytes per fix to reserve for a flight, 6-7 measured in cruise and
+    // thermals at 1-4 s intervals, keyframes included
+    static const uint8_t JOURNAL_FIX_BUDGET = 8;
+
+    enum journal_entry_type_t
+    {
+        JOURNAL_TEXT = 'T',
+        JOURNAL_KEY = 'K',
+        JOURNAL_DELTA = 0x80,
+        JOURNAL_FIX         // decoded fix, key or delta
+    };
+
+    // delta entry mask bits
+    static const uint8_t JOURNAL_HAS_DT  = 0x01;
+    static const uint8_t JOURNAL_HAS_FXA = 0x02;
+    static const uint8_t JOURNAL_HAS_SIU = 0x04;
+
+    // encoder/decoder state
+    typedef struct
+    {
+        fix_t last;         // previous fix
+        uint32_t time;      // seconds of the day of the previous fix
+        uint32_t step;      // s between the last two fixes
+        uint16_t since_key; // fixes since the last keyframe
+        bool started;       // keyframe written/read
+    } journal_t;
+
+    typedef struct
+    {
+        journal_entry_type_t type;
+        const char *text;   // JOURNAL_TEXT, not NULL terminated
+        uint8_t length;
+        fix_t fix;          // JOURNAL_FIX
+    } journal_entry_t;
+
+    void journalBegin(journal_t &journal);
+
+    // encoders, return the number of bytes written to out
+    uint8_t journalHeader(uint8_t *out);
+    // out holds 2 + 255 bytes, longer lines are cut
+    uint16_t journalText(const char *line, uint8_t *out);
+    // out holds JOURNAL_FIX_MAX bytes
+    uint8_t journalFix(journal_t &journal, const fix_t &fix, uint8_t *out);
+
+    bool journalCheckHeader(const uint8_t *data, size_t size);
+    // decode the entry at data, returns its size, 0 if incomplete or invalid
+    size_t journalDecode(journal_t &journal, const uint8_t *data, size_t size,
+                         journal_entry_t &entry);
+    // offset of the next plausible keyframe after data[0], size if none
+    size_t journalResync(const uint8_t *data, size_t size);
+}
+
+#endif
@@ -0,0 +1,46 @@
+#ifndef _IGC_RECORD_RING_H_
+#define _IGC_RECORD_RING_H_
+
+#include <Arduino.h>
+
+#ifndef IGC_RING_SIZE
+#define IGC_RING_SIZE 768
+#endif
+
+// RAM ring of formatted IGC records waiting to be written to the SD card.
+// Every entry is stored as [length][queue time in ms, 16 bits][record].
+class igc_record_ring final {
+public:
+  static const uint16_t ring_size = IGC_RING_SIZE;
+  static const uint8_t entry_overhead = 3;
+
+  // queue a record (max 255 chars), false if there is no room
+  bool push(const char *record, uint8_t len, unsigned long now);
+  // take the oldest record, returns its length (0 if empty or if it
+  // does not fit in size), record is NOT NULL terminated
+  uint8_t pop(char *record, uint8_t size);
+
+  // length of the oldest record (0 if empty)
+  uint8_t peek_length() const;
+  // queue time of the oldest record
+  unsigned long oldest(unsigned long now) const;
+
+  uint16_t used() const { return used_bytes; }
+  uint16_t available() const { return ring_size - used_bytes; }
+  bool empty() const { return used_bytes == 0; }
+  uint16_t count() const { return records; }
+  // drop all queued records
+  void clear() { head = tail = used_bytes = records = 0; }
+
+private:
+  static uint16_t next(uint16_t i) { return (i + 1 == ring_size) ? 0 : i + 1; }
+  void put(uint8_t c) { buffer[head] = c; head = next(head); }
+
+  uint8_t buffer[ring_size];
+  uint16_t head = 0; /** write index */
+  uint16_t tail = 0; /** read index */
+  uint16_t used_bytes = 0;
+  uint16_t records = 0;
+};
+
+#endif
@@ -1,7 +1,18 @@
 #ifndef _INDEX_INC_
 #define _INDEX_INC_
 
-void WriteNextFileIndex(int n);
-int ReadNextFileIndex();
+#include <Arduino.h>
+
+// IGC file numbers lg000..lg999. The flight counter lives in EEPROM,
+// written round-robin over a ring of slots to level the wear, with index.txt on SD
+// as fallback. Nothing is written until a file is actually closed.
+
+// counter as stored, no writes (file number is counter % 1000)
+uint32_t ReadFileCounter();
+// next free file number in folder; the same number until it is committed
+int ReserveFileIndex(const char *folder);
+// store the counter after the reserved number, when the file is closed.
+// A file left by a power loss is found by the next reservation.
+void CommitFileIndex();
 
 #endif
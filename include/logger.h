@@ -3,46 +3,53 @@
 
 #include <Arduino.h>
 #include <TinyGPS++.h>
-#include "MD5.h"
 #include "config.h"
+#include "igc_format.h"
 
 namespace IGC
 {
-    typedef union __attribute__((__packed__))
+    // B record queue statistics
+    typedef struct
     {
-        // IGC B record
-        struct __attribute__((__packed__))
-        {
-            char b ;        // 'B'
-            char time[6];   // YYMMDD
-            char lat[8];    // DDMMmmmN/S
-            char lng[9];    // DDDMMmmmE/W
-            char a;         // 'A'
-            char pAlt[5];   // pressure altitude
-            char gAlt[5];   // GPS altitude
-            char fxa[3];    // 2 sigma FXA (Fix Accuracy)
-            char siu[2];    // satellites in use
-        };
-        char raw[1+6+8+9+1+5+5+3+2+1]; // +1 for NULL terminator
-    }igc_t;
-
-    enum pos_type
-    {
-        LAT,
-        LNG
-    };
+        uint32_t queued;        // records queued
+        uint32_t written;       // records written to SD
+        uint32_t dropped;       // records lost (queue full or write error)
+        uint32_t late;          // records queued longer than twice the flush interval
+        uint16_t max_used;      // max. bytes in queue
+        unsigned long max_flush_ms; // longest flush
+        uint16_t pre_takeoff;   // ground fixes written at takeoff
+    } record_stats_t;
 
     void initIGC();
-    bool createIGCFileName(uint16_t y, uint16_t m, uint16_t d);
+    // create the day folder and sign files left by a power loss, once per
+    // folder; on the ground as soon as the date is known, so the takeoff
+    // only has to create the file
+    bool prepareDay(uint16_t y, uint16_t m, uint16_t d);
+    bool createIGCFileName(uint16_t y, uint16_t m, uint16_t d, const config_t &config);
     void closeIGC();
+    // takeoff not confirmed: drop the queued records and delete the file,
+    // its number is used again by the next takeoff
+    void discardIGC();
+    void serviceIGC();
+    // the queue keeps 16 bits of the ms time stamp, records must be written
+    // well within 65.5 s: seconds is clamped to 0..MAX_FLUSH_INTERVAL
+    static const int MAX_FLUSH_INTERVAL = 30;
+    void setFlushInterval(int seconds);
+    const record_stats_t &getRecordStats();
+    void printRecordStats();
     void prepareIGCFileName();
-    int writeRecord(const char *, bool sign=true);
+    // file size to pre-allocate for a flight of max_flight_hours in text
+    // or journal format, 0 if disabled
+    uint32_t preallocSize(const config_t &config, bool journal);
+    // keep the last fixes on the ground in RAM, written in front of the
+    // first B record of a flight so the launch is in the file
+    void initGroundFixes(uint16_t interval);
+    void keepGroundFix(TinyGPSPlus &gps, float alt);
+    int writeRecord(const char *);
     int writeIGCHeader(uint8_t y, uint8_t m, uint8_t d, config_t & config);
     bool includeRecordInGCalc(const char *in);
     int writeARecord();
     int writeBRecord(TinyGPSPlus &gps, float alt, config_t & config);
-    void writeGRecord(const MD5::MD5_CTX &ctx);
-    int writeHRecord(const char *format, ...);
     void enableIGCWrite(bool enable=true);
     void TestIGCLKFile(const char* path);
 }
@@ -0,0 +1,50 @@
+#ifndef _PERF_H_
+#define _PERF_H_
+
+#include <stdint.h>
+#include "hal.h"
+
+// Per stage latency statistics, only compiled in with -DPERF_STATS.
+// Every stage keeps count, min, max, mean and a histogram with power of 2
+// buckets in microseconds: bucket n counts samples of less than 2^n us,
+// the last bucket counts everything longer. micros() has a resolution
+// of 4 us on a 16 MHz AtMega2560 and wraps after 71.6 minutes, stages
+// are timed modulo 2^32 us.
+namespace PERF
+{
+    enum stage_t
+    {
+        // record path
+        PARSE,      // NMEA parsing (TinyGPS++)
+        FORMAT,     // B record formatting
+        HASH,       // sanitising + G record hashing
+        WRITE,      // SD writes
+        // loop() stages
+        GPS,        // draining the GPS receive buffer
+        BARO,       // baro altitude read
+        BATTERY,    // battery ADC read
+        PRINT,      // debug status output
+        LOG,        // B record queueing and flushing
+        LOOP,       // complete loop()
+        STAGE_COUNT
+    };
+
+    static const uint8_t BUCKETS = 16;
+
+    void add(stage_t stage, uint32_t us);
+    void reset();
+    // dump the table over the debug serial port
+    void print();
+    // dump the table as csv, overwriting the file
+    bool writeCSV(const char *path);
+}
+
+#ifdef PERF_STATS
+#define PERF_START(t)        uint32_t t = HAL::micros()
+#define PERF_STOP(stage, t)  PERF::add(PERF::stage, (uint32_t) HAL::micros() - (t))
+#else
+#define PERF_START(t)
+#define PERF_STOP(stage, t)
+#endif
+
+#endif
@@ -0,0 +1,41 @@
+#ifndef _SCHEDULER_H_
+#define _SCHEDULER_H_
+
+#include <stdint.h>
+
+// Table driven cooperative scheduler. Every task is released once per
+// period; runNext() starts the highest priority released task, so a slow
+// task delays the others by at most its own run time. The scheduler never
+// reads the clock itself, the caller passes the current time in ms.
+namespace SCHED
+{
+    typedef void (*task_fn_t)(unsigned long now);
+
+    typedef struct
+    {
+        uint32_t runs;
+        uint32_t late;          // started more than deadline ms after release
+        uint32_t skipped;       // releases dropped because the task was behind
+        uint32_t jitter_total;  // sum of release to start delays, ms
+        uint16_t max_jitter;    // ms
+    } task_stats_t;
+
+    typedef struct
+    {
+        const char *name;       // PROGMEM
+        task_fn_t run;
+        uint32_t period;        // ms, 0 runs it every ms
+        uint16_t deadline;      // ms after release
+        uint8_t priority;       // 0 = highest
+        unsigned long release;  // next release, ms
+        task_stats_t stats;
+    } task_t;
+
+    // release all tasks at now and clear the statistics
+    void start(task_t *tasks, uint8_t count, unsigned long now);
+    // run the highest priority released task, false if none was due
+    bool runNext(task_t *tasks, uint8_t count, unsigned long now);
+    void printStats(const task_t *tasks, uint8_t count);
+}
+
+#endif
@@ -0,0 +1,19 @@
+#ifndef _SD_PREALLOC_H_
+#define _SD_PREALLOC_H_
+
+#include <stdint.h>
+
+// File operations the SD library's File class does not offer, done on
+// the underlying SdFile. Paths are "name" or "folder/name" (8.3 names).
+// The host build implements them in hal_posix.cpp.
+
+// call once after SD.begin()
+bool sdPreallocBegin(uint8_t cs_pin);
+// create a new file of size bytes in one contiguous range of clusters
+bool sdPreallocate(const char *path, uint32_t size);
+// cut a file to size bytes
+bool sdTruncate(const char *path, uint32_t size);
+// size and last write time (FAT date << 16 | FAT time) of a file
+bool sdFileInfo(const char *path, uint32_t &size, uint32_t &stamp);
+
+#endif
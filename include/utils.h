@@ -1,6 +1,26 @@
 #ifndef _UTILS_H
 #define _UTILS_H
 
+#include <stddef.h>
+
 void fatal_error_blink(const int d);
 
-#endif
\ No newline at end of file
+// heap statistics (AVR malloc), all sizes in bytes
+typedef struct {
+    size_t free_memory;   // gap between top of heap and stack
+    size_t heap_used;     // current heap size
+    size_t heap_max;      // heap high-water mark since boot
+    size_t free_list;     // total size of freed blocks inside the heap
+    size_t largest_free;  // largest free block (free list or gap)
+} heap_info_t;
+
+void getHeapInfo(heap_info_t &info);
+void printHeapReport();
+
+#ifdef NATIVE
+// free memory getHeapInfo() reports on the host, like a board with that
+// much RAM left
+void hostFreeMemory(size_t bytes);
+#endif
+
+#endif
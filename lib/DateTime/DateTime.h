@@ -15,7 +15,11 @@
 //#include <wiring.h> // next two typedefs replace <wiring.h> here (fixed for rel 0012)
 typedef uint8_t byte;  
 
+#ifdef NATIVE
+#include <time.h>   // host time_t, same use
+#else
 typedef unsigned long time_t;
+#endif
 
 /*==============================================================================*/
 /* Useful Constants */
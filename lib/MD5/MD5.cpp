@@ -19,6 +19,12 @@ MD5::MD5()
 char* MD5::make_digest(const unsigned char *digest, int len) /* {{{ */
 {
 	char * md5str = (char*) malloc(sizeof(char)*(len*2+1));
+	make_digest(md5str, digest, len);
+	return md5str;
+}
+
+void MD5::make_digest(char *md5str, const unsigned char *digest, int len)
+{
 	static const char hexits[17] = "0123456789abcdef";
 	int i;
 
@@ -27,7 +33,6 @@ char* MD5::make_digest(const unsigned char *digest, int len) /* {{{ */
 		md5str[(i * 2) + 1] = hexits[digest[i] &  0x0F];
 	}
 	md5str[len * 2] = '\0';
-	return md5str;
 }
 
 /*
@@ -52,139 +57,157 @@ char* MD5::make_digest(const unsigned char *digest, int len) /* {{{ */
 	(a) += (b);
 
 /*
- * SET reads 4 input bytes in little-endian byte order and stores them
- * in a properly aligned word in host byte order.
- *
- * The check for little-endian architectures that tolerate unaligned
- * memory accesses is just an optimization.  Nothing will break if it
- * doesn't work.
+ * X reads word n of the current block, decoded in host byte order.
  */
-#if defined(__i386__) || defined(__x86_64__) || defined(__vax__)
-# define SET(n) \
-	(*(MD5_u32plus *)&ptr[(n) * 4])
-# define GET(n) \
-	SET(n)
-#else
-# define SET(n) \
-	(ctx->block[(n)] = \
-	(MD5_u32plus)ptr[(n) * 4] | \
-	((MD5_u32plus)ptr[(n) * 4 + 1] << 8) | \
-	((MD5_u32plus)ptr[(n) * 4 + 2] << 16) | \
-	((MD5_u32plus)ptr[(n) * 4 + 3] << 24))
-# define GET(n) \
-	(ctx->block[(n)])
-#endif
+#define X(n) (x[(n)])
 
 /*
- * This processes one or more 64-byte data blocks, but does NOT update
- * the bit counters.  There are no alignment requirements.
+ * Decode one 64-byte block from little-endian byte order into 16 properly
+ * aligned words in host byte order.
  */
-const void *MD5::body(void *ctxBuf, const void *data, size_t size)
+static void decode(MD5_u32plus *x, const unsigned char *ptr)
 {
-	MD5_CTX *ctx = (MD5_CTX*)ctxBuf;
-	const unsigned char *ptr;
-	MD5_u32plus a, b, c, d;
-	MD5_u32plus saved_a, saved_b, saved_c, saved_d;
+	for (int n = 0; n < 16; n++, ptr += 4) {
+		x[n] = (MD5_u32plus)ptr[0] |
+			((MD5_u32plus)ptr[1] << 8) |
+			((MD5_u32plus)ptr[2] << 16) |
+			((MD5_u32plus)ptr[3] << 24);
+	}
+}
 
-	ptr = (unsigned char*)data;
+/*
+ * Run the four rounds over one decoded block and add the result to the
+ * chaining values of the context.
+ */
+static void rounds(MD5_CTX *ctx, const MD5_u32plus *x)
+{
+	MD5_u32plus a, b, c, d;
 
 	a = ctx->a;
 	b = ctx->b;
 	c = ctx->c;
 	d = ctx->d;
 
-	do {
-		saved_a = a;
-		saved_b = b;
-		saved_c = c;
-		saved_d = d;
-
 /* Round 1
  * E() has been used instead of F() because F() is already defined in the Arduino core
  */
-		STEP(E, a, b, c, d, SET(0), 0xd76aa478, 7)
-		STEP(E, d, a, b, c, SET(1), 0xe8c7b756, 12)
-		STEP(E, c, d, a, b, SET(2), 0x242070db, 17)
-		STEP(E, b, c, d, a, SET(3), 0xc1bdceee, 22)
-		STEP(E, a, b, c, d, SET(4), 0xf57c0faf, 7)
-		STEP(E, d, a, b, c, SET(5), 0x4787c62a, 12)
-		STEP(E, c, d, a, b, SET(6), 0xa8304613, 17)
-		STEP(E, b, c, d, a, SET(7), 0xfd469501, 22)
-		STEP(E, a, b, c, d, SET(8), 0x698098d8, 7)
-		STEP(E, d, a, b, c, SET(9), 0x8b44f7af, 12)
-		STEP(E, c, d, a, b, SET(10), 0xffff5bb1, 17)
-		STEP(E, b, c, d, a, SET(11), 0x895cd7be, 22)
-		STEP(E, a, b, c, d, SET(12), 0x6b901122, 7)
-		STEP(E, d, a, b, c, SET(13), 0xfd987193, 12)
-		STEP(E, c, d, a, b, SET(14), 0xa679438e, 17)
-		STEP(E, b, c, d, a, SET(15), 0x49b40821, 22)
+	STEP(E, a, b, c, d, X(0), 0xd76aa478, 7)
+	STEP(E, d, a, b, c, X(1), 0xe8c7b756, 12)
+	STEP(E, c, d, a, b, X(2), 0x242070db, 17)
+	STEP(E, b, c, d, a, X(3), 0xc1bdceee, 22)
+	STEP(E, a, b, c, d, X(4), 0xf57c0faf, 7)
+	STEP(E, d, a, b, c, X(5), 0x4787c62a, 12)
+	STEP(E, c, d, a, b, X(6), 0xa8304613, 17)
+	STEP(E, b, c, d, a, X(7), 0xfd469501, 22)
+	STEP(E, a, b, c, d, X(8), 0x698098d8, 7)
+	STEP(E, d, a, b, c, X(9), 0x8b44f7af, 12)
+	STEP(E, c, d, a, b, X(10), 0xffff5bb1, 17)
+	STEP(E, b, c, d, a, X(11), 0x895cd7be, 22)
+	STEP(E, a, b, c, d, X(12), 0x6b901122, 7)
+	STEP(E, d, a, b, c, X(13), 0xfd987193, 12)
+	STEP(E, c, d, a, b, X(14), 0xa679438e, 17)
+	STEP(E, b, c, d, a, X(15), 0x49b40821, 22)
 
 /* Round 2 */
-		STEP(G, a, b, c, d, GET(1), 0xf61e2562, 5)
-		STEP(G, d, a, b, c, GET(6), 0xc040b340, 9)
-		STEP(G, c, d, a, b, GET(11), 0x265e5a51, 14)
-		STEP(G, b, c, d, a, GET(0), 0xe9b6c7aa, 20)
-		STEP(G, a, b, c, d, GET(5), 0xd62f105d, 5)
-		STEP(G, d, a, b, c, GET(10), 0x02441453, 9)
-		STEP(G, c, d, a, b, GET(15), 0xd8a1e681, 14)
-		STEP(G, b, c, d, a, GET(4), 0xe7d3fbc8, 20)
-		STEP(G, a, b, c, d, GET(9), 0x21e1cde6, 5)
-		STEP(G, d, a, b, c, GET(14), 0xc33707d6, 9)
-		STEP(G, c, d, a, b, GET(3), 0xf4d50d87, 14)
-		STEP(G, b, c, d, a, GET(8), 0x455a14ed, 20)
-		STEP(G, a, b, c, d, GET(13), 0xa9e3e905, 5)
-		STEP(G, d, a, b, c, GET(2), 0xfcefa3f8, 9)
-		STEP(G, c, d, a, b, GET(7), 0x676f02d9, 14)
-		STEP(G, b, c, d, a, GET(12), 0x8d2a4c8a, 20)
+	STEP(G, a, b, c, d, X(1), 0xf61e2562, 5)
+	STEP(G, d, a, b, c, X(6), 0xc040b340, 9)
+	STEP(G, c, d, a, b, X(11), 0x265e5a51, 14)
+	STEP(G, b, c, d, a, X(0), 0xe9b6c7aa, 20)
+	STEP(G, a, b, c, d, X(5), 0xd62f105d, 5)
+	STEP(G, d, a, b, c, X(10), 0x02441453, 9)
+	STEP(G, c, d, a, b, X(15), 0xd8a1e681, 14)
+	STEP(G, b, c, d, a, X(4), 0xe7d3fbc8, 20)
+	STEP(G, a, b, c, d, X(9), 0x21e1cde6, 5)
+	STEP(G, d, a, b, c, X(14), 0xc33707d6, 9)
+	STEP(G, c, d, a, b, X(3), 0xf4d50d87, 14)
+	STEP(G, b, c, d, a, X(8), 0x455a14ed, 20)
+	STEP(G, a, b, c, d, X(13), 0xa9e3e905, 5)
+	STEP(G, d, a, b, c, X(2), 0xfcefa3f8, 9)
+	STEP(G, c, d, a, b, X(7), 0x676f02d9, 14)
+	STEP(G, b, c, d, a, X(12), 0x8d2a4c8a, 20)
 
 /* Round 3 */
-		STEP(H, a, b, c, d, GET(5), 0xfffa3942, 4)
-		STEP(H, d, a, b, c, GET(8), 0x8771f681, 11)
-		STEP(H, c, d, a, b, GET(11), 0x6d9d6122, 16)
-		STEP(H, b, c, d, a, GET(14), 0xfde5380c, 23)
-		STEP(H, a, b, c, d, GET(1), 0xa4beea44, 4)
-		STEP(H, d, a, b, c, GET(4), 0x4bdecfa9, 11)
-		STEP(H, c, d, a, b, GET(7), 0xf6bb4b60, 16)
-		STEP(H, b, c, d, a, GET(10), 0xbebfbc70, 23)
-		STEP(H, a, b, c, d, GET(13), 0x289b7ec6, 4)
-		STEP(H, d, a, b, c, GET(0), 0xeaa127fa, 11)
-		STEP(H, c, d, a, b, GET(3), 0xd4ef3085, 16)
-		STEP(H, b, c, d, a, GET(6), 0x04881d05, 23)
-		STEP(H, a, b, c, d, GET(9), 0xd9d4d039, 4)
-		STEP(H, d, a, b, c, GET(12), 0xe6db99e5, 11)
-		STEP(H, c, d, a, b, GET(15), 0x1fa27cf8, 16)
-		STEP(H, b, c, d, a, GET(2), 0xc4ac5665, 23)
+	STEP(H, a, b, c, d, X(5), 0xfffa3942, 4)
+	STEP(H, d, a, b, c, X(8), 0x8771f681, 11)
+	STEP(H, c, d, a, b, X(11), 0x6d9d6122, 16)
+	STEP(H, b, c, d, a, X(14), 0xfde5380c, 23)
+	STEP(H, a, b, c, d, X(1), 0xa4beea44, 4)
+	STEP(H, d, a, b, c, X(4), 0x4bdecfa9, 11)
+	STEP(H, c, d, a, b, X(7), 0xf6bb4b60, 16)
+	STEP(H, b, c, d, a, X(10), 0xbebfbc70, 23)
+	STEP(H, a, b, c, d, X(13), 0x289b7ec6, 4)
+	STEP(H, d, a, b, c, X(0), 0xeaa127fa, 11)
+	STEP(H, c, d, a, b, X(3), 0xd4ef3085, 16)
+	STEP(H, b, c, d, a, X(6), 0x04881d05, 23)
+	STEP(H, a, b, c, d, X(9), 0xd9d4d039, 4)
+	STEP(H, d, a, b, c, X(12), 0xe6db99e5, 11)
+	STEP(H, c, d, a, b, X(15), 0x1fa27cf8, 16)
+	STEP(H, b, c, d, a, X(2), 0xc4ac5665, 23)
 
 /* Round 4 */
-		STEP(I, a, b, c, d, GET(0), 0xf4292244, 6)
-		STEP(I, d, a, b, c, GET(7), 0x432aff97, 10)
-		STEP(I, c, d, a, b, GET(14), 0xab9423a7, 15)
-		STEP(I, b, c, d, a, GET(5), 0xfc93a039, 21)
-		STEP(I, a, b, c, d, GET(12), 0x655b59c3, 6)
-		STEP(I, d, a, b, c, GET(3), 0x8f0ccc92, 10)
-		STEP(I, c, d, a, b, GET(10), 0xffeff47d, 15)
-		STEP(I, b, c, d, a, GET(1), 0x85845dd1, 21)
-		STEP(I, a, b, c, d, GET(8), 0x6fa87e4f, 6)
-		STEP(I, d, a, b, c, GET(15), 0xfe2ce6e0, 10)
-		STEP(I, c, d, a, b, GET(6), 0xa3014314, 15)
-		STEP(I, b, c, d, a, GET(13), 0x4e0811a1, 21)
-		STEP(I, a, b, c, d, GET(4), 0xf7537e82, 6)
-		STEP(I, d, a, b, c, GET(11), 0xbd3af235, 10)
-		STEP(I, c, d, a, b, GET(2), 0x2ad7d2bb, 15)
-		STEP(I, b, c, d, a, GET(9), 0xeb86d391, 21)
-
-		a += saved_a;
-		b += saved_b;
-		c += saved_c;
-		d += saved_d;
+	STEP(I, a, b, c, d, X(0), 0xf4292244, 6)
+	STEP(I, d, a, b, c, X(7), 0x432aff97, 10)
+	STEP(I, c, d, a, b, X(14), 0xab9423a7, 15)
+	STEP(I, b, c, d, a, X(5), 0xfc93a039, 21)
+	STEP(I, a, b, c, d, X(12), 0x655b59c3, 6)
+	STEP(I, d, a, b, c, X(3), 0x8f0ccc92, 10)
+	STEP(I, c, d, a, b, X(10), 0xffeff47d, 15)
+	STEP(I, b, c, d, a, X(1), 0x85845dd1, 21)
+	STEP(I, a, b, c, d, X(8), 0x6fa87e4f, 6)
+	STEP(I, d, a, b, c, X(15), 0xfe2ce6e0, 10)
+	STEP(I, c, d, a, b, X(6), 0xa3014314, 15)
+	STEP(I, b, c, d, a, X(13), 0x4e0811a1, 21)
+	STEP(I, a, b, c, d, X(4), 0xf7537e82, 6)
+	STEP(I, d, a, b, c, X(11), 0xbd3af235, 10)
+	STEP(I, c, d, a, b, X(2), 0x2ad7d2bb, 15)
+	STEP(I, b, c, d, a, X(9), 0xeb86d391, 21)
+
+	ctx->a += a;
+	ctx->b += b;
+	ctx->c += c;
+	ctx->d += d;
+}
+
+/*
+ * This processes one or more 64-byte data blocks, but does NOT update
+ * the bit counters.  There are no alignment requirements.
+ */
+const void *MD5::body(void *ctxBuf, const void *data, size_t size)
+{
+	MD5_CTX *ctx = (MD5_CTX*)ctxBuf;
+	const unsigned char *ptr;
+
+	ptr = (const unsigned char*)data;
+
+	do {
+		decode(ctx->block, ptr);
+		rounds(ctx, ctx->block);
 
 		ptr += 64;
 	} while (size -= 64);
 
-	ctx->a = a;
-	ctx->b = b;
-	ctx->c = c;
-	ctx->d = d;
+	return ptr;
+}
+
+/*
+ * Same as body(), for four contexts at once: every block is decoded once
+ * and then run through the rounds of all four contexts.
+ */
+const void *MD5::body4(void *const ctxBuf[4], const void *data, size_t size)
+{
+	MD5_CTX *first = (MD5_CTX*)ctxBuf[0];
+	const unsigned char *ptr;
+
+	ptr = (const unsigned char*)data;
+
+	do {
+		decode(first->block, ptr);
+		for (int i = 0; i < 4; i++) {
+			rounds((MD5_CTX*)ctxBuf[i], first->block);
+		}
+
+		ptr += 64;
+	} while (size -= 64);
 
 	return ptr;
 }
@@ -224,7 +247,7 @@ void MD5::MD5Update(void *ctxBuf, const void *data, size_t size)
 	if ((ctx->lo = (saved_lo + size) & 0x1fffffff) < saved_lo) {
 		ctx->hi++;
 	}
-	ctx->hi += (unsigned long) (size) >> 29;
+	ctx->hi += (MD5_u32plus) size >> 29;
 
 	used = saved_lo & 0x3f;
 
@@ -250,6 +273,55 @@ void MD5::MD5Update(void *ctxBuf, const void *data, size_t size)
 	memcpy(ctx->buffer, data, size);
 }
 
+/*
+ * Feed the same data to four contexts (e.g. differently seeded hashes of
+ * one file). The contexts must have been fed the same data so far, their
+ * byte counters and buffers are then identical.
+ */
+void MD5::MD5Update4(void *const ctxBuf[4], const void *data, size_t size)
+{
+	MD5_CTX *ctx = (MD5_CTX*)ctxBuf[0];
+	MD5_u32plus saved_lo;
+	MD5_u32plus used, free;
+	int i;
+
+	saved_lo = ctx->lo;
+	for (i = 0; i < 4; i++) {
+		MD5_CTX *lane = (MD5_CTX*)ctxBuf[i];
+		if ((lane->lo = (saved_lo + size) & 0x1fffffff) < saved_lo) {
+			lane->hi++;
+		}
+		lane->hi += (MD5_u32plus) size >> 29;
+	}
+
+	used = saved_lo & 0x3f;
+
+	if (used) {
+		free = 64 - used;
+
+		if (size < free) {
+			for (i = 0; i < 4; i++) {
+				memcpy(&((MD5_CTX*)ctxBuf[i])->buffer[used], data, size);
+			}
+			return;
+		}
+
+		memcpy(&ctx->buffer[used], data, free);
+		data = (unsigned char *)data + free;
+		size -= free;
+		body4(ctxBuf, ctx->buffer, 64);
+	}
+
+	if (size >= 64) {
+		data = body4(ctxBuf, data, size & ~(size_t)0x3f);
+		size &= 0x3f;
+	}
+
+	for (i = 0; i < 4; i++) {
+		memcpy(((MD5_CTX*)ctxBuf[i])->buffer, data, size);
+	}
+}
+
 void MD5::MD5Final(unsigned char *result, void *ctxBuf)
 {
 	MD5_CTX *ctx = (MD5_CTX*)ctxBuf;
@@ -314,12 +386,17 @@ unsigned char* MD5::make_hash(char *arg)
 
 unsigned char* MD5::make_hash(char *arg,size_t size)
 {
-	MD5_CTX context;
 	unsigned char * hash = (unsigned char *) malloc(16);
+	make_hash(hash, arg, size);
+	return hash;
+}
+
+void MD5::make_hash(unsigned char *hash, const char *arg, size_t size)
+{
+	MD5_CTX context;
 	MD5Init(&context);
 	MD5Update(&context, arg, size);
 	MD5Final(hash, &context);
-	return hash;
 }
 
 }
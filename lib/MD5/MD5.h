@@ -23,12 +23,15 @@
 #ifndef MD5_h
 #define MD5_h
 
-#include "Arduino.h"
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
 #include <string.h>
 
 namespace MD5
 {
-	typedef unsigned long MD5_u32plus;
+	// exactly 32 bits on every target (unsigned long is 64 bits on LP64 hosts)
+	typedef uint32_t MD5_u32plus;
 
 	typedef struct {
 		MD5_u32plus lo, hi;
@@ -44,11 +47,16 @@ namespace MD5
 		static unsigned char* make_hash(char *arg);
 		static unsigned char* make_hash(char *arg,size_t size);
 		static char* make_digest(const unsigned char *digest, int len);
+		// non allocating versions, hash holds 16 bytes, md5str len*2+1 chars
+		static void make_hash(unsigned char *hash, const char *arg, size_t size);
+		static void make_digest(char *md5str, const unsigned char *digest, int len);
 		static const void *body(void *ctxBuf, const void *data, size_t size);
+		static const void *body4(void *const ctxBuf[4], const void *data, size_t size);
 		static void MD5Init(void *ctxBuf);
 		static void MD5Initialize(void *ctxBuf, const MD5_u32plus a,const MD5_u32plus b,const MD5_u32plus c,const MD5_u32plus d);
 		static void MD5Final(unsigned char *result, void *ctxBuf);
 		static void MD5Update(void *ctxBuf, const void *data, size_t size);
+		static void MD5Update4(void *const ctxBuf[4], const void *data, size_t size);
 	};
 }
 
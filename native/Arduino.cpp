@@ -0,0 +1,123 @@
+#include <Arduino.h>
+#include <EEPROM.h>
+#include "hal.h"
+
+// Host build: Arduino core functions, see Arduino.h
+
+unsigned long millis()
+{
+  return HAL::millis();
+}
+
+unsigned long micros()
+{
+  return HAL::micros();
+}
+
+void delay(unsigned long ms)
+{
+  HAL::hostAdvance(ms);
+}
+
+void yield()
+{
+  HAL::idle();
+}
+
+void pinMode(uint8_t, uint8_t) {}
+void digitalWrite(uint8_t, uint8_t) {}
+int digitalRead(uint8_t) { return LOW; }
+int analogRead(uint8_t) { return 0; }
+void tone(uint8_t, unsigned int, unsigned long) {}
+void noTone(uint8_t) {}
+
+size_t Print::write(const uint8_t *buffer, size_t size)
+{
+  size_t n = 0;
+  while (size--)
+  {
+    if (write(*buffer++) == 0)
+    {
+      break;
+    }
+    n++;
+  }
+  return n;
+}
+
+size_t Print::print(unsigned long n, int base)
+{
+  char buf[8 * sizeof(long) + 1];
+  char *str = &buf[sizeof(buf) - 1];
+  *str = '\0';
+  if (base < 2)
+  {
+    base = 10;
+  }
+  do
+  {
+    const char c = n % base;
+    n /= base;
+    *--str = c < 10 ? c + '0' : c + 'A' - 10;
+  } while (n);
+  return write(str);
+}
+
+size_t Print::print(long n, int base)
+{
+  if (base == DEC && n < 0)
+  {
+    return print('-') + print((unsigned long) -n, base);
+  }
+  return print((unsigned long) n, base);
+}
+
+// same output as the Arduino core, including its "ovf"
+size_t Print::print(double number, int digits)
+{
+  if (isnan(number)) return write("nan");
+  if (isinf(number)) return write("inf");
+  if (number > 4294967040.0 || number < -4294967040.0) return write("ovf");
+
+  size_t n = 0;
+  if (number < 0.0)
+  {
+    n += print('-');
+    number = -number;
+  }
+  double rounding = 0.5;
+  for (int i = 0; i < digits; i++)
+  {
+    rounding /= 10.0;
+  }
+  number += rounding;
+  const unsigned long int_part = (unsigned long) number;
+  double remainder = number - (double) int_part;
+  n += print(int_part);
+  if (digits > 0)
+  {
+    n += print('.');
+  }
+  while (digits-- > 0)
+  {
+    remainder *= 10.0;
+    const unsigned int digit = (unsigned int) remainder;
+    n += print(digit);
+    remainder -= digit;
+  }
+  return n;
+}
+
+EEPROMClass EEPROM;
+
+uint8_t *EEPROMClass::data()
+{
+  static uint8_t cells[NATIVE_EEPROM_SIZE];
+  static bool erased = false;
+  if (!erased)
+  {
+    memset(cells, 0xFF, sizeof(cells));
+    erased = true;
+  }
+  return cells;
+}
@@ -0,0 +1,40 @@
+#ifndef _NATIVE_EEPROM_H_
+#define _NATIVE_EEPROM_H_
+
+#include <stdint.h>
+#include <string.h>
+
+// Host build: the 4 KB EEPROM of the AtMega2560 in RAM, erased (0xFF)
+// at start. hal_posix.cpp can load and save it as a file.
+#define NATIVE_EEPROM_SIZE 4096
+
+class EEPROMClass
+{
+  public:
+    uint8_t read(int addr) const { return data()[addr]; }
+    void write(int addr, uint8_t value) { data()[addr] = value; }
+    void update(int addr, uint8_t value) { if (read(addr) != value) write(addr, value); }
+    uint16_t length() const { return NATIVE_EEPROM_SIZE; }
+
+    template<typename T> T &get(int addr, T &t) const
+    {
+      memcpy(&t, data() + addr, sizeof(T));
+      return t;
+    }
+    template<typename T> const T &put(int addr, const T &t)
+    {
+      const uint8_t *p = (const uint8_t *) &t;
+      for (size_t i = 0; i < sizeof(T); i++)
+      {
+        update(addr + i, p[i]);
+      }
+      return t;
+    }
+
+    // storage, shared by all EEPROMClass objects
+    static uint8_t *data();
+};
+
+extern EEPROMClass EEPROM;
+
+#endif
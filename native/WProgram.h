@@ -0,0 +1,2 @@
+// pre 1.0 Arduino core header, still included by some libraries
+#include "Arduino.h"
@@ -0,0 +1,30 @@
+#ifndef _NATIVE_PGMSPACE_H_
+#define _NATIVE_PGMSPACE_H_
+
+// Host build: one address space, flash data is plain const data
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+
+#define PROGMEM
+#define PSTR(s) (s)
+
+#define pgm_read_byte(addr) (*(const uint8_t *) (addr))
+#define pgm_read_word(addr) (*(const uint16_t *) (addr))
+#define pgm_read_dword(addr) (*(const uint32_t *) (addr))
+#define pgm_read_float(addr) (*(const float *) (addr))
+#define pgm_read_ptr(addr) (*(void * const *) (addr))
+
+#define strcpy_P strcpy
+#define strncpy_P strncpy
+#define strlen_P strlen
+#define strcmp_P strcmp
+#define strcasecmp_P strcasecmp
+#define memcpy_P memcpy
+#define sprintf_P sprintf
+#define snprintf_P snprintf
+#define vsnprintf_P vsnprintf
+
+#endif
@@ -0,0 +1,58 @@
+#ifndef _NATIVE_POSIX_FILE_H_
+#define _NATIVE_POSIX_FILE_H_
+
+#include <Arduino.h>
+#include <memory>
+
+// Host build: the subset of the SD library's File class the logger uses,
+// on a file or directory below the folder that stands in for the card
+// (see hal_posix.cpp). Copies share the open file, like SD File objects.
+
+// open flags, values of the SD library
+#define O_READ    0x01
+#define O_WRITE   0x02
+#define O_RDWR    (O_READ | O_WRITE)
+#define O_APPEND  0x04
+#define O_CREAT   0x10
+#define O_TRUNC   0x40
+
+#define FILE_READ  O_READ
+#define FILE_WRITE (O_READ | O_WRITE | O_CREAT | O_APPEND)
+
+// FAT directory entry date and time, as in SdFat
+#define FAT_DATE(year, month, day) ((uint16_t) (((year) - 1980) << 9 | (month) << 5 | (day)))
+#define FAT_TIME(hour, minute, second) ((uint16_t) ((hour) << 11 | (minute) << 5 | (second) >> 1))
+
+class PosixFile : public Stream
+{
+  public:
+    struct handle_t;
+
+    PosixFile() {}
+    explicit PosixFile(const std::shared_ptr<handle_t> &handle) : handle(handle) {}
+
+    size_t write(uint8_t c) override { return write(&c, 1); }
+    size_t write(const uint8_t *buffer, size_t size) override;
+    using Print::write;
+    int read() override;
+    int read(void *buffer, uint16_t size);
+    int peek() override;
+    int available() override;
+    void flush() override;
+
+    bool seek(uint32_t pos);
+    uint32_t position();
+    uint32_t size();
+    void close();
+    operator bool() const { return handle != nullptr; }
+
+    const char *name();
+    bool isDirectory();
+    PosixFile openNextFile(uint8_t mode = O_READ);
+    void rewindDirectory();
+
+  private:
+    std::shared_ptr<handle_t> handle;
+};
+
+#endif
@@ -0,0 +1,8 @@
+#ifndef _NATIVE_ATOMIC_H_
+#define _NATIVE_ATOMIC_H_
+
+// Host build: no interrupts, a block is atomic as it is
+#define ATOMIC_RESTORESTATE
+#define ATOMIC_BLOCK(type) for (uint8_t _atomic_once = 1; _atomic_once; _atomic_once = 0)
+
+#endif
@@ -0,0 +1,14 @@
+#ifndef _NATIVE_CRC16_H_
+#define _NATIVE_CRC16_H_
+
+#include <stdint.h>
+
+// C version of the avr-libc inline assembler, same results
+static inline uint16_t _crc_ccitt_update(uint16_t crc, uint8_t data)
+{
+  data ^= (uint8_t) crc;
+  data ^= data << 4;
+  return ((((uint16_t) data << 8) | (crc >> 8)) ^ (uint8_t) (data >> 4) ^ ((uint16_t) data << 3));
+}
+
+#endif
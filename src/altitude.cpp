@@ -0,0 +1,63 @@
+#include "altitude.h"
+
+#ifdef __AVR__
+#include <avr/pgmspace.h>
+#else
+#define PROGMEM
+#define pgm_read_dword(addr) (*(const uint32_t *) (addr))
+#endif
+
+namespace ALTITUDE
+{
+
+// 44330 * (1 - (p / 101325) ^ 0.1903) in cm, p = 300, 310, .. 1100 hPa
+static const uint32_t TABLE_START_Q8 = 30000UL * 256;  // 300 hPa
+static const uint32_t TABLE_STEP_Q8 = 1000UL * 256;    // 10 hPa
+static const uint8_t TABLE_SIZE = 81;
+
+static const int32_t isa_table[TABLE_SIZE] PROGMEM =
+{
+    916537, 894526, 873083, 852175, 831775, 811854, 792389, 773358,
+    754738, 736511, 718658, 701163, 684011, 667186, 650674, 634464,
+    618543, 602900, 587524, 572406, 557535, 542903, 528501, 514322,
+    500358, 486602, 473047, 459686, 446514, 433525, 420713, 408072,
+    395598, 383286, 371131, 359129, 347276, 335567, 323998, 312567,
+    301269, 290101, 279060, 268142, 257345, 246665, 236099, 225646,
+    215302, 205065, 194932, 184902, 174971, 165137, 155400, 145755,
+    136202, 126739, 117363, 108073, 98867, 89744, 80701, 71738,
+    62853, 54043, 45309, 36647, 28058, 19540, 11090, 2709,
+    -5605, -13853, -22037, -30157, -38215, -46212, -54148, -62025,
+    -69844,
+};
+
+int32_t isaAltitude(uint32_t pressure_q8)
+{
+    // outside the table the end segments are extrapolated
+    uint8_t index = 0;
+    int32_t offset = (int32_t) (pressure_q8 - TABLE_START_Q8);
+    if (pressure_q8 >= TABLE_START_Q8)
+    {
+        index = (pressure_q8 - TABLE_START_Q8) / TABLE_STEP_Q8;
+        if (index > TABLE_SIZE - 2)
+        {
+            index = TABLE_SIZE - 2;
+        }
+        offset -= (int32_t) index * TABLE_STEP_Q8;
+    }
+    const int32_t h0 = (int32_t) pgm_read_dword(&isa_table[index]);
+    const int32_t h1 = (int32_t) pgm_read_dword(&isa_table[index + 1]);
+    // offset in 1/16 Pa keeps the product within 32 bits
+    return h0 + (h1 - h0) * (offset >> 4) / (int32_t) (TABLE_STEP_Q8 >> 4);
+}
+
+float altitude(uint32_t pressure_q8, float seaLevelhPa)
+{
+    if (seaLevelhPa != ISA_SEA_LEVEL_HPA)
+    {
+        // the altitude only depends on p / p0
+        pressure_q8 = (uint32_t) (pressure_q8 * (ISA_SEA_LEVEL_HPA / seaLevelhPa));
+    }
+    return isaAltitude(pressure_q8) / 100.0f;
+}
+
+} // ALTITUDE namespace
@@ -1,251 +1,700 @@
+#include <EEPROM.h>
+#include <stddef.h>
+#include <util/crc16.h>
 #include "config.h"
+#include "logger.h"
+#include "hal.h"
+#include "sd_prealloc.h"
+#include "eeprom_layout.h"
 
-// defaults
+// keys in config.ini, with their defaults in the same notation
 namespace CONFIG
 {
-  static const unsigned long CONFIG_DEFAULT_BAUDATE = 9600;
-  static const char* CONFIG_DEFAULT_PILOT = "John Doe";
-  static const char* CONFIG_DEFAULT_COPILOT = "not recorded";
-  static const char* CONFIG_DEFAULT_TYPE = "Astir";
-  static const char* CONFIG_DEFAULT_REG = "PH-XXX";
-  static const char* CONFIG_DEFAULT_CS = "XXX";
-  static const char* CONFIG_DEFAULT_CLASS = "Club";
-  static const char* CONFIG_DEFAULT_GPS = "Beitian BN-880Q";
-  static const float CONFIG_DEFAULT_LIFTOFF_THRESHOLD = 1.5;
-  static const bool CONFIG_DEFAULT_LIFTOFF_DETECT_ENABLE = true;
-  static const int CONFIG_DEFAULT_LOG_INTERVAL = 2;
+  enum section_t
+  {
+    SECTION_IGCHEADER,
+    SECTION_GPS,
+    SECTION_CONFIG,
+    SECTION_COUNT
+  };
+
+  enum value_type_t
+  {
+    TYPE_STRING,
+    TYPE_ULONG,
+    TYPE_INT,
+    TYPE_BOOL,
+    TYPE_FLOAT
+  };
+
+  typedef struct
+  {
+    uint8_t section;        // section_t
+    uint8_t type;           // value_type_t
+    uint8_t offset;         // of the field in config_t
+    uint8_t size;           // max. string length + 1 (strings only)
+    const char *key;        // PROGMEM
+    const char *def_value;  // PROGMEM
+  } config_key_t;
+
+  static const char section_igcheader[] PROGMEM = "igcheader";
+  static const char section_gps[] PROGMEM = "gps";
+  static const char section_config[] PROGMEM = "config";
+  static const char *const sections[SECTION_COUNT] PROGMEM =
+  {
+    section_igcheader, section_gps, section_config
+  };
+
+#define CONFIG_KEY(name, text) static const char name[] PROGMEM = text;
+  CONFIG_KEY(key_pilot, "Pilot")
+  CONFIG_KEY(key_copilot, "CoPilot")
+  CONFIG_KEY(key_type, "Type")
+  CONFIG_KEY(key_reg, "Registration")
+  CONFIG_KEY(key_cs, "CallSign")
+  CONFIG_KEY(key_cls, "Class")
+  CONFIG_KEY(key_baudrate, "Baudrate")
+  CONFIG_KEY(key_log_interval, "log_interval")
+  CONFIG_KEY(key_adaptive_logging, "adaptive_logging")
+  CONFIG_KEY(key_log_interval_min, "log_interval_min")
+  CONFIG_KEY(key_log_interval_max, "log_interval_max")
+  CONFIG_KEY(key_liftoff_threshold, "liftoff_threshold")
+  CONFIG_KEY(key_liftoff_detection, "liftoff_detection")
+  CONFIG_KEY(key_vario_filter, "vario_filter")
+  CONFIG_KEY(key_takeoff_speed, "takeoff_speed")
+  CONFIG_KEY(key_landing_time, "landing_time")
+  CONFIG_KEY(key_keep_file_open, "keep_file_open")
+  CONFIG_KEY(key_sync_records, "sync_records")
+  CONFIG_KEY(key_sync_interval, "sync_interval")
+  CONFIG_KEY(key_flush_interval, "flush_interval")
+  CONFIG_KEY(key_max_flight_hours, "max_flight_hours")
+  CONFIG_KEY(key_grecord_deferred, "grecord_deferred")
+  CONFIG_KEY(key_grecord_checkpoint, "grecord_checkpoint")
+  CONFIG_KEY(key_journal, "journal")
+
+  // defaults
+  CONFIG_KEY(CONFIG_DEFAULT_PILOT, "John Doe")
+  CONFIG_KEY(CONFIG_DEFAULT_COPILOT, "not recorded")
+  CONFIG_KEY(CONFIG_DEFAULT_TYPE, "Astir")
+  CONFIG_KEY(CONFIG_DEFAULT_REG, "PH-XXX")
+  CONFIG_KEY(CONFIG_DEFAULT_CS, "XXX")
+  CONFIG_KEY(CONFIG_DEFAULT_CLASS, "Club")
+  CONFIG_KEY(CONFIG_DEFAULT_GPS, "Beitian BN-880Q")
+  CONFIG_KEY(CONFIG_DEFAULT_BAUDATE, "9600")
+  CONFIG_KEY(CONFIG_DEFAULT_LIFTOFF_THRESHOLD, "1.5")
+  CONFIG_KEY(CONFIG_DEFAULT_LIFTOFF_DETECT_ENABLE, "true")
+  CONFIG_KEY(CONFIG_DEFAULT_VARIO_FILTER, "1.5")
+  CONFIG_KEY(CONFIG_DEFAULT_TAKEOFF_SPEED, "10")
+  CONFIG_KEY(CONFIG_DEFAULT_LANDING_TIME, "30")
+  CONFIG_KEY(CONFIG_DEFAULT_LOG_INTERVAL, "2")
+  CONFIG_KEY(CONFIG_DEFAULT_ADAPTIVE_LOGGING, "false")
+  CONFIG_KEY(CONFIG_DEFAULT_LOG_INTERVAL_MIN, "1")
+  CONFIG_KEY(CONFIG_DEFAULT_LOG_INTERVAL_MAX, "4")
+  CONFIG_KEY(CONFIG_DEFAULT_KEEP_FILE_OPEN, "false")
+  CONFIG_KEY(CONFIG_DEFAULT_SYNC_RECORDS, "10")
+  CONFIG_KEY(CONFIG_DEFAULT_SYNC_INTERVAL, "30")
+  CONFIG_KEY(CONFIG_DEFAULT_FLUSH_INTERVAL, "15")
+  CONFIG_KEY(CONFIG_DEFAULT_MAX_FLIGHT_HOURS, "0")
+  CONFIG_KEY(CONFIG_DEFAULT_GRECORD_DEFERRED, "false")
+  CONFIG_KEY(CONFIG_DEFAULT_GRECORD_CHECKPOINT, "5")
+  CONFIG_KEY(CONFIG_DEFAULT_JOURNAL, "false")
+#undef CONFIG_KEY
+
+#define CONFIG_FIELD(field) offsetof(config_t, field)
+  static const config_key_t keys[] PROGMEM =
+  {
+    { SECTION_IGCHEADER, TYPE_STRING, CONFIG_FIELD(pilot), 80, key_pilot, CONFIG_DEFAULT_PILOT },
+    { SECTION_IGCHEADER, TYPE_STRING, CONFIG_FIELD(copilot), 80, key_copilot, CONFIG_DEFAULT_COPILOT },
+    { SECTION_IGCHEADER, TYPE_STRING, CONFIG_FIELD(type), 40, key_type, CONFIG_DEFAULT_TYPE },
+    { SECTION_IGCHEADER, TYPE_STRING, CONFIG_FIELD(cs), 10, key_cs, CONFIG_DEFAULT_CS },
+    { SECTION_IGCHEADER, TYPE_STRING, CONFIG_FIELD(reg), 10, key_reg, CONFIG_DEFAULT_REG },
+    { SECTION_IGCHEADER, TYPE_STRING, CONFIG_FIELD(cls), 20, key_cls, CONFIG_DEFAULT_CLASS },
+    { SECTION_GPS, TYPE_STRING, CONFIG_FIELD(gps), 50, key_type, CONFIG_DEFAULT_GPS },
+    { SECTION_GPS, TYPE_ULONG, CONFIG_FIELD(baudrate), 0, key_baudrate, CONFIG_DEFAULT_BAUDATE },
+    { SECTION_CONFIG, TYPE_INT, CONFIG_FIELD(log_interval), 0, key_log_interval, CONFIG_DEFAULT_LOG_INTERVAL },
+    { SECTION_CONFIG, TYPE_BOOL, CONFIG_FIELD(adaptive_logging), 0, key_adaptive_logging, CONFIG_DEFAULT_ADAPTIVE_LOGGING },
+    { SECTION_CONFIG, TYPE_INT, CONFIG_FIELD(log_interval_min), 0, key_log_interval_min, CONFIG_DEFAULT_LOG_INTERVAL_MIN },
+    { SECTION_CONFIG, TYPE_INT, CONFIG_FIELD(log_interval_max), 0, key_log_interval_max, CONFIG_DEFAULT_LOG_INTERVAL_MAX },
+    { SECTION_CONFIG, TYPE_FLOAT, CONFIG_FIELD(liftoff_threshold), 0, key_liftoff_threshold, CONFIG_DEFAULT_LIFTOFF_THRESHOLD },
+    { SECTION_CONFIG, TYPE_BOOL, CONFIG_FIELD(liftoff_detection), 0, key_liftoff_detection, CONFIG_DEFAULT_LIFTOFF_DETECT_ENABLE },
+    { SECTION_CONFIG, TYPE_FLOAT, CONFIG_FIELD(vario_filter), 0, key_vario_filter, CONFIG_DEFAULT_VARIO_FILTER },
+    { SECTION_CONFIG, TYPE_INT, CONFIG_FIELD(takeoff_speed), 0, key_takeoff_speed, CONFIG_DEFAULT_TAKEOFF_SPEED },
+    { SECTION_CONFIG, TYPE_INT, CONFIG_FIELD(landing_time), 0, key_landing_time, CONFIG_DEFAULT_LANDING_TIME },
+    { SECTION_CONFIG, TYPE_BOOL, CONFIG_FIELD(keep_file_open), 0, key_keep_file_open, CONFIG_DEFAULT_KEEP_FILE_OPEN },
+    { SECTION_CONFIG, TYPE_INT, CONFIG_FIELD(sync_records), 0, key_sync_records, CONFIG_DEFAULT_SYNC_RECORDS },
+    { SECTION_CONFIG, TYPE_INT, CONFIG_FIELD(sync_interval), 0, key_sync_interval, CONFIG_DEFAULT_SYNC_INTERVAL },
+    { SECTION_CONFIG, TYPE_INT, CONFIG_FIELD(flush_interval), 0, key_flush_interval, CONFIG_DEFAULT_FLUSH_INTERVAL },
+    { SECTION_CONFIG, TYPE_INT, CONFIG_FIELD(max_flight_hours), 0, key_max_flight_hours, CONFIG_DEFAULT_MAX_FLIGHT_HOURS },
+    { SECTION_CONFIG, TYPE_BOOL, CONFIG_FIELD(grecord_deferred), 0, key_grecord_deferred, CONFIG_DEFAULT_GRECORD_DEFERRED },
+    { SECTION_CONFIG, TYPE_INT, CONFIG_FIELD(grecord_checkpoint), 0, key_grecord_checkpoint, CONFIG_DEFAULT_GRECORD_CHECKPOINT },
+    { SECTION_CONFIG, TYPE_BOOL, CONFIG_FIELD(journal), 0, key_journal, CONFIG_DEFAULT_JOURNAL },
+  };
+#undef CONFIG_FIELD
+  static const uint8_t KEY_COUNT = sizeof(keys) / sizeof(keys[0]);
+  static_assert(sizeof(keys) / sizeof(keys[0]) <= 32, "seen mask is 32 bits");
+
+  // sum of the string sizes above
+  static const uint16_t STRINGS_SIZE = 80 + 80 + 40 + 10 + 10 + 20 + 50;
+
+  // strings of the current config
+  static char *arena = NULL;
 }
 
-void printErrorMessage(uint8_t e, bool eol = true)
+// strings are collected here while parsing, then moved to the arena
+typedef struct
+{
+  char buffer[CONFIG::STRINGS_SIZE];
+  uint16_t used;
+  uint16_t position[CONFIG::KEY_COUNT];
+} string_scratch_t;
+
+static void setValue(const CONFIG::config_key_t &key, const char *value, config_t &config, string_scratch_t &strings, uint8_t index)
 {
-  switch (e) 
+  void *field = (uint8_t *) &config + pgm_read_byte(&key.offset);
+  switch (pgm_read_byte(&key.type))
   {
-  case IniFile::errorNoError:
-    Serial.print("no error");
-    break;
-  case IniFile::errorFileNotFound:
-    Serial.print("file not found");
-    break;
-  case IniFile::errorFileNotOpen:
-    Serial.print("file not open");
-    break;
-  case IniFile::errorBufferTooSmall:
-    Serial.print("buffer too small");
-    break;
-  case IniFile::errorSeekError:
-    Serial.print("seek error");
-    break;
-  case IniFile::errorSectionNotFound:
-    Serial.print("section not found");
-    break;
-  case IniFile::errorKeyNotFound:
-    Serial.print("key not found");
-    break;
-  case IniFile::errorEndOfFile:
-    Serial.print("end of file");
-    break;
-  case IniFile::errorUnknownError:
-    Serial.print("unknown error");
-    break;
-  default:
-    Serial.print("unknown error value");
-    break;
+    case CONFIG::TYPE_STRING:
+    {
+      const uint8_t size = pgm_read_byte(&key.size);
+      char *dst = strings.buffer + strings.used;
+      strncpy(dst, value, size - 1);
+      dst[size - 1] = '\0';
+      strings.position[index] = strings.used;
+      strings.used += strlen(dst) + 1;
+      break;
+    }
+    case CONFIG::TYPE_ULONG:
+      *(unsigned long *) field = strtoul(value, NULL, 10);
+      break;
+    case CONFIG::TYPE_INT:
+      *(int *) field = atoi(value);
+      break;
+    case CONFIG::TYPE_BOOL:
+      *(bool *) field = strcasecmp_P(value, PSTR("true")) == 0;
+      break;
+    case CONFIG::TYPE_FLOAT:
+      *(float *) field = atof(value);
+      break;
   }
-  if (eol) 
+}
+
+static void setDefault(const CONFIG::config_key_t &key, config_t &config, string_scratch_t &strings, uint8_t index)
+{
+  char value[20];
+  const char *def_value = (const char *) pgm_read_ptr(&key.def_value);
+  if (pgm_read_byte(&key.type) == CONFIG::TYPE_STRING)
   {
-    Serial.println();
+    // copy straight from flash, may be longer than value
+    char *dst = strings.buffer + strings.used;
+    strcpy_P(dst, def_value);
+    strings.position[index] = strings.used;
+    strings.used += strlen(dst) + 1;
+    return;
   }
+  strncpy_P(value, def_value, sizeof(value) - 1);
+  value[sizeof(value) - 1] = '\0';
+  setValue(key, value, config, strings, index);
 }
 
-static void getStringValue(IniFile &ini, const char *section, const char* key, char* result, const char* def_value)
+// (re)size the string arena, it is only allocated once
+static bool allocArena(uint16_t size)
 {
-  const size_t bufferLen = 80;
-  char iniline[bufferLen];
-
-  strcpy(result,def_value);
-  if (ini.getValue(section, key, iniline, bufferLen)) 
+  char *arena = (char *) realloc(CONFIG::arena, size);
+  if (arena == NULL)
   {
-    strcpy(result,iniline);
+    HAL::console().println(F("Out of memory for config!"));
+    return false;
   }
-  else 
+  CONFIG::arena = arena;
+  return true;
+}
+
+// string pointer of key index in config
+static const char *&stringField(config_t &config, uint8_t index)
+{
+  return *(const char **) ((uint8_t *) &config + pgm_read_byte(&CONFIG::keys[index].offset));
+}
+
+// longest log interval, s
+#define CONFIG_MAX_LOG_INTERVAL 3600
+
+static int limitInt(int value, int low, int high, const char *key)
+{
+  const int limited = constrain(value, low, high);
+  if (limited != value)
   {
-    char err[200];
-    snprintf(err,sizeof(err), "Could not read '%s' from section '%s', will use default '%s', error: ", 
-      key,section, def_value);
-    Serial.print(err);
-    printErrorMessage(ini.getError());
+    HAL::console().print((const __FlashStringHelper *) key);
+    HAL::console().print(F(" out of range, using "));
+    HAL::console().println(limited);
   }
+  return limited;
 }
 
-static void getULongValue(IniFile &ini, const char *section, const char* key, unsigned long &result, const unsigned long def_value)
+static unsigned long limitULong(unsigned long value, unsigned long low, unsigned long high, const char *key)
 {
-  const size_t bufferLen = 80;
-  char iniline[bufferLen];
-
-  result = def_value;
-  if (ini.getValue(section, key, iniline, bufferLen)) {
-    result = atol(iniline);
+  const unsigned long limited = constrain(value, low, high);
+  if (limited != value)
+  {
+    HAL::console().print((const __FlashStringHelper *) key);
+    HAL::console().print(F(" out of range, using "));
+    HAL::console().println(limited);
   }
-  else {
-    char err[200];
-    snprintf(err,sizeof(err),"Could not read '%s' from section '%s', will use default %ld, error: ",
-        key,section,def_value);
-    Serial.print(err);
-    printErrorMessage(ini.getError());
+  return limited;
+}
+
+// nan is out of range too and becomes low
+static float limitFloat(float value, float low, float high, const char *key)
+{
+  const float limited = value >= low ? (value <= high ? value : high) : low;
+  if (!(limited == value))
+  {
+    HAL::console().print((const __FlashStringHelper *) key);
+    HAL::console().print(F(" out of range, using "));
+    HAL::console().println(limited);
   }
+  return limited;
+}
+
+// every numeric value, from config.ini and from the EEPROM snapshot: the
+// logger divides by some, keeps others in 16 bit fields or multiplies
+// them into ms
+static void limitConfig(config_t &config)
+{
+  // config_t is packed, no references to its fields
+  config.baudrate = limitULong(config.baudrate, 1200, 115200, CONFIG::key_baudrate);
+  config.log_interval = limitInt(config.log_interval, 1, CONFIG_MAX_LOG_INTERVAL,
+                                 CONFIG::key_log_interval);
+  config.log_interval_min = limitInt(config.log_interval_min, 1, CONFIG_MAX_LOG_INTERVAL,
+                                     CONFIG::key_log_interval_min);
+  config.log_interval_max = limitInt(config.log_interval_max, config.log_interval_min,
+                                     CONFIG_MAX_LOG_INTERVAL, CONFIG::key_log_interval_max);
+  config.liftoff_threshold = limitFloat(config.liftoff_threshold, 0.1f, 10.0f,
+                                        CONFIG::key_liftoff_threshold);
+  // time constant of the vario filter, s
+  config.vario_filter = limitFloat(config.vario_filter, 0.1f, 60.0f, CONFIG::key_vario_filter);
+  config.takeoff_speed = limitInt(config.takeoff_speed, 1, 300, CONFIG::key_takeoff_speed);
+  config.landing_time = limitInt(config.landing_time, 0, 3600, CONFIG::key_landing_time);
+  config.sync_records = limitInt(config.sync_records, 0, 1000, CONFIG::key_sync_records);
+  config.sync_interval = limitInt(config.sync_interval, 0, 3600, CONFIG::key_sync_interval);
+  config.flush_interval = limitInt(config.flush_interval, 0, IGC::MAX_FLUSH_INTERVAL,
+                                   CONFIG::key_flush_interval);
+  config.max_flight_hours = limitInt(config.max_flight_hours, 0, 24, CONFIG::key_max_flight_hours);
+  config.grecord_checkpoint = limitInt(config.grecord_checkpoint, 0, 1440,
+                                       CONFIG::key_grecord_checkpoint);
 }
 
-static void getIntValue(IniFile &ini, const char *section, const char* key, int &result, const int def_value)
+// Binary copy of the parsed config in EEPROM, used instead of config.ini
+// as long as size and last write time of the file and the key table of
+// the firmware do not change. String pointers are stored as offsets into
+// the arena, which follows config_t.
+#define CONFIG_SNAPSHOT_MAGIC   0x4643  // "CF"
+#define CONFIG_SNAPSHOT_VERSION 2
+
+typedef struct __attribute__((__packed__))
 {
-  const size_t bufferLen = 80;
-  char iniline[bufferLen];
+  uint16_t magic;
+  uint8_t version;
+  uint8_t layout;       // sizeof(config_t)
+  uint32_t ini_size;
+  uint32_t ini_stamp;   // FAT date << 16 | FAT time
+  uint16_t strings;     // arena size
+  uint16_t crc;         // CRC-CCITT of config_t + arena
+  uint16_t keys;        // keysCrc() of the firmware that wrote it
+} config_snapshot_t;
 
-  result = def_value;
-  if (ini.getValue(section, key, iniline, bufferLen)) {
-    result = atoi(iniline);
+static uint16_t crcUpdate(uint16_t crc, const uint8_t *data, uint16_t len)
+{
+  while (len--)
+  {
+    crc = _crc_ccitt_update(crc, *data++);
   }
-  else {
-    char err[200];
-    snprintf(err,sizeof(err),"Could not read '%s' from section '%s', will use default %d, error: ",
-        key,section,def_value);
-    Serial.print(err);
-    printErrorMessage(ini.getError());
+  return crc;
+}
+
+static uint16_t crcUpdate_P(uint16_t crc, const char *text)
+{
+  char c;
+  do
+  {
+    c = pgm_read_byte(text++);
+    crc = _crc_ccitt_update(crc, c);
+  } while (c != '\0');
+  return crc;
+}
+
+// CRC-CCITT of the key table with names and defaults: keys that are not
+// in config.ini take their default, so a firmware with other defaults
+// must not use the snapshot of the previous one
+static uint16_t keysCrc()
+{
+  uint16_t crc = 0xffff;
+  for (uint8_t i = 0; i < CONFIG::KEY_COUNT; i++)
+  {
+    const CONFIG::config_key_t &key = CONFIG::keys[i];
+    crc = _crc_ccitt_update(crc, pgm_read_byte(&key.section));
+    crc = _crc_ccitt_update(crc, pgm_read_byte(&key.type));
+    crc = _crc_ccitt_update(crc, pgm_read_byte(&key.offset));
+    crc = _crc_ccitt_update(crc, pgm_read_byte(&key.size));
+    crc = crcUpdate_P(crc, (const char *) pgm_read_ptr(&key.key));
+    crc = crcUpdate_P(crc, (const char *) pgm_read_ptr(&key.def_value));
   }
+  return crc;
 }
 
-static void getBoolValue(IniFile &ini, const char *section, const char* key, bool &result, const bool def_value)
+static void saveSnapshot(const config_t &config, uint16_t strings, uint32_t ini_size, uint32_t ini_stamp)
 {
-  const size_t bufferLen = 80;
-  char iniline[bufferLen];
+  if (sizeof(config_snapshot_t) + sizeof(config_t) + strings > EEPROM_CONFIG_SIZE)
+  {
+    return;
+  }
+  config_t stored = config;
+  for (uint8_t i = 0; i < CONFIG::KEY_COUNT; i++)
+  {
+    if (pgm_read_byte(&CONFIG::keys[i].type) == CONFIG::TYPE_STRING)
+    {
+      const char *&field = stringField(stored, i);
+      field = (const char *) (uintptr_t) (field - CONFIG::arena);
+    }
+  }
+  config_snapshot_t header;
+  header.magic = CONFIG_SNAPSHOT_MAGIC;
+  header.version = CONFIG_SNAPSHOT_VERSION;
+  header.layout = sizeof(config_t);
+  header.ini_size = ini_size;
+  header.ini_stamp = ini_stamp;
+  header.strings = strings;
+  header.crc = crcUpdate(crcUpdate(0xffff, (const uint8_t *) &stored, sizeof(stored)),
+                         (const uint8_t *) CONFIG::arena, strings);
+  header.keys = keysCrc();
 
-  result = def_value;
-  if (ini.getValue(section, key, iniline, bufferLen)) {
-    result = strcasecmp("true",iniline) == 0;
+  // update() only writes the bytes that changed
+  int addr = EEPROM_CONFIG_ADDR;
+  const uint8_t *data = (const uint8_t *) &header;
+  for (uint16_t i = 0; i < sizeof(header); i++)
+  {
+    EEPROM.update(addr++, data[i]);
   }
-  else {
-    char err[200];
-    snprintf(err,sizeof(err),"Could not read '%s' from section '%s', will use default %d, error: ",
-        key,section,def_value);
-    Serial.print(err);
-    printErrorMessage(ini.getError());
+  data = (const uint8_t *) &stored;
+  for (uint16_t i = 0; i < sizeof(stored); i++)
+  {
+    EEPROM.update(addr++, data[i]);
+  }
+  for (uint16_t i = 0; i < strings; i++)
+  {
+    EEPROM.update(addr++, CONFIG::arena[i]);
   }
+  HAL::console().println(F("Config snapshot saved to EEPROM"));
 }
 
-static void getDoubleValue(IniFile &ini, const char *section, const char* key, double &result, const double def_value)
+static bool loadSnapshot(config_t &config, uint32_t ini_size, uint32_t ini_stamp)
 {
-  const size_t bufferLen = 80;
-  char iniline[bufferLen];
+  config_snapshot_t header;
+  EEPROM.get(EEPROM_CONFIG_ADDR, header);
+  if (header.magic != CONFIG_SNAPSHOT_MAGIC ||
+      header.version != CONFIG_SNAPSHOT_VERSION ||
+      header.layout != sizeof(config_t) ||
+      header.ini_size != ini_size ||
+      header.ini_stamp != ini_stamp ||
+      header.keys != keysCrc() ||
+      sizeof(header) + sizeof(config_t) + header.strings > EEPROM_CONFIG_SIZE)
+  {
+    return false;
+  }
+  config_t stored;
+  int addr = EEPROM_CONFIG_ADDR + sizeof(header);
+  EEPROM.get(addr, stored);
+  addr += sizeof(stored);
+  if (!allocArena(header.strings))
+  {
+    return false;
+  }
+  for (uint16_t i = 0; i < header.strings; i++)
+  {
+    CONFIG::arena[i] = EEPROM.read(addr++);
+  }
+  const uint16_t crc = crcUpdate(crcUpdate(0xffff, (const uint8_t *) &stored, sizeof(stored)),
+                                 (const uint8_t *) CONFIG::arena, header.strings);
+  if (crc != header.crc)
+  {
+    HAL::console().println(F("Config snapshot corrupt"));
+    return false;
+  }
+  for (uint8_t i = 0; i < CONFIG::KEY_COUNT; i++)
+  {
+    if (pgm_read_byte(&CONFIG::keys[i].type) == CONFIG::TYPE_STRING)
+    {
+      const char *&field = stringField(stored, i);
+      const uint16_t offset = (uintptr_t) field;
+      if (offset >= header.strings)
+      {
+        return false;
+      }
+      field = CONFIG::arena + offset;
+    }
+  }
+  config = stored;
+  return true;
+}
 
-  result = def_value;
-  if (ini.getValue(section, key, iniline, bufferLen)) {
-    result = atof(iniline);
+// index of section/key in the key table, -1 if unknown
+static int8_t findKey(int8_t section, const char *name)
+{
+  for (uint8_t i = 0; i < CONFIG::KEY_COUNT; i++)
+  {
+    if (pgm_read_byte(&CONFIG::keys[i].section) == section &&
+        strcasecmp_P(name, (const char *) pgm_read_ptr(&CONFIG::keys[i].key)) == 0)
+    {
+      return i;
+    }
   }
-  else {
-    char err[200];
-    snprintf(err,sizeof(err),"Could not read '%s' from section '%s', will use default %f, error: ",
-        key,section,def_value);
-    Serial.print(err);
-    printErrorMessage(ini.getError());
+  return -1;
+}
+
+static int8_t findSection(const char *name)
+{
+  for (uint8_t i = 0; i < CONFIG::SECTION_COUNT; i++)
+  {
+    if (strcasecmp_P(name, (const char *) pgm_read_ptr(&CONFIG::sections[i])) == 0)
+    {
+      return i;
+    }
   }
+  return -1;
 }
 
-/*
-; Simple IGC Logger configuration file
-[igcheader]
-Pilot=Pietje Puk
-CoPilot=John Doe
-Type=Duo Discus
-Registration=PH-1035
-CallSign=SAL
-Class=Two Seater
+static char *trim(char *text)
+{
+  while (*text == ' ' || *text == '\t')
+  {
+    text++;
+  }
+  char *end = text + strlen(text);
+  while (end > text && (end[-1] == ' ' || end[-1] == '\t'))
+  {
+    *(--end) = '\0';
+  }
+  return text;
+}
 
-[gps]
-; baudrate of GPS, default is 9600 Bd
-Baudrate=38400
-Type=Beitian BN-880Q
-*/
+// one line of the ini file: [section], key=value or a ; or # comment
+static void parseLine(char *line, int8_t &section, uint32_t &seen, config_t &config, string_scratch_t &strings)
+{
+  line = trim(line);
+  if (*line == '\0' || *line == ';' || *line == '#')
+  {
+    return;
+  }
+  if (*line == '[')
+  {
+    char *end = strchr(line, ']');
+    if (end != NULL)
+    {
+      *end = '\0';
+    }
+    section = findSection(trim(line + 1));
+    return;
+  }
+  char *value = strchr(line, '=');
+  if (value == NULL || section < 0)
+  {
+    return;
+  }
+  *value++ = '\0';
+  const int8_t index = findKey(section, trim(line));
+  if (index < 0 || (seen & (1UL << index)))
+  {
+    // unknown key, or later duplicate (the first one counts)
+    return;
+  }
+  setValue(CONFIG::keys[index], trim(value), config, strings, index);
+  seen |= 1UL << index;
+}
 
 bool readConfig(const char* iniFilename, config_t &config)
 {
-  const size_t bufferLen = 80;
-  char iniline[bufferLen];
-
-  // init config with defaults
-  strncpy(config.pilot,CONFIG::CONFIG_DEFAULT_PILOT, sizeof(config.pilot));
-  strncpy(config.copilot, CONFIG::CONFIG_DEFAULT_COPILOT, sizeof(config.copilot));
-  strncpy(config.type, CONFIG::CONFIG_DEFAULT_TYPE, sizeof(config.type));
-  strncpy(config.reg, CONFIG::CONFIG_DEFAULT_REG, sizeof(config.reg));
-  strncpy(config.cs, CONFIG::CONFIG_DEFAULT_CS, sizeof(config.cs));
-  strncpy(config.cls, CONFIG::CONFIG_DEFAULT_CLASS, sizeof(config.cls));
-  config.baudrate = CONFIG::CONFIG_DEFAULT_BAUDATE;
-  config.liftoff_detection = CONFIG::CONFIG_DEFAULT_LIFTOFF_DETECT_ENABLE;
-  config.liftoff_threshold = CONFIG::CONFIG_DEFAULT_LIFTOFF_THRESHOLD;
-  config.log_interval = CONFIG::CONFIG_DEFAULT_LOG_INTERVAL;
-
-  IniFile ini(iniFilename);
-  if (!ini.open()) 
-  {
-    Serial.print("Ini file '");
-    Serial.print(iniFilename);
-    Serial.println("' does not exist");
-    return false;
+  const unsigned long start = HAL::millis();
+
+  // config.ini unchanged since the last boot?
+  uint32_t ini_size = 0;
+  uint32_t ini_stamp = 0;
+  const bool have_info = sdFileInfo(iniFilename, ini_size, ini_stamp);
+  if (have_info && loadSnapshot(config, ini_size, ini_stamp))
+  {
+    limitConfig(config);
+    HAL::console().print(F("Config from EEPROM snapshot in "));
+    HAL::console().print(HAL::millis() - start);
+    HAL::console().println(F(" ms"));
+    return true;
+  }
+
+  string_scratch_t strings;
+  strings.used = 0;
+  uint32_t seen = 0;
+  bool result = true;
+
+  HAL::File ini = HAL::fsOpen(iniFilename, FILE_READ);
+  if (!ini) 
+  {
+    HAL::console().print(F("Ini file '"));
+    HAL::console().print(iniFilename);
+    HAL::console().println(F("' does not exist"));
+    result = false;
+  }
+  else
+  {
+    // single pass over the file, in chunks
+    char chunk[64];
+    char line[80];
+    uint8_t len = 0;
+    bool overflow = false;
+    int8_t section = -1;
+    int count;
+    while ((count = ini.read(chunk, sizeof(chunk))) > 0)
+    {
+      for (int i = 0; i < count; i++)
+      {
+        const char c = chunk[i];
+        if (c == '\n' || c == '\r')
+        {
+          line[len] = '\0';
+          if (overflow)
+          {
+            HAL::console().print(F("Line too long in ini file: "));
+            HAL::console().println(line);
+          }
+          else
+          {
+            parseLine(line, section, seen, config, strings);
+          }
+          len = 0;
+          overflow = false;
+        }
+        else if (len < sizeof(line) - 1)
+        {
+          line[len++] = c;
+        }
+        else
+        {
+          overflow = true;
+        }
+      }
+    }
+    if (len > 0 && !overflow)
+    {
+      // last line without EOL
+      line[len] = '\0';
+      parseLine(line, section, seen, config, strings);
+    }
+    ini.close();
+  }
+
+  for (uint8_t i = 0; i < CONFIG::KEY_COUNT; i++)
+  {
+    if (seen & (1UL << i))
+    {
+      continue;
+    }
+    const CONFIG::config_key_t &key = CONFIG::keys[i];
+    if (result)
+    {
+      HAL::console().print(F("Could not read '"));
+      HAL::console().print((const __FlashStringHelper *) pgm_read_ptr(&key.key));
+      HAL::console().print(F("' from section '"));
+      HAL::console().print((const __FlashStringHelper *) pgm_read_ptr(&CONFIG::sections[pgm_read_byte(&key.section)]));
+      HAL::console().print(F("', will use default '"));
+      HAL::console().print((const __FlashStringHelper *) pgm_read_ptr(&key.def_value));
+      HAL::console().println('\'');
+    }
+    setDefault(key, config, strings, i);
   }
-  // Check the file is valid. This can be used to warn if any lines
-  // are longer than the buffer.
-  if (!ini.validate(iniline, bufferLen)) 
+
+  limitConfig(config);
+
+  // move the strings to an arena of the right size
+  if (!allocArena(strings.used))
   {
-    Serial.print("ini file ");
-    Serial.print(ini.getFilename());
-    Serial.print(" not valid: ");
-    printErrorMessage(ini.getError());
     return false;
   }
-  // read settings
-  getStringValue(ini,"igcheader","Pilot", config.pilot, CONFIG::CONFIG_DEFAULT_PILOT); 
-  getStringValue(ini,"igcheader","CoPilot", config.copilot, CONFIG::CONFIG_DEFAULT_COPILOT); 
-  getStringValue(ini,"igcheader","Type", config.type, CONFIG::CONFIG_DEFAULT_TYPE);
-  getStringValue(ini,"igcheader","CallSign", config.cs, CONFIG::CONFIG_DEFAULT_CS);
-  getStringValue(ini,"igcheader","Registration", config.reg, CONFIG::CONFIG_DEFAULT_REG);
-  getStringValue(ini,"igcheader","Class", config.cls, CONFIG::CONFIG_DEFAULT_CLASS);
-  getStringValue(ini,"gps","Type", config.gps, CONFIG::CONFIG_DEFAULT_GPS);
-  getULongValue(ini,"gps", "Baudrate", config.baudrate, CONFIG::CONFIG_DEFAULT_BAUDATE);
-  getIntValue(ini,"config", "log_interval", config.log_interval, CONFIG::CONFIG_DEFAULT_LOG_INTERVAL);
-  getDoubleValue(ini,"config", "liftoff_threshold", config.liftoff_threshold, CONFIG::CONFIG_DEFAULT_LIFTOFF_THRESHOLD);
-  getBoolValue(ini,"config", "liftoff_detection", config.liftoff_detection, CONFIG::CONFIG_DEFAULT_LIFTOFF_DETECT_ENABLE);
+  memcpy(CONFIG::arena, strings.buffer, strings.used);
+  for (uint8_t i = 0; i < CONFIG::KEY_COUNT; i++)
+  {
+    if (pgm_read_byte(&CONFIG::keys[i].type) == CONFIG::TYPE_STRING)
+    {
+      stringField(config, i) = CONFIG::arena + strings.position[i];
+    }
+  }
+  if (result && have_info)
+  {
+    saveSnapshot(config, strings.used, ini_size, ini_stamp);
+  }
 
-  return true;
+  HAL::console().print(F("Config read in "));
+  HAL::console().print(HAL::millis() - start);
+  HAL::console().print(F(" ms, "));
+  HAL::console().print(sizeof(config_t));
+  HAL::console().print(F(" bytes + "));
+  HAL::console().print(strings.used);
+  HAL::console().println(F(" bytes strings"));
+  return result;
 }
 
 void printLine()
 {
-    Serial.println(F("======================================================"));
+    HAL::console().println(F("======================================================"));
 }
 
 void printConfig(const config_t &config)
 {
-    Serial.println(F("Config:"));
+    HAL::console().println(F("Config:"));
     printLine();
-    Serial.print(F("Pilot            : "));
-    Serial.println(config.pilot);
-    Serial.print(F("Co-Pilot         : "));
-    Serial.println(config.copilot);
-    Serial.print(F("Type             : "));
-    Serial.println(config.type);
-    Serial.print(F("Registration     : "));
-    Serial.println(config.reg);
-    Serial.print(F("Class            : "));
-    Serial.println(config.cls);
-    Serial.print(F("Call Sign        : "));
-    Serial.println(config.cs);
-    Serial.print(F("GPS Type         : "));
-    Serial.println(config.gps);
-    Serial.print(F("GPS Baudrate     : "));
-    Serial.println(config.baudrate);
-    Serial.print(F("Liftoff Detection: "));
-    Serial.println(config.liftoff_detection);
-    Serial.print(F("Liftoff Threshold: "));
-    Serial.println(config.liftoff_threshold);
-    Serial.print(F("Logger Interval  : "));
-    Serial.println(config.log_interval);
+    HAL::console().print(F("Pilot            : "));
+    HAL::console().println(config.pilot);
+    HAL::console().print(F("Co-Pilot         : "));
+    HAL::console().println(config.copilot);
+    HAL::console().print(F("Type             : "));
+    HAL::console().println(config.type);
+    HAL::console().print(F("Registration     : "));
+    HAL::console().println(config.reg);
+    HAL::console().print(F("Class            : "));
+    HAL::console().println(config.cls);
+    HAL::console().print(F("Call Sign        : "));
+    HAL::console().println(config.cs);
+    HAL::console().print(F("GPS Type         : "));
+    HAL::console().println(config.gps);
+    HAL::console().print(F("GPS Baudrate     : "));
+    HAL::console().println(config.baudrate);
+    HAL::console().print(F("Liftoff Detection: "));
+    HAL::console().println(config.liftoff_detection);
+    HAL::console().print(F("Liftoff Threshold: "));
+    HAL::console().println(config.liftoff_threshold);
+    HAL::console().print(F("Vario Filter     : "));
+    HAL::console().println(config.vario_filter);
+    HAL::console().print(F("Takeoff Speed    : "));
+    HAL::console().println(config.takeoff_speed);
+    HAL::console().print(F("Landing Time     : "));
+    HAL::console().println(config.landing_time);
+    HAL::console().print(F("Logger Interval  : "));
+    HAL::console().println(config.log_interval);
+    HAL::console().print(F("Adaptive Logging : "));
+    HAL::console().println(config.adaptive_logging);
+    HAL::console().print(F("Log Interval Min : "));
+    HAL::console().println(config.log_interval_min);
+    HAL::console().print(F("Log Interval Max : "));
+    HAL::console().println(config.log_interval_max);
+    HAL::console().print(F("Keep File Open   : "));
+    HAL::console().println(config.keep_file_open);
+    HAL::console().print(F("Sync Records     : "));
+    HAL::console().println(config.sync_records);
+    HAL::console().print(F("Sync Interval    : "));
+    HAL::console().println(config.sync_interval);
+    HAL::console().print(F("Flush Interval   : "));
+    HAL::console().println(config.flush_interval);
+    HAL::console().print(F("Max Flight Hours : "));
+    HAL::console().println(config.max_flight_hours);
+    HAL::console().print(F("G-record Deferred: "));
+    HAL::console().println(config.grecord_deferred);
+    HAL::console().print(F("G-rec. Checkpoint: "));
+    HAL::console().println(config.grecord_checkpoint);
+    HAL::console().print(F("Journal          : "));
+    HAL::console().println(config.journal);
     printLine();
 }
@@ -0,0 +1,151 @@
+#include <math.h>
+#include "flight.h"
+
+namespace FLIGHT
+{
+
+void varioUpdate(vario_t &vario, float altitude, unsigned long now, float time_constant)
+{
+    if (!vario.valid)
+    {
+        vario.altitude = altitude;
+        vario.rate = 0.0f;
+        vario.last = now;
+        vario.valid = true;
+        return;
+    }
+    const float dt = (now - vario.last) / 1000.0f;
+    if (dt <= 0.0f)
+    {
+        return;
+    }
+    vario.last = now;
+    const float theta = expf(-dt / time_constant);
+    const float alpha = 1.0f - theta * theta;
+    const float beta = (1.0f - theta) * (1.0f - theta);
+    // predict, then correct with the residual
+    vario.altitude += vario.rate * dt;
+    const float residual = altitude - vario.altitude;
+    vario.altitude += alpha * residual;
+    vario.rate += beta * residual / dt;
+}
+
+void begin(flight_t &flight, bool detect, unsigned long now)
+{
+    flight.state = detect ? GROUND : FLYING;
+    flight.since = now;
+    flight.moving = now;
+    flight.stopped = now;
+    flight.takeoff_alt = NAN;
+    flight.takeoff_gps_alt = NAN;
+    flight.takeoff_latency = 0;
+    flight.landing_latency = 0;
+}
+
+static void enter(flight_t &flight, state_t state, unsigned long now)
+{
+    flight.state = state;
+    flight.since = now;
+}
+
+// on the ground again: baro or GPS altitude close to the takeoff, the
+// baro may have drifted over a long flight
+static bool nearTakeoff(const flight_t &flight, const params_t &params, const sample_t &sample)
+{
+    if (params.landing_height <= 0.0f || isnan(flight.takeoff_alt))
+    {
+        return true;
+    }
+    return fabsf(sample.altitude - flight.takeoff_alt) <= params.landing_height ||
+           fabsf(sample.gps_altitude - flight.takeoff_gps_alt) <= params.landing_height;
+}
+
+bool update(flight_t &flight, const params_t &params, const sample_t &sample,
+            unsigned long now)
+{
+    if (!sample.gps_valid && flight.state != LANDED)
+    {
+        // without a fix moving or not is unknown: hold the state, a
+        // flight only lands on valid fixes at low speed
+        return false;
+    }
+    const bool climbing = sample.vario > params.liftoff_threshold;
+    const bool moving = sample.gps_valid &&
+        (sample.speed > params.takeoff_speed || fabsf(sample.vario) > params.liftoff_threshold);
+    if (moving)
+    {
+        flight.moving = now;
+    }
+    else
+    {
+        flight.stopped = now;
+    }
+
+    const state_t old_state = flight.state;
+    switch (flight.state)
+    {
+        case GROUND:
+            if (sample.gps_valid && (climbing || sample.speed > params.takeoff_speed))
+            {
+                flight.takeoff_alt = sample.altitude;
+                flight.takeoff_gps_alt = sample.gps_altitude;
+                enter(flight, TAKEOFF, now);
+            }
+            break;
+        case TAKEOFF:
+            if (now - flight.stopped >= params.confirm_time * 1000UL)
+            {
+                // moving all the time since takeoff
+                flight.takeoff_latency = now - flight.since;
+                enter(flight, FLYING, now);
+            }
+            else if (now - flight.moving >= params.confirm_time * 1000UL)
+            {
+                // false alarm
+                enter(flight, GROUND, now);
+            }
+            break;
+        case FLYING:
+            // landing_time 0 = never land (no takeoff detection)
+            if (params.landing_time > 0 &&
+                now - flight.moving >= params.landing_time * 1000UL &&
+                nearTakeoff(flight, params, sample))
+            {
+                flight.landing_latency = now - flight.moving;
+                enter(flight, LANDED, now);
+            }
+            break;
+        case LANDED:
+            // wait for the next flight
+            enter(flight, GROUND, now);
+            break;
+    }
+    return flight.state != old_state;
+}
+
+const char *stateName(state_t state)
+{
+    switch (state)
+    {
+        case GROUND: return "ground";
+        case TAKEOFF: return "takeoff";
+        case FLYING: return "flying";
+        case LANDED: return "landed";
+    }
+    return "?";
+}
+
+uint16_t logInterval(const flight_t &flight, const log_params_t &params,
+                     float vario, float turn_rate, float height)
+{
+    if (flight.state == TAKEOFF ||
+        vario > params.climb ||
+        fabsf(turn_rate) > params.turn_rate ||
+        fabsf(height) < params.low_height)
+    {
+        return params.min_interval;
+    }
+    return params.max_interval;
+}
+
+} // FLIGHT namespace
@@ -0,0 +1,139 @@
+#include <Arduino.h>
+#ifndef NATIVE
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#endif
+#include <util/atomic.h>
+#include "gps_rx.h"
+
+namespace GPS_RX
+{
+
+static const uint16_t mask = GPS_RX_BUFFER_SIZE - 1;
+static_assert((GPS_RX_BUFFER_SIZE & mask) == 0, "GPS_RX_BUFFER_SIZE must be a power of 2");
+
+static uint8_t buffer[GPS_RX_BUFFER_SIZE];
+static volatile uint16_t head = 0; // written by ISR only
+static volatile uint16_t tail = 0; // written by loop() only
+static volatile uint16_t overruns = 0;
+static volatile uint16_t framing = 0;
+static volatile uint16_t dropped = 0;
+static volatile uint16_t max_used = 0; // written by ISR only
+
+void begin(unsigned long baud)
+{
+#ifndef NATIVE
+  // same baud rate calculation as HardwareSerial::begin()
+  uint16_t baud_setting = (F_CPU / 4 / baud - 1) / 2;
+  UCSR1A = _BV(U2X1);
+  if (((F_CPU == 16000000UL) && (baud == 57600)) || (baud_setting > 4095))
+  {
+    UCSR1A = 0;
+    baud_setting = (F_CPU / 8 / baud - 1) / 2;
+  }
+  UBRR1 = baud_setting;
+  UCSR1C = _BV(UCSZ11) | _BV(UCSZ10); // 8N1
+  UCSR1B = _BV(RXEN1) | _BV(RXCIE1);  // receive only
+#else
+  (void) baud;    // no USART on the host
+#endif
+}
+
+static uint16_t readHead()
+{
+  uint16_t h;
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    h = head;
+  }
+  return h;
+}
+
+int available()
+{
+  return (readHead() - tail) & mask;
+}
+
+int read()
+{
+  uint16_t t = tail;
+  if (readHead() == t)
+  {
+    return -1;
+  }
+  uint8_t c = buffer[t];
+  // the ISR must not see half of the new tail
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    tail = (t + 1) & mask;
+  }
+  return c;
+}
+
+void getStats(gps_rx_stats_t &stats)
+{
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    stats.overruns = overruns;
+    stats.framing = framing;
+    stats.dropped = dropped;
+    stats.max_used = max_used;
+  }
+}
+
+// store a received byte, interrupt context: the fill level is highest
+// here, so max_used is taken here and not in loop()
+static inline void receive(uint8_t c)
+{
+  uint16_t h = head;
+  uint16_t next = (h + 1) & mask;
+  if (next == tail)
+  {
+    dropped++;
+    return;
+  }
+  buffer[h] = c;
+  head = next;
+  uint16_t used = (next - tail) & mask;
+  if (used > max_used)
+  {
+    max_used = used;
+  }
+}
+
+#ifdef NATIVE
+void hostReceive(const uint8_t *data, uint16_t size)
+{
+  while (size--)
+  {
+    receive(*data++);
+  }
+}
+
+void hostReset()
+{
+  head = tail = 0;
+  overruns = framing = dropped = max_used = 0;
+}
+#endif
+
+} // GPS_RX namespace
+
+#ifndef NATIVE
+ISR(USART1_RX_vect)
+{
+  using namespace GPS_RX;
+  uint8_t status = UCSR1A;
+  uint8_t c = UDR1;
+  if (status & _BV(DOR1))
+  {
+    overruns++;
+  }
+  if (status & _BV(FE1))
+  {
+    framing++;
+    return;
+  }
+  receive(c);
+}
+#endif
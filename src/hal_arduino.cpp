@@ -0,0 +1,297 @@
+#ifndef NATIVE
+
+#include <Arduino.h>
+#include <SD.h>
+#include <avr/power.h>
+#include <avr/sleep.h>
+#include <Wire.h>
+#include <Adafruit_BMP280.h>
+#include "hal.h"
+#include "gps_rx.h"
+#include "altitude.h"
+
+
+namespace HAL
+{
+
+bool fsBegin(uint8_t cs_pin)
+{
+  return SD.begin(cs_pin);
+}
+
+File fsOpen(const char *path, uint8_t mode)
+{
+  return SD.open(path, mode);
+}
+
+bool fsExists(const char *path)
+{
+  return SD.exists(path);
+}
+
+bool fsMkdir(const char *path)
+{
+  return SD.mkdir(path);
+}
+
+bool fsRemove(const char *path)
+{
+  return SD.remove(path);
+}
+
+void fsDateTimeCallback(void (*callback)(uint16_t *date, uint16_t *time))
+{
+  SdFile::dateTimeCallback(callback);
+}
+
+void consoleBegin(unsigned long baud)
+{
+  Serial.begin(baud);
+  // wait until Serial (USB) port is available
+  while (!Serial) {}
+}
+
+Stream &console()
+{
+  return Serial;
+}
+
+void idle()
+{
+}
+
+void powerDown()
+{
+  set_sleep_mode(SLEEP_MODE_PWR_DOWN);
+  cli();
+  sleep_enable();
+  sei();
+  sleep_mode();
+}
+
+} // HAL namespace
+
+#ifndef REPLAY
+
+#define BATTERY_PIN A1
+
+namespace HAL
+{
+
+// BMP280 sensor
+static Adafruit_BMP280 bmp;
+
+unsigned long millis()
+{
+  return ::millis();
+}
+
+unsigned long micros()
+{
+  return ::micros();
+}
+
+float readBatteryVoltage()
+{
+  // Reads the value from the specified analog pin. Arduino boards contain a multichannel, 
+  // 10-bit analog to digital converter. This means that it will map input voltages
+  // between 0 and the operating voltage(5V or 3.3V) into integer values between 0 and 1023.
+  power_adc_enable();
+  float volt = (float)analogRead(BATTERY_PIN) * (5.0/1023.0);
+  power_adc_disable();
+  return volt;
+}
+
+// BMP280 registers, see the Bosch BST-BMP280-DS001 datasheet
+#define BMP280_I2C_ADDRESS  0x77
+#define BMP280_REG_CALIB    0x88
+#define BMP280_REG_STATUS   0xF3
+#define BMP280_REG_DATA     0xF7
+#define BMP280_STATUS_MEASURING 0x08
+
+// with STANDBY_MS_500 and the oversampling below a conversion completes
+// every ~545 ms, don't poll the sensor before that
+#define BARO_SAMPLE_MS      500
+// next look when the sensor is still converting or the sample has not
+// changed yet
+#define BARO_RETRY_MS       20
+
+// factory calibration (datasheet 3.11.2)
+static struct
+{
+  uint16_t T1;
+  int16_t T2, T3;
+  uint16_t P1;
+  int16_t P2, P3, P4, P5, P6, P7, P8, P9;
+} calib;
+
+// last sample
+static int32_t raw_temperature = 0;
+static int32_t raw_pressure = 0;
+static int32_t temperature = 0;      // 0.01 degrees C
+static uint32_t pressure = 0;        // Pa, Q24.8 (whole Pa)
+static unsigned long last_sample = 0;
+
+static bool readRegisters(uint8_t reg, uint8_t *data, uint8_t len)
+{
+  Wire.beginTransmission(BMP280_I2C_ADDRESS);
+  Wire.write(reg);
+  if (Wire.endTransmission() != 0 || Wire.requestFrom((uint8_t) BMP280_I2C_ADDRESS, len) != len)
+  {
+    return false;
+  }
+  for (uint8_t i = 0; i < len; i++)
+  {
+    data[i] = Wire.read();
+  }
+  return true;
+}
+
+static bool readCalibration()
+{
+  uint8_t data[24];
+  if (!readRegisters(BMP280_REG_CALIB, data, sizeof(data)))
+  {
+    return false;
+  }
+  // little endian words, T1 first
+  uint16_t *words = (uint16_t *) &calib;
+  for (uint8_t i = 0; i < 12; i++)
+  {
+    words[i] = data[2 * i] | ((uint16_t) data[2 * i + 1] << 8);
+  }
+  return true;
+}
+
+// integer compensation from the datasheet (8.2), 32 bit pressure version
+// (bmp280_compensate_P_int32): 1 Pa resolution, the AVR has no 64 bit
+// multiply and divide in hardware
+static void compensate()
+{
+  int32_t var1, var2;
+  var1 = ((((raw_temperature >> 3) - ((int32_t) calib.T1 << 1))) * ((int32_t) calib.T2)) >> 11;
+  var2 = (((((raw_temperature >> 4) - ((int32_t) calib.T1)) *
+            ((raw_temperature >> 4) - ((int32_t) calib.T1))) >> 12) * ((int32_t) calib.T3)) >> 14;
+  const int32_t t_fine = var1 + var2;
+  temperature = (t_fine * 5 + 128) >> 8;
+
+  uint32_t p;
+  var1 = (t_fine >> 1) - (int32_t) 64000;
+  var2 = (((var1 >> 2) * (var1 >> 2)) >> 11) * ((int32_t) calib.P6);
+  var2 = var2 + ((var1 * ((int32_t) calib.P5)) << 1);
+  var2 = (var2 >> 2) + (((int32_t) calib.P4) << 16);
+  var1 = (((calib.P3 * (((var1 >> 2) * (var1 >> 2)) >> 13)) >> 3) +
+          ((((int32_t) calib.P2) * var1) >> 1)) >> 18;
+  var1 = ((32768 + var1) * ((int32_t) calib.P1)) >> 15;
+  if (var1 == 0)
+  {
+    return; // avoid exception caused by division by zero
+  }
+  p = (((uint32_t) (((int32_t) 1048576) - raw_pressure)) - (var2 >> 12)) * 3125;
+  if (p < 0x80000000)
+  {
+    p = (p << 1) / ((uint32_t) var1);
+  }
+  else
+  {
+    p = (p / (uint32_t) var1) * 2;
+  }
+  var1 = (((int32_t) calib.P9) * ((int32_t) (((p >> 3) * (p >> 3)) >> 13))) >> 12;
+  var2 = (((int32_t) (p >> 2)) * ((int32_t) calib.P8)) >> 13;
+  p = (uint32_t) ((int32_t) p + ((var1 + var2 + calib.P7) >> 4));
+  // Q24.8 for ALTITUDE::altitude()
+  pressure = p << 8;
+}
+
+bool baroBegin()
+{
+  Wire.begin();
+  // BMP280 at I2C address 0x77
+  if (!bmp.begin(BMP280_I2C_ADDRESS))
+  {
+    return false;
+  }
+  /* Default settings from datasheet. */
+  bmp.setSampling(Adafruit_BMP280::MODE_NORMAL,     /* Operating Mode. */
+                  Adafruit_BMP280::SAMPLING_X2,     /* Temp. oversampling */
+                  Adafruit_BMP280::SAMPLING_X16,    /* Pressure oversampling */
+                  Adafruit_BMP280::FILTER_X16,      /* Filtering. */
+                  Adafruit_BMP280::STANDBY_MS_500); /* Standby time. */
+  if (!readCalibration())
+  {
+    return false;
+  }
+  // wait for the first conversion
+  delay(50);
+  last_sample = ::millis() - BARO_SAMPLE_MS;
+  return baroUpdate();
+}
+
+bool baroUpdate()
+{
+  const unsigned long now = ::millis();
+  if (now - last_sample < BARO_SAMPLE_MS)
+  {
+    return false;
+  }
+  // unless a new sample is read below, look again in BARO_RETRY_MS and
+  // not on every pass of the loop
+  last_sample = now - BARO_SAMPLE_MS + BARO_RETRY_MS;
+  if (bmp.getStatus() & BMP280_STATUS_MEASURING)
+  {
+    return false;
+  }
+  uint8_t data[6];
+  if (!readRegisters(BMP280_REG_DATA, data, sizeof(data)))
+  {
+    return false;
+  }
+  const int32_t adc_P = ((uint32_t) data[0] << 12) | ((uint32_t) data[1] << 4) | (data[2] >> 4);
+  const int32_t adc_T = ((uint32_t) data[3] << 12) | ((uint32_t) data[4] << 4) | (data[5] >> 4);
+  if (adc_P == raw_pressure && adc_T == raw_temperature && pressure != 0)
+  {
+    // conversion not finished yet
+    return false;
+  }
+  raw_pressure = adc_P;
+  raw_temperature = adc_T;
+  compensate();
+  last_sample = now;
+  return true;
+}
+
+float baroTemperature()
+{
+  return temperature / 100.0f;
+}
+
+float baroPressure()
+{
+  return pressure / 256.0f;
+}
+
+float baroAltitude(float seaLevelhPa)
+{
+  return ALTITUDE::altitude(pressure, seaLevelhPa);
+}
+
+void gpsBegin(unsigned long baud)
+{
+  GPS_RX::begin(baud);
+}
+
+int gpsAvailable()
+{
+  return GPS_RX::available();
+}
+
+int gpsRead()
+{
+  return GPS_RX::read();
+}
+
+} // HAL namespace
+
+#endif // REPLAY
+
+#endif // NATIVE
@@ -0,0 +1,529 @@
+#include <Arduino.h>
+#include <EEPROM.h>
+#include <string>
+#include <chrono>
+#include <sys/stat.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <time.h>
+#include "hal.h"
+#include "sd_prealloc.h"
+
+// Host build (-DNATIVE, see [env:native] in platformio.ini): the logger
+// runs on a PC. Sensors come from the replay traces of hal_replay.cpp, the
+// SD card is a folder, the debug port is stdout.
+//
+// The clock is virtual: millis() only moves when the logger waits (idle()
+// after every loop(), delay(), a slow card), so a flight replays as fast
+// as the PC can run it and every run gives the same file. micros() is the
+// real clock, for the stage timings, and 32 bit like on the board.
+
+#ifdef NATIVE
+
+void setup();
+void loop();
+
+struct PosixFile::handle_t
+{
+  FILE *fp = NULL;
+  DIR *dir = NULL;
+  std::string path;         // on the host
+  std::string name;
+  uint8_t mode = 0;
+  uint32_t pos = 0;         // position of the File
+  uint32_t size = 0;
+  long stdio_pos = -1;      // position of fp, -1 if unknown
+  bool last_write = false;
+
+  ~handle_t()
+  {
+    if (fp) fclose(fp);
+    if (dir) closedir(dir);
+  }
+};
+
+namespace HAL
+{
+
+static std::string root = "sd";
+static bool echo = true;
+static unsigned long clock_ms = 0;
+static bool halted = false;
+static fs_stats_t fs_stats = {};
+static unsigned long write_delay = 0;
+static bool fail_writes = false;
+static uint32_t micros_start = 0;
+static std::chrono::steady_clock::time_point micros_epoch = std::chrono::steady_clock::now();
+
+static std::string hostPath(const char *path)
+{
+  while (*path == '/')
+  {
+    path++;
+  }
+  return root + "/" + path;
+}
+
+void hostBegin(const char *sd_root, bool console_echo)
+{
+  root = sd_root;
+  echo = console_echo;
+  clock_ms = 0;
+  halted = false;
+  fail_writes = false;
+  hostFsResetStats();
+}
+
+void hostAdvance(unsigned long ms)
+{
+  clock_ms += ms;
+}
+
+bool hostHalted()
+{
+  return halted;
+}
+
+void hostFsStats(fs_stats_t &stats)
+{
+  stats = fs_stats;
+}
+
+void hostFsResetStats()
+{
+  memset(&fs_stats, 0, sizeof(fs_stats));
+}
+
+void hostFsWriteDelay(unsigned long ms)
+{
+  write_delay = ms;
+}
+
+void hostFsFailWrites(bool fail)
+{
+  fail_writes = fail;
+}
+
+unsigned long millis()
+{
+  return clock_ms;
+}
+
+unsigned long micros()
+{
+  using namespace std::chrono;
+  return (uint32_t) (micros_start + duration_cast<microseconds>(steady_clock::now() - micros_epoch).count());
+}
+
+void hostMicros(uint32_t us)
+{
+  micros_start = us;
+  micros_epoch = std::chrono::steady_clock::now();
+}
+
+void idle()
+{
+  clock_ms++;
+}
+
+void powerDown()
+{
+  fflush(stdout);
+  halted = true;
+}
+
+// console
+
+class Console : public Stream
+{
+  public:
+    size_t write(uint8_t c) override
+    {
+      if (echo)
+      {
+        putchar(c);
+      }
+      return 1;
+    }
+    using Print::write;
+    int available() override { return 0; }
+    int read() override { return -1; }
+    int peek() override { return -1; }
+    void flush() override { fflush(stdout); }
+};
+
+static Console host_console;
+
+void consoleBegin(unsigned long)
+{
+}
+
+Stream &console()
+{
+  return host_console;
+}
+
+// file system
+
+static uint32_t clusters(uint32_t size)
+{
+  return (size + HOST_CLUSTER_SIZE - 1) / HOST_CLUSTER_SIZE;
+}
+
+static PosixFile openPath(const std::string &path, const char *name, uint8_t mode)
+{
+  std::shared_ptr<PosixFile::handle_t> handle = std::make_shared<PosixFile::handle_t>();
+  handle->path = path;
+  handle->name = name;
+  handle->mode = mode;
+  struct stat st;
+  const bool exists = stat(path.c_str(), &st) == 0;
+  if (exists && S_ISDIR(st.st_mode))
+  {
+    handle->dir = opendir(path.c_str());
+    if (!handle->dir)
+    {
+      return PosixFile();
+    }
+    fs_stats.opens++;
+    return PosixFile(handle);
+  }
+  if (!(mode & O_WRITE))
+  {
+    handle->fp = exists ? fopen(path.c_str(), "rb") : NULL;
+  }
+  else if (mode & O_TRUNC || (!exists && (mode & O_CREAT)))
+  {
+    handle->fp = fopen(path.c_str(), "w+b");
+  }
+  else if (exists)
+  {
+    handle->fp = fopen(path.c_str(), "r+b");
+  }
+  if (!handle->fp)
+  {
+    return PosixFile();
+  }
+  handle->size = (exists && !(mode & O_TRUNC)) ? st.st_size : 0;
+  if (mode & O_APPEND)
+  {
+    handle->pos = handle->size;
+  }
+  fs_stats.opens++;
+  return PosixFile(handle);
+}
+
+bool fsBegin(uint8_t)
+{
+  struct stat st;
+  return stat(root.c_str(), &st) == 0 && S_ISDIR(st.st_mode);
+}
+
+File fsOpen(const char *path, uint8_t mode)
+{
+  const char *name = strrchr(path, '/');
+  return openPath(hostPath(path), name ? name + 1 : path, mode);
+}
+
+bool fsExists(const char *path)
+{
+  struct stat st;
+  return stat(hostPath(path).c_str(), &st) == 0;
+}
+
+bool fsMkdir(const char *path)
+{
+  struct stat st;
+  const std::string host_path = hostPath(path);
+  if (stat(host_path.c_str(), &st) == 0)
+  {
+    return S_ISDIR(st.st_mode);
+  }
+  return mkdir(host_path.c_str(), 0777) == 0;
+}
+
+bool fsRemove(const char *path)
+{
+  return unlink(hostPath(path).c_str()) == 0;
+}
+
+void fsDateTimeCallback(void (*)(uint16_t *, uint16_t *))
+{
+  // the host stamps files with its own clock
+}
+
+} // HAL namespace
+
+// PosixFile, see posix_file.h
+
+size_t PosixFile::write(const uint8_t *buffer, size_t size)
+{
+  if (!handle || !handle->fp || !(handle->mode & O_WRITE) || HAL::fail_writes)
+  {
+    setWriteError();
+    return 0;
+  }
+  handle_t &h = *handle;
+  if (h.mode & O_APPEND)
+  {
+    h.pos = h.size;
+  }
+  if (h.stdio_pos != (long) h.pos || !h.last_write)
+  {
+    fseek(h.fp, h.pos, SEEK_SET);
+  }
+  const size_t written = fwrite(buffer, 1, size, h.fp);
+  h.pos += written;
+  h.stdio_pos = h.pos;
+  h.last_write = true;
+  if (h.pos > h.size)
+  {
+    HAL::fs_stats.clusters += HAL::clusters(h.pos) - HAL::clusters(h.size);
+    h.size = h.pos;
+  }
+  HAL::fs_stats.writes++;
+  HAL::fs_stats.bytes_written += written;
+  HAL::hostAdvance(HAL::write_delay);
+  if (written != size)
+  {
+    setWriteError();
+  }
+  return written;
+}
+
+int PosixFile::read(void *buffer, uint16_t size)
+{
+  if (!handle || !handle->fp)
+  {
+    return -1;
+  }
+  handle_t &h = *handle;
+  if (h.stdio_pos != (long) h.pos || h.last_write)
+  {
+    fseek(h.fp, h.pos, SEEK_SET);
+  }
+  const size_t count = fread(buffer, 1, size, h.fp);
+  HAL::fs_stats.reads++;
+  HAL::fs_stats.bytes_read += count;
+  h.pos += count;
+  h.stdio_pos = h.pos;
+  h.last_write = false;
+  return count;
+}
+
+int PosixFile::read()
+{
+  uint8_t c;
+  return read(&c, 1) == 1 ? c : -1;
+}
+
+int PosixFile::peek()
+{
+  const int c = read();
+  if (c >= 0)
+  {
+    handle->pos--;
+  }
+  return c;
+}
+
+int PosixFile::available()
+{
+  const uint32_t n = size() - position();
+  return n > 0x7FFF ? 0x7FFF : n;
+}
+
+void PosixFile::flush()
+{
+  if (handle && handle->fp)
+  {
+    fflush(handle->fp);
+    HAL::fs_stats.syncs++;
+    HAL::hostAdvance(HAL::write_delay);
+  }
+}
+
+bool PosixFile::seek(uint32_t pos)
+{
+  if (!handle || !handle->fp || pos > handle->size)
+  {
+    return false;
+  }
+  handle->pos = pos;
+  HAL::fs_stats.seeks++;
+  return true;
+}
+
+uint32_t PosixFile::position()
+{
+  return handle ? handle->pos : 0;
+}
+
+uint32_t PosixFile::size()
+{
+  return handle ? handle->size : 0;
+}
+
+void PosixFile::close()
+{
+  if (handle && (handle->fp || handle->dir))
+  {
+    if (handle->fp)
+    {
+      // a close syncs, like SdFile::close()
+      flush();
+      fclose(handle->fp);
+      handle->fp = NULL;
+    }
+    if (handle->dir)
+    {
+      closedir(handle->dir);
+      handle->dir = NULL;
+    }
+    HAL::fs_stats.closes++;
+  }
+  handle.reset();
+}
+
+const char *PosixFile::name()
+{
+  return handle ? handle->name.c_str() : "";
+}
+
+bool PosixFile::isDirectory()
+{
+  return handle && handle->dir;
+}
+
+PosixFile PosixFile::openNextFile(uint8_t mode)
+{
+  if (!handle || !handle->dir)
+  {
+    return PosixFile();
+  }
+  struct dirent *entry;
+  while ((entry = readdir(handle->dir)) != NULL)
+  {
+    if (entry->d_name[0] != '.')
+    {
+      return HAL::openPath(handle->path + "/" + entry->d_name, entry->d_name, mode);
+    }
+  }
+  return PosixFile();
+}
+
+void PosixFile::rewindDirectory()
+{
+  if (handle && handle->dir)
+  {
+    rewinddir(handle->dir);
+  }
+}
+
+// sd_prealloc.h on the host file system
+
+bool sdPreallocBegin(uint8_t)
+{
+  return true;
+}
+
+bool sdPreallocate(const char *path, uint32_t size)
+{
+  // like SdFile::createContiguous(), fails on an existing file
+  if (HAL::fsExists(path))
+  {
+    return false;
+  }
+  const std::string host_path = HAL::hostPath(path);
+  FILE *fp = fopen(host_path.c_str(), "wb");
+  if (!fp)
+  {
+    return false;
+  }
+  fclose(fp);
+  if (truncate(host_path.c_str(), size) != 0)
+  {
+    return false;
+  }
+  HAL::fs_stats.preallocs++;
+  return true;
+}
+
+bool sdTruncate(const char *path, uint32_t size)
+{
+  struct stat st;
+  const std::string host_path = HAL::hostPath(path);
+  if (stat(host_path.c_str(), &st) != 0)
+  {
+    return false;
+  }
+  return (uint32_t) st.st_size <= size || truncate(host_path.c_str(), size) == 0;
+}
+
+bool sdFileInfo(const char *path, uint32_t &size, uint32_t &stamp)
+{
+  struct stat st;
+  if (stat(HAL::hostPath(path).c_str(), &st) != 0)
+  {
+    return false;
+  }
+  struct tm t;
+  gmtime_r(&st.st_mtime, &t);
+  size = st.st_size;
+  stamp = ((uint32_t) FAT_DATE(t.tm_year + 1900, t.tm_mon + 1, t.tm_mday) << 16) |
+          FAT_TIME(t.tm_hour, t.tm_min, t.tm_sec);
+  return true;
+}
+
+#ifndef PIO_UNIT_TESTING
+
+// logger [-q] [-e eeprom.bin] [card folder]
+//   -q  no console output
+//   -e  EEPROM image, loaded at start and saved at the end
+int main(int argc, char **argv)
+{
+  const char *root = "sd";
+  const char *eeprom_file = NULL;
+  bool echo = true;
+  for (int i = 1; i < argc; i++)
+  {
+    if (strcmp(argv[i], "-q") == 0)
+    {
+      echo = false;
+    }
+    else if (strcmp(argv[i], "-e") == 0 && i + 1 < argc)
+    {
+      eeprom_file = argv[++i];
+    }
+    else
+    {
+      root = argv[i];
+    }
+  }
+  FILE *fp = eeprom_file ? fopen(eeprom_file, "rb") : NULL;
+  if (fp)
+  {
+    fread(EEPROMClass::data(), 1, NATIVE_EEPROM_SIZE, fp);
+    fclose(fp);
+  }
+
+  HAL::hostBegin(root, echo);
+  setup();
+  while (!HAL::hostHalted())
+  {
+    loop();
+    HAL::idle();
+  }
+
+  fp = eeprom_file ? fopen(eeprom_file, "wb") : NULL;
+  if (fp)
+  {
+    fwrite(EEPROMClass::data(), 1, NATIVE_EEPROM_SIZE, fp);
+    fclose(fp);
+  }
+  return 0;
+}
+
+#endif // PIO_UNIT_TESTING
+
+#endif // NATIVE
@@ -0,0 +1,193 @@
+#include <Arduino.h>
+#include <math.h>
+#include "hal.h"
+
+// Replay build (-DREPLAY, see [env:replay] in platformio.ini): instead of
+// the GPS port and the BMP280, data comes from traces recorded earlier,
+// stored on the SD card:
+//
+//   replay/gps.txt   raw NMEA stream as received from the GPS
+//   replay/baro.csv  one "<ms>,<altitude in m>" line per sample, ms since
+//                    start of the recording, ascending
+//
+// The logger clock runs REPLAY_SPEEDUP times faster than real time and
+// the NMEA bytes are delivered at that rate of the configured baud rate,
+// so a flight is replayed through the normal parse/format/hash/write path
+// in a fraction of its duration. micros() stays real time, it is used to
+// measure the stages. The host build (hal_posix.cpp) uses the traces with
+// its own clock.
+
+#ifdef REPLAY
+
+#ifndef REPLAY_SPEEDUP
+#define REPLAY_SPEEDUP 10
+#endif
+
+#define REPLAY_GPS_FILE  "replay/gps.txt"
+#define REPLAY_BARO_FILE "replay/baro.csv"
+
+namespace HAL
+{
+
+static File gps_file;
+static File baro_file;
+static unsigned long gps_baud = 9600;
+static uint32_t gps_bytes_read = 0;
+static bool gps_done = false;
+
+// last sample read from the baro trace, and the one after it
+static float baro_alt = 0.0f;
+static unsigned long next_baro_ms = 0;
+static float next_baro_alt = 0.0f;
+static bool baro_done = true;
+
+#ifndef NATIVE
+unsigned long millis()
+{
+  return ::millis() * REPLAY_SPEEDUP;
+}
+
+unsigned long micros()
+{
+  return ::micros();
+}
+#endif
+
+float readBatteryVoltage()
+{
+  // board is usually on USB power while replaying
+  return 4.0f;
+}
+
+// read the next "<ms>,<alt>" line, false at end of file
+static bool readBaroSample()
+{
+  char line[24];
+  uint8_t len = 0;
+  int c;
+  while ((c = baro_file.read()) >= 0)
+  {
+    if (c == '\n')
+    {
+      if (len == 0)
+      {
+        continue;
+      }
+      break;
+    }
+    if (c != '\r' && len < sizeof(line) - 1)
+    {
+      line[len++] = c;
+    }
+  }
+  if (len == 0)
+  {
+    return false;
+  }
+  line[len] = '\0';
+  char *sep = strchr(line, ',');
+  if (sep == NULL)
+  {
+    return false;
+  }
+  next_baro_ms = strtoul(line, NULL, 10);
+  next_baro_alt = atof(sep + 1);
+  return true;
+}
+
+bool baroBegin()
+{
+  baro_file = fsOpen(REPLAY_BARO_FILE, FILE_READ);
+  if (!baro_file)
+  {
+    console().println(F("Cannot open " REPLAY_BARO_FILE));
+    return false;
+  }
+  baro_done = !readBaroSample();
+  baro_alt = next_baro_alt;
+  return true;
+}
+
+float baroTemperature()
+{
+  return 15.0f;
+}
+
+float baroPressure()
+{
+  // ISA, inverse of baroAltitude() at standard sea level pressure
+  return 101325.0f * pow(1.0f - baro_alt / 44330.0f, 5.255f);
+}
+
+bool baroUpdate()
+{
+  const unsigned long now = millis();
+  bool updated = false;
+  while (!baro_done && next_baro_ms <= now)
+  {
+    baro_alt = next_baro_alt;
+    baro_done = !readBaroSample();
+    updated = true;
+  }
+  return updated;
+}
+
+float baroAltitude(float seaLevelhPa)
+{
+  (void) seaLevelhPa;
+  return baro_alt;
+}
+
+void gpsBegin(unsigned long baud)
+{
+  gps_baud = baud;
+  gps_file = fsOpen(REPLAY_GPS_FILE, FILE_READ);
+  if (!gps_file)
+  {
+    console().println(F("Cannot open " REPLAY_GPS_FILE));
+    gps_done = true;
+  }
+}
+
+// bytes the GPS would have sent so far (10 bits per byte)
+static uint32_t gpsBytesDue()
+{
+  return (uint32_t) ((uint64_t) millis() * gps_baud / 10000);
+}
+
+int gpsAvailable()
+{
+  if (gps_done)
+  {
+    return 0;
+  }
+  const uint32_t due = gpsBytesDue() - gps_bytes_read;
+  const int left = gps_file.available();
+  return (due < (uint32_t) left) ? (int) due : left;
+}
+
+int gpsRead()
+{
+  if (gps_done || gpsBytesDue() == gps_bytes_read)
+  {
+    return -1;
+  }
+  const int c = gps_file.read();
+  if (c < 0)
+  {
+    gps_done = true;
+    gps_file.close();
+    return -1;
+  }
+  gps_bytes_read++;
+  return c;
+}
+
+bool replayFinished()
+{
+  return gps_done;
+}
+
+} // HAL namespace
+
+#endif // REPLAY
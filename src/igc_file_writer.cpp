@@ -12,120 +12,454 @@
  */
 
 #include <Arduino.h>
+#include <ctype.h>
 #include <MD5.h>
-#include <SD.h>
+#include "hal.h"
 #include "igc_file_writer.h"
+#include "igc_grecord.h"
+#include "sd_prealloc.h"
 #include "utils.h"
+#include "perf.h"
 
 namespace {
-  // return c if valid char for IGC files
-  // return space if not.
-  char clean_igc_char(char c) {
-    if (c >= 0x20 && c <= 0x7E && c != 0x24 &&
-        c != 0x2A && c != 0x2C && c != 0x21 &&
-        c != 0x5C && c != 0x5E && c != 0x7E) {
-      return c;
-    }
-    return ' ';
-  }
-
-  void write_g_record(File &stream, const MD5::MD5_CTX &md5) {
-    char part1[17];
-    char part2[17];
-    MD5::MD5_CTX md5_tmp;
-    // we made copy to allow to continue to update hash after Final call.
-  // make a copy, so we can continue with
-  // next record in case flight not done
-  memcpy(&md5_tmp,&md5, sizeof(MD5::MD5_CTX));
-  unsigned char * hash = (unsigned char *) malloc(16);
-  MD5::MD5::MD5Final(hash, &md5_tmp);
-  char *md5str = MD5::MD5::make_digest(hash,16);
-//  Serial.print("MD5 hash > ");
-//  Serial.println(md5str);
-  // split in two 16 char. strings
-  memset(&part1,0,sizeof(part1));
-  memset(&part2,0,sizeof(part2));
-  memcpy(part1,md5str,16);
-  memcpy(part2,(md5str+16),16);
-
-  stream.print("G");
-  stream.print(part1);
-  stream.print("\r\nG");
-  if (stream.getWriteError()) 
+  // "G<16 hex>\r\nG<16 hex>\r\n", one G-record block per MD5 context
+  const size_t g_record_size = IGC::G_RECORD_SIZE;
+
+  bool write_g_record(HAL::File &stream, const MD5::MD5_CTX &md5) {
+    char line[g_record_size + 1];
+    IGC::formatGRecord(md5, line);
+    if (stream.write((const uint8_t *) line, g_record_size) != g_record_size)
+    {
+      HAL::console().println(F("Error writing G-record!"));
+      return false;
+    }
+    return true;
+  }
+
+  // the last 4 G-record blocks are in place: "G<16 hex>\r\n" lines
+  // right after the end of a record
+  bool ends_with_grecords(HAL::File &file, uint32_t size) {
+    const uint32_t block_size = 4 * g_record_size;
+    if (size <= block_size || !file.seek(size - block_size - 1)) {
+      return false;
+    }
+    char block[4 * g_record_size + 1];
+    if (file.read(block, sizeof(block)) != (int) sizeof(block) || block[0] != '\n') {
+      return false;
+    }
+    const uint8_t line_size = 1 + 16 + 2;
+    for (const char *line = block + 1; line < block + sizeof(block); line += line_size) {
+      if (line[0] != 'G' || line[17] != '\r' || line[18] != '\n') {
+        return false;
+      }
+      for (uint8_t i = 1; i < 17; i++) {
+        if (!isxdigit(line[i])) {
+          return false;
+        }
+      }
+    }
+    return true;
+  }
+} // namespace
+
+igc_file_writer::igc_file_writer(const char *file, bool grecord, bool keep_open,
+                                 uint16_t sync_records, uint16_t sync_seconds,
+                                 bool defer_grecord, uint16_t checkpoint_minutes)
+    : file_path(file), add_grecord(grecord), keep_open(keep_open),
+      sync_records(sync_records), sync_seconds(sync_seconds),
+      defer_grecord(defer_grecord), checkpoint_minutes(checkpoint_minutes) {
+  IGC::initGRecord(md5_a, md5_b, md5_c, md5_d);
+}
+
+igc_file_writer::~igc_file_writer() {
+  close();
+}
+
+bool igc_file_writer::open_file() {
+  if (igcFile) {
+    // still open from previous record
+    return true;
+  }
+  // no O_APPEND, it breaks the seek function!!
+  // (must be an arduino thing...)
+  // the write position is tracked by the stage instead
+  igcFile = HAL::fsOpen(file_path,O_WRITE);
+  if (!igcFile) {
+    return false;
+  }
+  file_stats.open++;
+  if (next_record_position <= 0) {
+    // first open, continue at end of file (header),
+    // a pre-allocated file is written from the start
+    next_record_position = preallocated ? 0 : igcFile.size();
+    stage_start = next_record_position & ~(uint32_t) (sector_size - 1);
+    stage_fill = next_record_position - stage_start;
+    stage_flushed = stage_fill;
+  }
+  last_sync = millis();
+  return true;
+}
+
+// copy a record into the sector stage, sanitise and hash it there and
+// write every sector to the card as soon as it is complete.
+// false if a sector could not be written
+bool igc_file_writer::stage_record(const char *data, size_t size) {
+  void *const md5[] = { &md5_a, &md5_b, &md5_c, &md5_d };
+  bool ok = true;
+  while (*(data) && size > 1) {
+    char *dst = (char *) &stage[stage_fill];
+    uint16_t len = 0;
+    for (; *(data) && size > 1 && stage_fill + len < sector_size; ++data, --size) {
+      dst[len++] = *data;
+    }
+    PERF_START(hash_start);
+    IGC::cleanRecord(dst, len, add_grecord ? md5 : nullptr);
+    PERF_STOP(HASH, hash_start);
+    stage_fill += len;
+    if (stage_fill == sector_size) {
+      ok = next_sector() && ok;
+    }
+  }
+  next_record_position = stage_start + stage_fill;
+  return ok;
+}
+
+bool igc_file_writer::stage_raw(const uint8_t *data, size_t size) {
+  bool ok = true;
+  while (size > 0) {
+    uint16_t len = sector_size - stage_fill;
+    if (len > size) {
+      len = size;
+    }
+    memcpy(&stage[stage_fill], data, len);
+    data += len;
+    size -= len;
+    stage_fill += len;
+    if (stage_fill == sector_size) {
+      ok = next_sector() && ok;
+    }
+  }
+  next_record_position = stage_start + stage_fill;
+  return ok;
+}
+
+// stage is full, write it and continue with the next sector, the stage
+// is needed for the next records even if the write failed
+bool igc_file_writer::next_sector() {
+  const bool ok = write_stage();
+  stage_start += sector_size;
+  stage_fill = 0;
+  stage_flushed = 0;
+  return ok;
+}
+
+// write the part of the stage not yet on the card, on failure it is
+// written again with the next sync
+bool igc_file_writer::write_stage() {
+  if (stage_flushed == stage_fill) {
+    return true;
+  }
+  const uint32_t position = stage_start + stage_flushed;
+  if (igcFile.position() != position)
   {
-    Serial.println(F("Error writing G-record!"));
+    file_stats.seek++;
+    if (!igcFile.seek(position))
+    {
+      HAL::console().println(F("Seek failed!!"));
+      return false;
+    }
+  }
+  const uint16_t size = stage_fill - stage_flushed;
+  PERF_START(write_start);
+  const size_t written = igcFile.write(&stage[stage_flushed], size);
+  PERF_STOP(WRITE, write_start);
+  file_stats.write_calls++;
+  file_stats.bytes_written += written;
+  if (written != size) {
+    HAL::console().println(F("Error writing IGC file!"));
+    return false;
   }
-  stream.print(part2);
-  stream.print("\r\n");
-  if (stream.getWriteError()) 
+  if (stage_flushed > 0) {
+    // part of this sector is on the card already
+    file_stats.sector_rewrites++;
+  }
+  stage_flushed = stage_fill;
+  return true;
+}
+
+bool igc_file_writer::checkpoint_due() const {
+  return checkpoint_minutes && 
+    (millis() - last_checkpoint) >= (unsigned long) checkpoint_minutes * 60000;
+}
+
+bool igc_file_writer::write_grecords() {
+  // records first
+  if (!write_stage()) {
+    return false;
+  }
+  if (next_record_position > 0 && 
+      igcFile.position() != (uint32_t) next_record_position)
   {
-    Serial.println(F("Error writing G-record!"));
+    file_stats.seek++;
+    if (!igcFile.seek(next_record_position))
+    {
+      HAL::console().println(F("Seek failed!!"));
+      return false;
+    }
   }
-  free(md5str);
-  free(hash);
+  bool ok = write_g_record(igcFile, md5_a);
+  ok = write_g_record(igcFile, md5_b) && ok;
+  ok = write_g_record(igcFile, md5_c) && ok;
+  ok = write_g_record(igcFile, md5_d) && ok;
+  file_stats.grecords++;
+  grecord_pending = !ok;
+  last_checkpoint = millis();
+  return ok;
+}
+
+bool igc_file_writer::sync_due() const {
+  if (sync_records && records_since_sync >= sync_records) {
+    return true;
   }
-} // namespace
+  if (sync_seconds && (millis() - last_sync) >= (unsigned long) sync_seconds * 1000) {
+    return true;
+  }
+  return false;
+}
+
+bool igc_file_writer::sync() {
+  if (!igcFile) {
+    return false;
+  }
+  bool ok = write_stage();
+  igcFile.flush();
+  file_stats.sync++;
+  records_since_sync = 0;
+  last_sync = millis();
+  // write errors are counted where they happen, the flag is sticky
+  igcFile.clearWriteError();
+  return ok;
+}
+
+void igc_file_writer::close() {
+  bool grecord = add_grecord && (grecord_pending || file_stats.grecords > 0);
+  if (grecord_pending && open_file()) {
+    write_grecords();
+  }
+  close_file();
+  if (preallocated && next_record_position > 0) {
+    // cut off the unused part of the pre-allocated file
+    sdTruncate(file_path, next_record_position + (grecord ? 4 * g_record_size : 0));
+  }
+}
 
-igc_file_writer::igc_file_writer(const char *file, bool grecord)
-    : file_path(file), add_grecord(grecord) {
-        // LK8000, not yet working, for a test file OK though!
-  MD5::MD5::MD5Initialize(&md5_a, (unsigned long) 0x63e54c01, (unsigned long) 0x25adab89, (unsigned long) 0x44baecfe, (unsigned long) 0x60f25476);
-  MD5::MD5::MD5Initialize(&md5_b, (unsigned long) 0x41e24d03, (unsigned long) 0x23b8ebea, (unsigned long) 0x4a4bfc9e, (unsigned long) 0x640ed89a);
-  MD5::MD5::MD5Initialize(&md5_c, (unsigned long) 0x61e54e01, (unsigned long) 0x22cdab89, (unsigned long) 0x48b20cfe, (unsigned long) 0x62125476);
-  MD5::MD5::MD5Initialize(&md5_d, (unsigned long) 0xc1e84fe8, (unsigned long) 0x21d1c28a, (unsigned long) 0x438e1a12, (unsigned long) 0x6c250aee);
+void igc_file_writer::discard() {
+  if (igcFile) {
+    // staged data and G-record are dropped, not written
+    igcFile.close();
+    file_stats.close++;
+  }
+  stage_fill = 0;
+  stage_flushed = 0;
+  grecord_pending = false;
+  preallocated = false;
+  next_record_position = 0;
+  HAL::fsRemove(file_path);
 }
 
+void igc_file_writer::reset(const char *file) {
+  close();
+  file_path = file;
+  next_record_position = 0;
+  stage_start = 0;
+  stage_fill = 0;
+  stage_flushed = 0;
+  records_since_sync = 0;
+  last_checkpoint = millis();
+  grecord_pending = false;
+  preallocated = false;
+  file_stats = {};
+  IGC::initGRecord(md5_a, md5_b, md5_c, md5_d);
+}
+
+bool igc_file_writer::close_file() {
+  if (!igcFile) {
+    return true;
+  }
+  const bool ok = write_stage();
+  igcFile.close();
+  file_stats.close++;
+  records_since_sync = 0;
+  return ok;
+}
+
+void igc_file_writer::print_stats() const {
+  HAL::console().print(F("IGC writer: records="));
+  HAL::console().print(file_stats.records);
+  HAL::console().print(F(", open="));
+  HAL::console().print(file_stats.open);
+  HAL::console().print(F(", seek="));
+  HAL::console().print(file_stats.seek);
+  HAL::console().print(F(", close="));
+  HAL::console().print(file_stats.close);
+  HAL::console().print(F(", sync="));
+  HAL::console().print(file_stats.sync);
+  HAL::console().print(F(", G-records="));
+  HAL::console().println(file_stats.grecords);
+  HAL::console().print(F("IGC writer: write calls="));
+  HAL::console().print(file_stats.write_calls);
+  HAL::console().print(F(", bytes/write="));
+  HAL::console().print(file_stats.write_calls ? file_stats.bytes_written / file_stats.write_calls : 0);
+  HAL::console().print(F(", sector rewrites="));
+  HAL::console().println(file_stats.sector_rewrites);
+}
 
 bool igc_file_writer::append(const char *data, size_t size) {
 
-  uint8_t mode = O_WRITE;
-  if (next_record_position <= 0)
+  if(open_file()) 
   {
-    // if a G-record is written, we'll use seek
-    // to reposition file write location
-    // and do not want to use O_APPEND
-    // since this breaks the seek function!!
-    // (must be an arduino thing...)
-    mode |= O_APPEND;
-  }
-  File igcFile = SD.open(file_path,mode);
-  if(igcFile) 
-  {
-      if (next_record_position > 0)
-      {
-        if (!igcFile.seek(next_record_position))
-        {
-          Serial.println(F("Seek failed!!"));
-        }
+    bool ok = stage_record(data, size);
+
+    bool checkpoint = false;
+    if (add_grecord) {
+      grecord_pending = true;
+      checkpoint = defer_grecord && checkpoint_due();
+      if (!defer_grecord || checkpoint) {
+        ok = write_grecords() && ok;
       }
+    }
+    file_stats.records++;
+    records_since_sync++;
+    if (!keep_open) {
+      ok = close_file() && ok;
+    }
+    else if (checkpoint || sync_due()) {
+      // always sync a G-record checkpoint
+      ok = sync() && ok;
+    }
+    return ok;
+  }
+  return false;
+}
 
-    char c;
-    for (; *(data) && size > 1; ++data, --size) {
-      if ((*data) != 0x0D && (*data) != 0x0A) {
-        c = clean_igc_char(*data);
+bool igc_file_writer::append_raw(const uint8_t *data, size_t size) {
+  if (!open_file()) {
+    return false;
+  }
+  bool ok = stage_raw(data, size);
+  file_stats.records++;
+  records_since_sync++;
+  if (!keep_open) {
+    ok = close_file() && ok;
+  }
+  else if (sync_due()) {
+    ok = sync() && ok;
+  }
+  return ok;
+}
 
-        if (add_grecord) {
-          MD5::MD5::MD5Update(&md5_a,&c,1);
-          MD5::MD5::MD5Update(&md5_b,&c,1);
-          MD5::MD5::MD5Update(&md5_c,&c,1);
-          MD5::MD5::MD5Update(&md5_d,&c,1);
-        }
-      } else {
-        c = *data;
+// G-record hash of all complete A..Z record lines from the start of the
+// file up to the first G-record line (or damaged line), returns the end of
+// the last of them
+uint32_t igc_file_writer::hash_records(HAL::File &file, uint32_t size, MD5::MD5_CTX (&md5)[4]) {
+  IGC::initGRecord(md5[0], md5[1], md5[2], md5[3]);
+  void *const md5_all[] = { &md5[0], &md5[1], &md5[2], &md5[3] };
+
+  // read a sector at a time, the card reads whole sectors anyway
+  uint8_t block[512];
+  char line[84];
+  size_t len = 0;
+  uint32_t records_end = 0; /** end of last complete record */
+  uint32_t pos = 0;
+  while (pos < size) {
+    const int count = file.read(block, sizeof(block));
+    if (count <= 0) {
+      break;
+    }
+    for (int i = 0; i < count; i++) {
+      const char c = block[i];
+      ++pos;
+      if ((len == 0 && (c < 'A' || c > 'Z' || c == 'G')) || len >= sizeof(line)) {
+        // G-record, no record at all or too long for a valid record:
+        // end of signed data
+        return records_end;
+      }
+      line[len++] = c;
+      if (c == 0x0A) {
+        IGC::cleanRecord(line, len, md5_all);
+        records_end = pos;
+        len = 0;
       }
-      igcFile.print(c);
     }
+  }
+  return records_end;
+}
 
-    next_record_position = igcFile.position();
+// true if the file ends in the G-record of its records
+bool igc_file_writer::verify(const char *path) {
+  HAL::File igcFile = HAL::fsOpen(path);
+  if (!igcFile) {
+    return false;
+  }
+  const uint32_t size = igcFile.size();
+  MD5::MD5_CTX md5[4];
+  const uint32_t records_end = hash_records(igcFile, size, md5);
+  bool sealed = records_end > 0 && size == records_end + 4 * g_record_size &&
+                igcFile.seek(records_end);
+  char expected[g_record_size + 1];
+  char actual[g_record_size];
+  for (uint8_t i = 0; sealed && i < 4; i++) {
+    IGC::formatGRecord(md5[i], expected);
+    sealed = igcFile.read(actual, g_record_size) == (int) g_record_size &&
+             memcmp(actual, expected, g_record_size) == 0;
+  }
+  igcFile.close();
+  return sealed;
+}
 
-    if (add_grecord) {
-      write_g_record(igcFile, md5_a);
-      write_g_record(igcFile, md5_b);
-      write_g_record(igcFile, md5_c);
-      write_g_record(igcFile, md5_d);
-    }
+// Re-hash an IGC file left behind without a G-record (power lost before
+// landing) and append the G-record. All complete records are signed,
+// anything after is overwritten, the unused part of a pre-allocated file
+// is cut off. A file that ends in a complete G-record block was closed by
+// the writer and is not read any further. Returns true if the file had
+// to be repaired.
+bool igc_file_writer::recover(const char *path) {
+  HAL::File igcFile = HAL::fsOpen(path, O_RDWR);
+  if (!igcFile) {
+    return false;
+  }
+  const uint32_t size = igcFile.size();
+  if (ends_with_grecords(igcFile, size) || !igcFile.seek(0)) {
     igcFile.close();
-    return true;
+    return false;
   }
-  return false;
+  MD5::MD5_CTX md5[4];
+  const uint32_t records_end = hash_records(igcFile, size, md5);
+
+  if (records_end == 0) {
+    // not a single record, probably pre-allocated but never written
+    igcFile.close();
+    if (size > 0) {
+      sdTruncate(path, 0);
+    }
+    return size > 0;
+  }
+  HAL::console().print(F("Adding G-record to "));
+  HAL::console().println(path);
+  // a G-record block is never shorter than what followed the last
+  // complete record, so no stale data is left at the end of the file.
+  if (igcFile.seek(records_end)) {
+    for (const MD5::MD5_CTX &ctx : md5) {
+      write_g_record(igcFile, ctx);
+    }
+  }
+  else {
+    HAL::console().println(F("Seek failed!!"));
+  }
+  igcFile.close();
+  if (size > records_end + 4 * g_record_size) {
+    // pre-allocated file, power lost before it was truncated
+    sdTruncate(path, records_end + 4 * g_record_size);
+  }
+  return true;
 }
@@ -0,0 +1,81 @@
+#include "igc_format.h"
+
+namespace IGC
+{
+
+// write value as "%0<width>u" into dst, if the number needs more than
+// width digits only the most significant digits are kept (like copying
+// the first width chars of the sprintf output)
+static void putUnsigned(char *dst, uint8_t width, uint16_t value)
+{
+  char tmp[5];
+  uint8_t len = 0;
+  do
+  {
+    tmp[len++] = '0' + value % 10;
+    value /= 10;
+  } while (value);
+  while (len < width)
+  {
+    tmp[len++] = '0';
+  }
+  for (uint8_t i = 0; i < width; i++)
+  {
+    dst[i] = tmp[len - 1 - i];
+  }
+}
+
+// same for "%0<width>d", the sign counts toward the width
+static void putSigned(char *dst, uint8_t width, int16_t value)
+{
+  if (value >= 0)
+  {
+    putUnsigned(dst, width, value);
+    return;
+  }
+  *dst = '-';
+  putUnsigned(dst + 1, width - 1, -(int32_t) value);
+}
+
+// DDMMmmm (width 2) or DDDMMmmm (width 3) followed by hemisphere
+static void putPosition(char *dst, uint8_t width, uint32_t milli_minutes, char hemisphere)
+{
+  uint16_t deg = milli_minutes / 60000;
+  uint16_t rest = milli_minutes - (uint32_t) deg * 60000;
+  putUnsigned(dst, width, deg);
+  dst += width;
+  putUnsigned(dst, 2, rest / 1000);
+  putUnsigned(dst + 2, 3, rest % 1000);
+  dst[5] = hemisphere;
+}
+
+uint32_t degreesToMilliMinutes(uint16_t deg, uint32_t billionths)
+{
+  // billionths * 60 * 1000 / 1e9, 3e9 still fits in 32 bits
+  return (uint32_t) deg * 60000 + billionths * 3 / 50000;
+}
+
+void formatBRecord(const fix_t &fix, igc_t &igc)
+{
+  igc.b = 'B';
+  // HHMMSS
+  putUnsigned(&igc.time[0], 2, fix.hour);
+  putUnsigned(&igc.time[2], 2, fix.minute);
+  putUnsigned(&igc.time[4], 2, fix.second);
+  //      12345678
+  // LAT: DDMMmmmN/S
+  putPosition(igc.lat, 2, fix.lat, (fix.flags & FIX_SOUTH) ? 'S' : 'N');
+  //      123456789
+  // LNG: DDDMMmmmE/W
+  putPosition(igc.lng, 3, fix.lng, (fix.flags & FIX_WEST) ? 'W' : 'E');
+  igc.a = 'A';
+  // pressure altitude in meters
+  putSigned(igc.pAlt, 5, fix.pAlt);
+  // GPS altitude in meters
+  putSigned(igc.gAlt, 5, fix.gAlt);
+  putUnsigned(igc.fxa, 3, fix.fxa);
+  putUnsigned(igc.siu, 2, fix.siu);
+  igc.raw[sizeof(igc.raw) - 1] = '\0';
+}
+
+} // IGC namespace
@@ -0,0 +1,70 @@
+#include <string.h>
+#include "igc_grecord.h"
+
+namespace IGC
+{
+
+char cleanChar(char c)
+{
+  if (c >= 0x20 && c <= 0x7E && c != 0x24 &&
+      c != 0x2A && c != 0x2C && c != 0x21 &&
+      c != 0x5C && c != 0x5E && c != 0x7E)
+  {
+    return c;
+  }
+  return ' ';
+}
+
+void initGRecord(MD5::MD5_CTX &md5_a, MD5::MD5_CTX &md5_b,
+                 MD5::MD5_CTX &md5_c, MD5::MD5_CTX &md5_d)
+{
+  // LK8000, not yet working, for a test file OK though!
+  MD5::MD5::MD5Initialize(&md5_a, 0x63e54c01, 0x25adab89, 0x44baecfe, 0x60f25476);
+  MD5::MD5::MD5Initialize(&md5_b, 0x41e24d03, 0x23b8ebea, 0x4a4bfc9e, 0x640ed89a);
+  MD5::MD5::MD5Initialize(&md5_c, 0x61e54e01, 0x22cdab89, 0x48b20cfe, 0x62125476);
+  MD5::MD5::MD5Initialize(&md5_d, 0xc1e84fe8, 0x21d1c28a, 0x438e1a12, 0x6c250aee);
+}
+
+void cleanRecord(char *record, size_t len, void *const md5[4])
+{
+  size_t hashed = 0; // start of span not hashed yet
+  for (size_t i = 0; i < len; ++i)
+  {
+    if (record[i] != 0x0D && record[i] != 0x0A)
+    {
+      record[i] = cleanChar(record[i]);
+    }
+    else
+    {
+      if (md5 && i > hashed)
+      {
+        MD5::MD5::MD5Update4(md5, &record[hashed], i - hashed);
+      }
+      hashed = i + 1;
+    }
+  }
+  if (md5 && len > hashed)
+  {
+    MD5::MD5::MD5Update4(md5, &record[hashed], len - hashed);
+  }
+}
+
+void formatGRecord(const MD5::MD5_CTX &md5, char (&line)[G_RECORD_SIZE + 1])
+{
+  // make a copy, so we can continue with
+  // next record in case flight not done
+  MD5::MD5_CTX md5_tmp;
+  memcpy(&md5_tmp, &md5, sizeof(MD5::MD5_CTX));
+  unsigned char hash[16];
+  char md5str[33];
+  MD5::MD5::MD5Final(hash, &md5_tmp);
+  MD5::MD5::make_digest(md5str, hash, 16);
+  // split in two 16 char. strings
+  line[0] = 'G';
+  memcpy(&line[1], md5str, 16);
+  memcpy(&line[17], "\r\nG", 3);
+  memcpy(&line[20], (md5str + 16), 16);
+  memcpy(&line[36], "\r\n", 3);
+}
+
+}
@@ -0,0 +1,273 @@
+#include <string.h>
+#include "igc_journal.h"
+
+namespace IGC
+{
+
+static const uint32_t seconds_per_day = 86400UL;
+static const uint8_t key_size = 1 + 19;
+
+static uint8_t *putLE(uint8_t *out, uint32_t value, uint8_t bytes)
+{
+  while (bytes--)
+  {
+    *out++ = value & 0xff;
+    value >>= 8;
+  }
+  return out;
+}
+
+static uint32_t getLE(const uint8_t *in, uint8_t bytes)
+{
+  uint32_t value = 0;
+  for (uint8_t i = bytes; i > 0; i--)
+  {
+    value = (value << 8) | in[i - 1];
+  }
+  return value;
+}
+
+static uint8_t *putVarint(uint8_t *out, uint32_t value)
+{
+  while (value >= 0x80)
+  {
+    *out++ = (value & 0x7f) | 0x80;
+    value >>= 7;
+  }
+  *out++ = value;
+  return out;
+}
+
+// false if the varint does not end before end or is too long
+static bool getVarint(const uint8_t *&in, const uint8_t *end, uint32_t &value)
+{
+  value = 0;
+  for (uint8_t shift = 0; shift < 35 && in < end; shift += 7)
+  {
+    const uint8_t b = *in++;
+    value |= (uint32_t) (b & 0x7f) << shift;
+    if (!(b & 0x80))
+    {
+      return true;
+    }
+  }
+  return false;
+}
+
+// small differences of either sign to small numbers: 0, -1, 1, -2, ...
+static uint32_t zigzag(int32_t value)
+{
+  return ((uint32_t) value << 1) ^ (uint32_t) (value >> 31);
+}
+
+static int32_t unzigzag(uint32_t value)
+{
+  return (int32_t) (value >> 1) ^ -(int32_t) (value & 1);
+}
+
+static uint32_t timeOfDay(const fix_t &fix)
+{
+  return (fix.hour * 60UL + fix.minute) * 60UL + fix.second;
+}
+
+static void setTimeOfDay(fix_t &fix, uint32_t time)
+{
+  fix.hour = time / 3600;
+  fix.minute = time / 60 % 60;
+  fix.second = time % 60;
+}
+
+void journalBegin(journal_t &journal)
+{
+  memset(&journal, 0, sizeof(journal));
+}
+
+uint8_t journalHeader(uint8_t *out)
+{
+  memcpy(out, "IGCJ", 4);
+  out[4] = JOURNAL_VERSION;
+  return JOURNAL_HEADER_SIZE;
+}
+
+uint16_t journalText(const char *line, uint8_t *out)
+{
+  size_t len = strlen(line);
+  if (len > 255)
+  {
+    len = 255;
+  }
+  out[0] = JOURNAL_TEXT;
+  out[1] = len;
+  memcpy(&out[2], line, len);
+  return 2 + len;
+}
+
+uint8_t journalFix(journal_t &journal, const fix_t &fix, uint8_t *out)
+{
+  uint8_t *p = out;
+  const uint32_t time = timeOfDay(fix);
+  const uint32_t step = (time + seconds_per_day - journal.time) % seconds_per_day;
+  if (!journal.started || journal.since_key >= JOURNAL_KEY_INTERVAL ||
+      fix.flags != journal.last.flags)
+  {
+    *p++ = JOURNAL_KEY;
+    p = putLE(p, time, 3);
+    *p++ = fix.flags;
+    p = putLE(p, fix.lat, 4);
+    p = putLE(p, fix.lng, 4);
+    p = putLE(p, (uint16_t) fix.pAlt, 2);
+    p = putLE(p, (uint16_t) fix.gAlt, 2);
+    p = putLE(p, fix.fxa, 2);
+    *p++ = fix.siu;
+    journal.since_key = 0;
+    // the next delta carries its step, so decoding can start at any keyframe
+    journal.step = 0;
+    journal.started = true;
+  }
+  else
+  {
+    uint8_t *tag = p++;
+    uint8_t mask = 0;
+    if (step != journal.step)
+    {
+      mask |= JOURNAL_HAS_DT;
+      p = putVarint(p, step);
+      journal.step = step;
+    }
+    p = putVarint(p, zigzag((int32_t) (fix.lat - journal.last.lat)));
+    p = putVarint(p, zigzag((int32_t) (fix.lng - journal.last.lng)));
+    p = putVarint(p, zigzag((int32_t) fix.pAlt - journal.last.pAlt));
+    p = putVarint(p, zigzag((int32_t) fix.gAlt - journal.last.gAlt));
+    if (fix.fxa != journal.last.fxa)
+    {
+      mask |= JOURNAL_HAS_FXA;
+      p = putVarint(p, zigzag((int32_t) fix.fxa - journal.last.fxa));
+    }
+    if (fix.siu != journal.last.siu)
+    {
+      mask |= JOURNAL_HAS_SIU;
+      *p++ = fix.siu;
+    }
+    *tag = JOURNAL_DELTA | mask;
+    journal.since_key++;
+  }
+  journal.last = fix;
+  journal.time = time;
+  return p - out;
+}
+
+bool journalCheckHeader(const uint8_t *data, size_t size)
+{
+  return size >= JOURNAL_HEADER_SIZE && memcmp(data, "IGCJ", 4) == 0 &&
+         data[4] == JOURNAL_VERSION;
+}
+
+static bool decodeKey(const uint8_t *data, fix_t &fix, uint32_t &time)
+{
+  time = getLE(&data[1], 3);
+  fix.flags = data[4];
+  fix.lat = getLE(&data[5], 4);
+  fix.lng = getLE(&data[9], 4);
+  fix.pAlt = (int16_t) getLE(&data[13], 2);
+  fix.gAlt = (int16_t) getLE(&data[15], 2);
+  fix.fxa = getLE(&data[17], 2);
+  fix.siu = data[19];
+  setTimeOfDay(fix, time);
+  // plausible values only, a damaged entry must not pass as a keyframe
+  return time < seconds_per_day && fix.flags <= (FIX_SOUTH | FIX_WEST) &&
+         fix.lat <= 90 * 60000UL && fix.lng <= 180 * 60000UL;
+}
+
+size_t journalDecode(journal_t &journal, const uint8_t *data, size_t size,
+                     journal_entry_t &entry)
+{
+  if (size < 1)
+  {
+    return 0;
+  }
+  if (data[0] == JOURNAL_TEXT)
+  {
+    if (size < 2 || size < 2u + data[1])
+    {
+      return 0;
+    }
+    entry.type = JOURNAL_TEXT;
+    entry.text = (const char *) &data[2];
+    entry.length = data[1];
+    return 2 + data[1];
+  }
+  if (data[0] == JOURNAL_KEY)
+  {
+    uint32_t time;
+    if (size < key_size || !decodeKey(data, entry.fix, time))
+    {
+      return 0;
+    }
+    journal.step = 0;
+    journal.started = true;
+    journal.time = time;
+    journal.last = entry.fix;
+    entry.type = JOURNAL_FIX;
+    return key_size;
+  }
+  if ((data[0] & ~(JOURNAL_HAS_DT | JOURNAL_HAS_FXA | JOURNAL_HAS_SIU)) != JOURNAL_DELTA ||
+      !journal.started)
+  {
+    return 0;
+  }
+  const uint8_t mask = data[0];
+  const uint8_t *p = &data[1];
+  const uint8_t *end = data + size;
+  uint32_t step = journal.step;
+  uint32_t dlat, dlng, dpalt, dgalt, dfxa = 0;
+  if ((mask & JOURNAL_HAS_DT) && !getVarint(p, end, step))
+  {
+    return 0;
+  }
+  if (!getVarint(p, end, dlat) || !getVarint(p, end, dlng) ||
+      !getVarint(p, end, dpalt) || !getVarint(p, end, dgalt))
+  {
+    return 0;
+  }
+  if ((mask & JOURNAL_HAS_FXA) && !getVarint(p, end, dfxa))
+  {
+    return 0;
+  }
+  fix_t &fix = entry.fix;
+  fix = journal.last;
+  if (mask & JOURNAL_HAS_SIU)
+  {
+    if (p >= end)
+    {
+      return 0;
+    }
+    fix.siu = *p++;
+  }
+  journal.step = step;
+  journal.time = (journal.time + step) % seconds_per_day;
+  setTimeOfDay(fix, journal.time);
+  fix.lat += unzigzag(dlat);
+  fix.lng += unzigzag(dlng);
+  fix.pAlt += unzigzag(dpalt);
+  fix.gAlt += unzigzag(dgalt);
+  fix.fxa += unzigzag(dfxa);
+  journal.last = fix;
+  entry.type = JOURNAL_FIX;
+  return p - data;
+}
+
+size_t journalResync(const uint8_t *data, size_t size)
+{
+  for (size_t pos = 1; pos + key_size <= size; pos++)
+  {
+    fix_t fix;
+    uint32_t time;
+    if (data[pos] == JOURNAL_KEY && decodeKey(&data[pos], fix, time))
+    {
+      return pos;
+    }
+  }
+  return size;
+}
+
+}
@@ -0,0 +1,59 @@
+#include "igc_record_ring.h"
+
+bool igc_record_ring::push(const char *record, uint8_t len, unsigned long now)
+{
+  if (len == 0 || (uint16_t) len + entry_overhead > available())
+  {
+    return false;
+  }
+  put(len);
+  put(now & 0xff);
+  put((now >> 8) & 0xff);
+  for (uint8_t i = 0; i < len; i++)
+  {
+    put(record[i]);
+  }
+  used_bytes += len + entry_overhead;
+  records++;
+  return true;
+}
+
+uint8_t igc_record_ring::peek_length() const
+{
+  return empty() ? 0 : buffer[tail];
+}
+
+unsigned long igc_record_ring::oldest(unsigned long now) const
+{
+  if (empty())
+  {
+    return now;
+  }
+  // only 16 bits of the time stamp are stored, so
+  // restore the upper bits from the current time
+  uint16_t i = next(tail);
+  uint16_t stamp = buffer[i];
+  stamp |= (uint16_t) buffer[next(i)] << 8;
+  return now - (uint16_t) ((uint16_t) now - stamp);
+}
+
+uint8_t igc_record_ring::pop(char *record, uint8_t size)
+{
+  uint8_t len = peek_length();
+  if (len == 0 || len > size)
+  {
+    return 0;
+  }
+  for (uint8_t i = 0; i < entry_overhead; i++)
+  {
+    tail = next(tail);
+  }
+  for (uint8_t i = 0; i < len; i++)
+  {
+    record[i] = buffer[tail];
+    tail = next(tail);
+  }
+  used_bytes -= len + entry_overhead;
+  records--;
+  return len;
+}
@@ -1,49 +1,203 @@
 #include <Arduino.h>
-#include <SD.h>
-
-void WriteNextFileIndex(int n)
-{
-  Serial.println(F("Opening index.txt for writing..."));
-  File index = SD.open("index.txt", O_WRITE | O_CREAT | O_TRUNC);
-  if (index) {
-      Serial.println(F("Writing index.txt..."));
-      char line[10];
-      sprintf(line,"%d",n);
-      index.println(line);
-      index.close();
-  }
-  else {
-    Serial.println(F("Error opening index.txt for writing!"));
-  }
-}
-
-int ReadNextFileIndex()
-{
-  int result = 0;
-  char c;
-  char line[80];
-  char i = 0;
-  char *p = line;
-  
-  Serial.println(F("Opening index.txt for reading..."));
-  File index = SD.open(F("index.txt"),FILE_READ);
-  if (index) {
-    Serial.println(F("Reading index.txt..."));
-    while(index.available() && i<(int) sizeof(line)){
-      c = index.read();
-      *p++ = c;
-      if (c == '\n') {
-        *p = '\0';
+#include <EEPROM.h>
+#include "index.h"
+#include "eeprom_layout.h"
+#include "hal.h"
+
+// A slot holds the counter and its complement, so erased (0xff) and
+// half written slots are invalid. The slot with the highest counter is
+// current, the next write goes to the slot after it. One flight costs
+// one slot write, each EEPROM cell sees 1/EEPROM_INDEX_SLOTS of them.
+typedef struct
+{
+  uint32_t counter;
+  uint32_t check;     // ~counter
+} index_slot_t;
+
+static const char index_file[] = "index.txt";
+
+static bool readSlot(uint8_t slot, uint32_t &counter)
+{
+  index_slot_t data;
+  EEPROM.get(EEPROM_INDEX_ADDR + slot * sizeof(index_slot_t), data);
+  counter = data.counter;
+  return data.check == ~data.counter;
+}
+
+// current slot, -1 if none is valid
+static int8_t findSlot(uint32_t &counter)
+{
+  int8_t current = -1;
+  counter = 0;
+  for (uint8_t slot = 0; slot < EEPROM_INDEX_SLOTS; slot++)
+  {
+    uint32_t value;
+    if (readSlot(slot, value) && (current < 0 || value > counter))
+    {
+      current = slot;
+      counter = value;
+    }
+  }
+  return current;
+}
+
+static bool writeSlot(uint8_t slot, uint32_t counter)
+{
+  index_slot_t data = { counter, ~counter };
+  EEPROM.put(EEPROM_INDEX_ADDR + slot * sizeof(index_slot_t), data);
+  uint32_t verify;
+  return readSlot(slot, verify) && verify == counter;
+}
+
+static bool readIndexFile(uint32_t &counter)
+{
+  HAL::File index = HAL::fsOpen(index_file, FILE_READ);
+  if (!index)
+  {
+    return false;
+  }
+  char line[12];
+  uint8_t len = 0;
+  while (index.available() && len < sizeof(line) - 1)
+  {
+    char c = index.read();
+    if (c < '0' || c > '9')
+    {
+      break;
+    }
+    line[len++] = c;
+  }
+  line[len] = '\0';
+  index.close();
+  counter = strtoul(line, NULL, 10);
+  return len > 0;
+}
+
+static void writeIndexFile(uint32_t counter)
+{
+  HAL::File index = HAL::fsOpen(index_file, O_WRITE | O_CREAT | O_TRUNC);
+  if (index)
+  {
+    index.println(counter);
+    index.close();
+  }
+  else
+  {
+    HAL::console().println(F("Error opening index.txt for writing!"));
+  }
+}
+
+uint32_t ReadFileCounter()
+{
+  uint32_t counter = 0;
+  if (findSlot(counter) < 0)
+  {
+    // EEPROM not used yet or worn out, index.txt of older firmware
+    readIndexFile(counter);
+  }
+  HAL::console().print(F("File counter = "));
+  HAL::console().println(counter);
+  return counter;
+}
+
+static void writeFileCounter(uint32_t counter)
+{
+  uint32_t current;
+  int8_t slot = findSlot(current);
+  // try the following slots until one verifies
+  for (uint8_t i = 0; i < EEPROM_INDEX_SLOTS; i++)
+  {
+    slot = (slot + 1) % EEPROM_INDEX_SLOTS;
+    if (writeSlot(slot, counter))
+    {
+      return;
+    }
+  }
+  HAL::console().println(F("EEPROM index failed, using index.txt"));
+  writeIndexFile(counter);
+}
+
+// lgNNN.igc or lgNNN.bin (journal) -> NNN, -1 for other names
+static int fileNumber(const char *name)
+{
+  if (strncasecmp(name, "lg", 2) != 0 ||
+      (strcasecmp(name + 5, ".igc") != 0 && strcasecmp(name + 5, ".bin") != 0))
+  {
+    return -1;
+  }
+  int number = 0;
+  for (uint8_t i = 2; i < 5; i++)
+  {
+    if (name[i] < '0' || name[i] > '9')
+    {
+      return -1;
+    }
+    number = number * 10 + name[i] - '0';
+  }
+  return number;
+}
+
+// counter to store once the reserved file is complete, 0 if none
+static uint32_t pending_counter = 0;
+
+int ReserveFileIndex(const char *folder)
+{
+  uint32_t counter = ReadFileCounter();
+  uint32_t sd_counter;
+  if (readIndexFile(sd_counter) && sd_counter > counter)
+  {
+    // written by the fallback, or by older firmware
+    counter = sd_counter;
+  }
+  int index = counter % 1000;
+
+  char path[20]; // YYYYMMDD/lg000.igc
+  snprintf_P(path, sizeof(path), PSTR("%s/lg%03d.igc"), folder, index);
+  bool used = HAL::fsExists(path);
+  if (!used)
+  {
+    snprintf_P(path, sizeof(path), PSTR("%s/lg%03d.bin"), folder, index);
+    used = HAL::fsExists(path);
+  }
+  if (used)
+  {
+    // counter wrapped past 999 or was lost: scan the day folder once
+    // and take the first free number after the counter
+    uint8_t day_bitmap[125] = {};
+    HAL::File dir = HAL::fsOpen(folder);
+    HAL::File entry;
+    while (dir && (entry = dir.openNextFile()))
+    {
+      int number = entry.isDirectory() ? -1 : fileNumber(entry.name());
+      if (number >= 0)
+      {
+        day_bitmap[number >> 3] |= 1 << (number & 7);
       }
+      entry.close();
+    }
+    dir.close();
+    uint16_t skip = 0;
+    while (skip < 1000 && (day_bitmap[index >> 3] & (1 << (index & 7))))
+    {
+      index = (index + 1) % 1000;
+      skip++;
+    }
+    if (skip == 1000)
+    {
+      HAL::console().println(F("No free IGC file number left!"));
+      return -1;
     }
-    result = atoi(line);
-    Serial.print(F("result = "));
-    Serial.println(result);
-    WriteNextFileIndex(++result);
+    counter += skip;
   }
-  else {
-    Serial.println(F("Error opening file index.txt for reading, creating new file"));
-    WriteNextFileIndex(0);
+  pending_counter = counter + 1;
+  return index;
+}
+
+void CommitFileIndex()
+{
+  if (pending_counter != 0)
+  {
+    writeFileCounter(pending_counter);
+    pending_counter = 0;
   }
-  return result;
 }
@@ -1,18 +1,20 @@
 #include <Arduino.h>
-#include <SD.h>
 #include "logger.h"
 #include "igc_file_writer.h"
-#include "MD5.h"
+#include "igc_record_ring.h"
+#include "igc_journal.h"
+#include "igc_grecord.h"
 #include "utils.h"
 #include "index.h"
+#include "sd_prealloc.h"
+#include "hal.h"
+#include "perf.h"
 
 namespace IGC
 {
 
-static File igcFile;
-//                                  012345678
-static char *igcfilename = (char*) "lg000.igc";
-static const int igc_id_offset = 2; // offset to numeric id
+static HAL::File igcFile;
+static int igc_file_index = 0;      // lg000.igc
 //
 //                                               11111111
 //                                     012345678901234567
@@ -25,6 +27,28 @@ static const char* IGC_EOL = "\r\n";
 // singleton instance of igc file writer
 static igc_file_writer* igc_writer_ptr = NULL;
 
+// B records waiting to be written to SD, flushed in batches
+static igc_record_ring record_ring;
+static const uint16_t flush_batch_size = 512;
+static unsigned long flush_budget = 0; // max. time in ms a record is queued
+static record_stats_t record_stats;
+static int queueRecord(const char *data);
+
+// ring of the last fixes before takeoff, binary so it holds ~2x more
+// than formatted records would
+static const uint16_t ground_window = 60;    // s before takeoff
+static IGC::fix_t *ground_fixes = NULL;
+static uint16_t ground_size = 0;
+static uint16_t ground_head = 0;  // next write
+static uint16_t ground_count = 0;
+static void flushGroundFixes();
+
+// journal mode: binary lgNNN.bin, no text formatting, hashing or queue
+static bool journal_mode = false;
+static IGC::journal_t journal;
+static bool writeJournalFix(const IGC::fix_t &fix);
+static float makeFix(TinyGPSPlus &gps, float alt, IGC::fix_t &fix);
+
 template<size_t size>
 bool IGCWriteRecord(const char(&szIn)[size]) {
     return igc_writer_ptr && igc_writer_ptr->append(szIn);
@@ -32,239 +56,637 @@ bool IGCWriteRecord(const char(&szIn)[size]) {
 
 void initIGC()
 {
-  Serial.println(F(">>>>>>>>>>> initIGC <<<<<<<<<<<<<"));
+  HAL::console().println(F(">>>>>>>>>>> initIGC <<<<<<<<<<<<<"));
 
   memset(&igc_full_path,0,sizeof(igc_full_path));
+  memset(&record_stats,0,sizeof(record_stats));
   bIGCHeaderWritten = false;
   BRecordCount=0;
 }
 
 void prepareIGCFileName()
 {
-    // read index.txt from SD for next IGC index number
-    int file_index = ReadNextFileIndex();
-    
-    // Prepare filename with current index
-    igcfilename[igc_id_offset]   = (file_index / 100) % 10 + '0';
-    igcfilename[igc_id_offset+1] = (file_index / 10) % 10 + '0';
-    igcfilename[igc_id_offset+2] = (file_index) % 10 + '0';
+    // expected number of the next file, only reserved once the file
+    // gets created, so a boot without a flight writes nothing
+    igc_file_index = ReadFileCounter() % 1000;
 }
 
 void DumpIGCFile(const char* path)
 {
   // re-open the file for reading:
-  File myFile = SD.open(path);
+  HAL::File myFile = HAL::fsOpen(path);
   if (myFile) {
-    Serial.print(F("Dumping "));
-    Serial.println(path);
+    HAL::console().print(F("Dumping "));
+    HAL::console().println(path);
 
     // read from the file until there's nothing else in it:
     while (myFile.available()) {
       char c = myFile.read();
-      Serial.write(c);
+      if (c == '\0')
+      {
+        // unused part of a pre-allocated file
+        break;
+      }
+      HAL::console().write(c);
       if (c == 0x0a)
       {
-        Serial.print('\r');
+        HAL::console().print('\r');
       }
     }
     // close the file:
     myFile.close();
   } else {
     // if the file didn't open, print an error:
-    Serial.print(F("Error opening "));
-    Serial.print(path);
-    Serial.println(F(" for reading!"));
+    HAL::console().print(F("Error opening "));
+    HAL::console().print(path);
+    HAL::console().println(F(" for reading!"));
   }  
 }
 
+uint32_t preallocSize(const config_t &config, bool journal)
+{
+  // every fix is logged at the shortest interval in effect
+  const int interval = config.adaptive_logging ? config.log_interval_min : config.log_interval;
+  if (config.max_flight_hours <= 0 || interval <= 0)
+  {
+    return 0;
+  }
+  const uint32_t header_size = 1024;
+  const uint32_t grecord_size = journal ? 0 : 4 * IGC::G_RECORD_SIZE;
+  const uint32_t record_size = journal ? IGC::JOURNAL_FIX_BUDGET : sizeof(igc_t) - 1 + 2;
+  // the fixes kept from before takeoff come on top of the flight
+  const uint32_t records = ((uint32_t) config.max_flight_hours * 3600 + ground_window) / interval;
+  return header_size + records * record_size + grecord_size;
+}
+
+// IGC header lines: fixed text in flash, followed by a config or date field
+enum header_field_t
+{
+  HF_NONE,
+  HF_DATE,      // DDMMYY
+  HF_PILOT,
+  HF_COPILOT,
+  HF_TYPE,
+  HF_REG,
+  HF_GPS,
+  HF_CS,
+  HF_CLASS
+};
+
+typedef struct
+{
+  const char *text;     // PROGMEM
+  uint8_t field;        // header_field_t
+} header_line_t;
+
+static const char h_date[] PROGMEM = "HFDTE";
+static const char h_fxa[] PROGMEM = "HFFXA035";
+static const char h_pilot[] PROGMEM = "HFPLTPILOTINCHARGE: ";
+static const char h_copilot[] PROGMEM = "HFCM2CREW2: ";
+static const char h_type[] PROGMEM = "HFGTYGLIDERTYPE: ";
+static const char h_reg[] PROGMEM = "HFGIDGLIDERID: ";
+static const char h_datum[] PROGMEM = "HFDTM100GPSDATUM: WGS-1984";
+static const char h_hardware[] PROGMEM = "HFRHWHARDWAREVERSION: 2021";
+static const char h_frtype[] PROGMEM = "HFFTYFRTYPE:Simple Arduino Logger";
+static const char h_gps[] PROGMEM = "HFGPSRECEIVER: ";
+static const char h_altgps[] PROGMEM = "HFALGALTGPS:GEO";     // for non IGC loggers
+static const char h_altpressure[] PROGMEM = "HFALPALTPRESSURE:ISA";
+static const char h_sensor[] PROGMEM = "HFPRSPRESSALTSENSOR: Bosch Sensortec,BMP280,max9000m";
+static const char h_cs[] PROGMEM = "HFCIDCOMPETITIONID: ";
+static const char h_class[] PROGMEM = "HFCCLCOMPETITIONCLASS: ";
+static const char h_extensions[] PROGMEM = "I023638FXA3940SIU";  // FXA and SIU number
+
+static const header_line_t header_lines[] PROGMEM =
+{
+  { h_date, HF_DATE },
+  { h_fxa, HF_NONE },
+  { h_pilot, HF_PILOT },
+  { h_copilot, HF_COPILOT },
+  { h_type, HF_TYPE },
+  { h_reg, HF_REG },
+  { h_datum, HF_NONE },
+  { h_hardware, HF_NONE },
+  { h_frtype, HF_NONE },
+  { h_gps, HF_GPS },
+  { h_altgps, HF_NONE },
+  { h_altpressure, HF_NONE },
+  { h_sensor, HF_NONE },
+  { h_cs, HF_CS },
+  { h_class, HF_CLASS },
+  { h_extensions, HF_NONE },
+};
+
+// format one header line from its descriptor in flash
+static int writeHeaderLine(const header_line_t &desc, uint8_t y, uint8_t m, uint8_t d, const config_t &config)
+{
+  char line[80];
+  const char *text = (const char *) pgm_read_ptr(&desc.text);
+  strncpy_P(line, text, sizeof(line) - 1);
+  line[sizeof(line) - 1] = '\0';
+  const size_t len = strlen(line);
+  const char *value = NULL;
+  switch (pgm_read_byte(&desc.field))
+  {
+    case HF_DATE:
+      snprintf_P(line + len, sizeof(line) - len, PSTR("%02d%02d%02d"), d, m, y);
+      break;
+    case HF_PILOT: value = config.pilot; break;
+    case HF_COPILOT: value = config.copilot; break;
+    case HF_TYPE: value = config.type; break;
+    case HF_REG: value = config.reg; break;
+    case HF_GPS: value = config.gps; break;
+    case HF_CS: value = config.cs; break;
+    case HF_CLASS: value = config.cls; break;
+  }
+  if (value != NULL)
+  {
+    // truncated like the %s of the former writeHRecord() format
+    strncat(line, value, sizeof(line) - 1 - len);
+  }
+  return writeRecord(line);
+}
+
 int writeIGCHeader(uint8_t y, uint8_t m, uint8_t d, config_t &config)
 {
   int result = 0;
   if (!bIGCHeaderWritten)
   {
-    Serial.println(F("Writing IGC Header..."));
-    // create empty file
-    igcFile = SD.open(igc_full_path,O_WRITE | O_CREAT | O_TRUNC);
-    if(igcFile)
+    HAL::console().println(F("Writing IGC Header..."));
+    bool created = false;
+    uint32_t size = preallocSize(config, journal_mode);
+    if (size > 0 && igc_writer_ptr)
+    {
+      // reserve the whole file up front, so the FAT is not
+      // touched while the file grows during the flight
+      HAL::fsRemove(igc_full_path);
+      created = sdPreallocate(igc_full_path, size);
+      if (created)
+      {
+        HAL::console().print(F("Pre-allocated "));
+        HAL::console().print(size);
+        HAL::console().println(F(" bytes"));
+        igc_writer_ptr->set_preallocated();
+      }
+    }
+    if (!created)
     {
+      // create empty file
+      igcFile = HAL::fsOpen(igc_full_path,O_WRITE | O_CREAT | O_TRUNC);
+      created = igcFile;
       igcFile.close();
+    }
+    if(created && igc_writer_ptr)
+    {
       BRecordCount = 0;
+      if (journal_mode)
+      {
+        uint8_t header[IGC::JOURNAL_HEADER_SIZE];
+        IGC::journalHeader(header);
+        igc_writer_ptr->append_raw(header, sizeof(header));
+        IGC::journalBegin(journal);
+      }
       //construct IGC header
       result = writeARecord(); // MUST be 1st record!
       // put in UTC time stamp and config values
-      if (result) result = writeHRecord("HFDTE%02d%02d%02d",d,m,y); // DDMMYY
-      if (result) result = writeHRecord("HFFXA035");
-      if (result) result = writeHRecord("HFPLTPILOTINCHARGE: %s",config.pilot);
-      if (result) result = writeHRecord("HFCM2CREW2: %s",config.copilot);
-      if (result) result = writeHRecord("HFGTYGLIDERTYPE: %s",config.type);
-      if (result) result = writeHRecord("HFGIDGLIDERID: %s",config.reg);
-      if (result) result = writeHRecord("HFDTM100GPSDATUM: WGS-1984");
-      if (result) result = writeHRecord("HFRHWHARDWAREVERSION: 2021");
-      if (result) result = writeHRecord("HFFTYFRTYPE:Simple Arduino Logger");
-      if (result) result = writeHRecord("HFGPSRECEIVER: %s",config.gps);
-      if (result) result = writeHRecord("HFALGALTGPS:GEO");     // for non IGC loggers
-      if (result) result = writeHRecord("HFALPALTPRESSURE:ISA");
-      if (result) result = writeHRecord("HFPRSPRESSALTSENSOR: Bosch Sensortec,BMP280,max9000m");
-      if (result) result = writeHRecord("HFCIDCOMPETITIONID: %s",config.cs);
-      if (result) result = writeHRecord("HFCCLCOMPETITIONCLASS: %s",config.cls);
-      if (result) result = writeHRecord("I023638FXA3940SIU");  // FXA and SIU number
+      for (uint8_t i = 0; result && i < sizeof(header_lines) / sizeof(header_lines[0]); i++)
+      {
+        result = writeHeaderLine(header_lines[i], y, m, d, config);
+      }
       if (result)
       {
+        // header is staged in RAM, put it on the card now
+        igc_writer_ptr->sync();
         bIGCHeaderWritten = true;
-        // for debug!
-        DumpIGCFile(igc_full_path);
       }
     }
     else 
     {
-        Serial.println(F("Error opening IGC file for header!"));
+        HAL::console().println(F("Error opening IGC file for header!"));
     }
   }
   return result;  
 }
 
-static char* convertDoubleToDDMMmmm(double f, const char* c, pos_type type)
-{
-  static char result[20];
-  memset(&result,0,sizeof(result));
-  char tmp[10];
-  
-  // Abs(f)
-  double d = f;
-  if (d<0) d = -d;
-	// degrees
-	int degr = (int) d;
-	double dminu = (d - degr)*60;
-	int minu = floor(dminu);
-	int sec = (int) .5 + (dminu - minu)*1000;
-	switch (type)
-	{
-	case LAT:
-		// DDMMmmmN/S
-		sprintf(tmp, "%02d", degr);
-		strcpy(result, tmp);
-		sprintf(tmp, "%02d", minu);
-		strcat(result, tmp);
-		sprintf(tmp, "%03d", sec);
-		strncat(result, tmp, 3);
-		break;
-	case LNG:
-		// DDDMMmmmE/W
-		sprintf(tmp, "%03d", degr);
-		strcpy(result, tmp);
-		sprintf(tmp, "%02d", minu);
-		strcat(result, tmp);
-		sprintf(tmp, "%03d", sec);
-		strncat(result, tmp, 3);
-		break;
-	}
-	strcat(result, c);
-//  Serial.print(f,6);
-//  Serial.print(F(" -> "));
-//  Serial.println(result);
-  return result;
-}
-
 int writeBRecord(TinyGPSPlus &gps, float alt, config_t &config)
 {
-    const char* c;
     igc_t cur_igc;
-    char igcbuffer[100];
     int result = 0;
 
     // IGC file write enabled but no header written yet?
     if (bIGCFileWrite && !bIGCHeaderWritten)
     {
-        IGC::writeIGCHeader(gps.date.year()-2000,gps.date.month(),gps.date.day(),config);
+        if (IGC::writeIGCHeader(gps.date.year()-2000,gps.date.month(),gps.date.day(),config))
+        {
+            flushGroundFixes();
+        }
+    }
+    IGC::fix_t fix;
+    float fxa = makeFix(gps, alt, fix);
+    HAL::console().print(F("HDOP = "));
+    HAL::console().print(gps.hdop.value()/100.0,6);
+    HAL::console().print(F(", FXA = "));
+    HAL::console().println(fxa, 6);
+
+    if (journal_mode)
+    {
+      // a few bytes into the sector stage, no need to queue
+      result = bIGCFileWrite && writeJournalFix(fix);
+      if (result)
+      {
+        BRecordCount++;
+      }
+      else if (bIGCFileWrite)
+      {
+        record_stats.dropped++;
+      }
+      return result;
+    }
+
+    PERF_START(format_start);
+    IGC::formatBRecord(fix, cur_igc);
+    PERF_STOP(FORMAT, format_start);
+
+//    HAL::console().println(cur_igc.raw);
+    result = queueRecord(cur_igc.raw);
+    if (result)
+    {
+      BRecordCount++;
     }
-    // prepare IGC B-record
-    memset(&cur_igc,0,sizeof(cur_igc));
-    memset(&cur_igc,'0',sizeof(cur_igc) - 1);
-    cur_igc.a = 'A';
-    cur_igc.b = 'B';
-    // HHMMSS
-    sprintf(igcbuffer, "%02d%02d%02d",gps.time.hour(),gps.time.minute(),gps.time.second());
-    memcpy(&cur_igc.time,igcbuffer,6);
-    //      12345678
-    // LAT: DDMMmmmN/S
-    c = gps.location.rawLat().negative ? "S" : "N";
-    sprintf(igcbuffer,"%s",convertDoubleToDDMMmmm(gps.location.lat(),c, IGC::LAT));
-    memcpy(&cur_igc.lat,igcbuffer,8);
-    //      123456789
-    // LNG: DDDMMmmmE/W
-    c = gps.location.rawLng().negative ? "W" : "E";
-    sprintf(igcbuffer,"%s",convertDoubleToDDMMmmm(gps.location.lng(),c, IGC::LNG));
-    memcpy(&cur_igc.lng,igcbuffer,9);
+    return result;
+}
+
+// prepare IGC B-record, integer math only, returns the FXA
+static float makeFix(TinyGPSPlus &gps, float alt, IGC::fix_t &fix)
+{
+    fix.hour = gps.time.hour();
+    fix.minute = gps.time.minute();
+    fix.second = gps.time.second();
+    const RawDegrees &lat = gps.location.rawLat();
+    const RawDegrees &lng = gps.location.rawLng();
+    fix.flags = (lat.negative ? IGC::FIX_SOUTH : 0) | (lng.negative ? IGC::FIX_WEST : 0);
+    fix.lat = IGC::degreesToMilliMinutes(lat.deg, lat.billionths);
+    fix.lng = IGC::degreesToMilliMinutes(lng.deg, lng.billionths);
     // pressure altitude in meters
-    sprintf(igcbuffer,"%05d",(int) alt);
-    memcpy(&cur_igc.pAlt,igcbuffer,5);
-    // GPS altitude in meters
-    sprintf(igcbuffer,"%05d",(int) gps.altitude.meters());
-    memcpy(&cur_igc.gAlt,igcbuffer,5);
+    fix.pAlt = (int) alt;
+    // GPS altitude in meters (value is in cm)
+    fix.gAlt = gps.altitude.value() / 100;
 
     // Using this formula to get a rough 2-sigma ehp value
     float fxa = (gps.hdop.value()/100.0) * 5.1 * 2.0;
-    Serial.print("HDOP = ");
-    Serial.print(gps.hdop.value()/100.0,6);
-    Serial.print(", FXA = ");
-    Serial.println(fxa, 6);
-
-    sprintf(igcbuffer,"%03u", (unsigned int) fxa);
-    memcpy(&cur_igc.fxa,igcbuffer,3);
+    fix.fxa = (unsigned int) fxa;
 
     // Output the SIU (Satellites In Use) Information
-    sprintf(igcbuffer,"%02u", (unsigned int) gps.satellites.value());
-    memcpy(&cur_igc.siu,igcbuffer,2);
+    fix.siu = gps.satellites.value();
+    return fxa;
+}
 
-//    Serial.println(cur_igc.raw);
-    result = writeRecord(cur_igc.raw, true);
-    if (result)
+// room for ground_window s of fixes at interval s, limited to half of
+// the free RAM left after the IGC writer (allocated at takeoff) and a
+// stack reserve
+void initGroundFixes(uint16_t interval)
+{
+  const size_t reserve = sizeof(igc_file_writer) + 1024;
+  heap_info_t info;
+  getHeapInfo(info);
+  size_t budget = info.free_memory > reserve ? (info.free_memory - reserve) / 2 : 0;
+  size_t size = ground_window / (interval > 0 ? interval : 1);
+  if (size > budget / sizeof(IGC::fix_t))
+  {
+    size = budget / sizeof(IGC::fix_t);
+  }
+  free(ground_fixes);
+  ground_fixes = NULL;
+  if (size > 0)
+  {
+    ground_fixes = (IGC::fix_t *) malloc(size * sizeof(IGC::fix_t));
+  }
+  ground_size = ground_fixes ? size : 0;
+  ground_head = 0;
+  ground_count = 0;
+  HAL::console().print(F("Pre-takeoff ring: "));
+  HAL::console().print(ground_size);
+  HAL::console().print(F(" fixes, "));
+  HAL::console().print(ground_size * sizeof(IGC::fix_t));
+  HAL::console().println(F(" bytes"));
+}
+
+void keepGroundFix(TinyGPSPlus &gps, float alt)
+{
+  if (ground_size == 0)
+  {
+    return;
+  }
+  makeFix(gps, alt, ground_fixes[ground_head]);
+  ground_head = (ground_head + 1 == ground_size) ? 0 : ground_head + 1;
+  if (ground_count < ground_size)
+  {
+    ground_count++;
+  }
+}
+
+static bool writeJournalFix(const IGC::fix_t &fix)
+{
+  uint8_t entry[IGC::JOURNAL_FIX_MAX];
+  PERF_START(format_start);
+  uint8_t size = IGC::journalFix(journal, fix, entry);
+  PERF_STOP(FORMAT, format_start);
+  return igc_writer_ptr && igc_writer_ptr->append_raw(entry, size);
+}
+
+// write the ground fixes, oldest first, right after the header
+static void flushGroundFixes()
+{
+  if (ground_count == 0)
+  {
+    return;
+  }
+  uint16_t index = (ground_head + ground_size - ground_count) % ground_size;
+  const uint16_t count = ground_count;
+  uint16_t written = 0;
+  igc_t igc;
+  char line[sizeof(igc.raw) + 2];
+  for (uint16_t i = 0; i < count; i++)
+  {
+    bool ok;
+    if (journal_mode)
     {
-      BRecordCount++;
+      ok = writeJournalFix(ground_fixes[index]);
     }
-    return result;
+    else
+    {
+      IGC::formatBRecord(ground_fixes[index], igc);
+      snprintf(line, sizeof(line), "%s%s", igc.raw, IGC_EOL);
+      ok = IGCWriteRecord(line);
+    }
+    if (ok)
+    {
+      written++;
+    }
+    else
+    {
+      record_stats.dropped++;
+    }
+    index = (index + 1 == ground_size) ? 0 : index + 1;
+  }
+  ground_count = 0;
+  BRecordCount += written;
+  record_stats.pre_takeoff += written;
+  if (igc_writer_ptr)
+  {
+    igc_writer_ptr->sync();
+  }
+  HAL::console().print(F("Recovered "));
+  HAL::console().print(written);
+  HAL::console().println(F(" pre-takeoff fixes"));
+}
+
+// write queued records to the SD card, max_bytes per batch
+static void flushRecords(uint16_t max_bytes)
+{
+  char line[128];
+  const unsigned long start = HAL::millis();
+  uint16_t written = 0;
+  while (!record_ring.empty())
+  {
+    uint8_t len = record_ring.peek_length();
+    if (written > 0 && written + len > max_bytes)
+    {
+      break;
+    }
+    unsigned long queued = record_ring.oldest(start);
+    len = record_ring.pop(line, sizeof(line) - 1);
+    if (len == 0)
+    {
+      break;
+    }
+    line[len] = '\0';
+    written += len;
+    if (start - queued > 2 * flush_budget)
+    {
+      record_stats.late++;
+    }
+    if (IGCWriteRecord(line))
+    {
+      record_stats.written++;
+    }
+    else
+    {
+      record_stats.dropped++;
+    }
+  }
+  unsigned long duration = HAL::millis() - start;
+  if (duration > record_stats.max_flush_ms)
+  {
+    record_stats.max_flush_ms = duration;
+  }
+}
+
+static int queueRecord(const char *data)
+{
+  if (!bIGCFileWrite)
+  {
+    return 0;
+  }
+  char line[128];
+  int len = snprintf(line, sizeof(line), "%s%s", data, IGC_EOL);
+  unsigned long now = HAL::millis();
+  if (!record_ring.push(line, len, now))
+  {
+    // ring full, SD card must be behind, write synchronously
+    flushRecords(igc_record_ring::ring_size);
+    if (!record_ring.push(line, len, now))
+    {
+      record_stats.dropped++;
+      return 0;
+    }
+  }
+  record_stats.queued++;
+  if (record_ring.used() > record_stats.max_used)
+  {
+    record_stats.max_used = record_ring.used();
+  }
+  return 1;
+}
+
+void serviceIGC()
+{
+  unsigned long now = HAL::millis();
+  if (record_ring.used() >= flush_batch_size)
+  {
+    flushRecords(flush_batch_size);
+  }
+  else if (!record_ring.empty() && now - record_ring.oldest(now) >= flush_budget)
+  {
+    flushRecords(igc_record_ring::ring_size);
+  }
+}
+
+void setFlushInterval(int seconds)
+{
+  flush_budget = (unsigned long) constrain(seconds, 0, MAX_FLUSH_INTERVAL) * 1000;
+}
+
+const record_stats_t &getRecordStats()
+{
+  return record_stats;
+}
+
+void printRecordStats()
+{
+  HAL::console().print(F("B records: queued="));
+  HAL::console().print(record_stats.queued);
+  HAL::console().print(F(", written="));
+  HAL::console().print(record_stats.written);
+  HAL::console().print(F(", dropped="));
+  HAL::console().print(record_stats.dropped);
+  HAL::console().print(F(", late="));
+  HAL::console().print(record_stats.late);
+  HAL::console().print(F(", max queued="));
+  HAL::console().print(record_stats.max_used);
+  HAL::console().print(F(" bytes, max flush="));
+  HAL::console().print(record_stats.max_flush_ms);
+  HAL::console().print(F(" ms, pre-takeoff="));
+  HAL::console().println(record_stats.pre_takeoff);
 }
 
 void closeIGC()
 {
+  flushRecords(igc_record_ring::ring_size);
+  printRecordStats();
   igcFile.close();
+  if (igc_writer_ptr)
+  {
+    igc_writer_ptr->close();
+    igc_writer_ptr->print_stats();
+    CommitFileIndex();
+  }
 }
 
-// date as YYYY, MM, DD, obtained from GPS so UTC time
-bool createIGCFileName(uint16_t y,uint16_t m, uint16_t d)
+void discardIGC()
+{
+  // dropped with the file, not counted as queued
+  record_stats.queued -= record_ring.count();
+  record_ring.clear();
+  igcFile.close();
+  if (igc_writer_ptr)
+  {
+    igc_writer_ptr->discard();
+  }
+  HAL::console().print(F("IGC file discarded:"));
+  HAL::console().println(igc_full_path);
+  bIGCFileWrite = false;
+  bIGCHeaderWritten = false;
+  BRecordCount = 0;
+}
+
+// look for IGC files in the day folder without a (valid) trailing G-record
+static void recoverIGCFiles(const char *folder_name)
+{
+  HAL::File folder = HAL::fsOpen(folder_name);
+  if (!folder)
+  {
+    return;
+  }
+  char path[20]; // YYYYMMDD/lg000.igc
+  HAL::File entry;
+  while ((entry = folder.openNextFile()))
+  {
+    const char *name = entry.name();
+    const char *ext = strrchr(name, '.');
+    bool is_igc = !entry.isDirectory() && ext && strcasecmp(ext, ".igc") == 0;
+    if (is_igc)
+    {
+      snprintf(path, sizeof(path), "%s/%s", folder_name, name);
+    }
+    entry.close();
+    if (is_igc)
+    {
+      igc_file_writer::recover(path);
+    }
+  }
+  folder.close();
+}
+
+// day folder of the last prepareDay(), recovered in this power cycle
+static char day_folder[9] = ""; // YYYYMMDD
+
+bool prepareDay(uint16_t y, uint16_t m, uint16_t d)
 {
     char folder_name[9]; // YYYYMMDD
-    memset(&folder_name,0,sizeof(folder_name));
-    snprintf(folder_name,sizeof(folder_name),"%04d%02d%02d",y,m,d);
+    // bounded so the compiler sees the name fits
+    snprintf_P(folder_name,sizeof(folder_name),PSTR("%04u%02u%02u"),
+               (unsigned) (y % 10000),(unsigned) (m % 100),(unsigned) (d % 100));
+    if (strcmp(folder_name, day_folder) == 0)
+    {
+       return true;
+    }
     // create the folder
-    if (!SD.mkdir(folder_name))
+    if (!HAL::fsMkdir(folder_name))
+    {
+       HAL::console().println(F("Error creating folder on SD!"));
+       return false;
+    }
+    // sign any IGC file left behind by a power loss, files of earlier
+    // flights of this power cycle were closed properly
+    recoverIGCFiles(folder_name);
+    strcpy(day_folder, folder_name);
+    return true;
+}
+
+// date as YYYY, MM, DD, obtained from GPS so UTC time
+bool createIGCFileName(uint16_t y,uint16_t m, uint16_t d, const config_t &config)
+{
+    // done on the ground already, unless the date changed since
+    if (!prepareDay(y, m, d))
+    {
+       return false;
+    }
+    igc_file_index = ReserveFileIndex(day_folder);
+    if (igc_file_index < 0)
     {
-       Serial.println(F("Error creating folder on SD!"));
        return false;
     }
     // create full path name
-    strcpy(igc_full_path,folder_name);
-    strcat(igc_full_path,"/");
-    strcat(igc_full_path,igcfilename);
-    Serial.print(F("IGC path:"));
-    Serial.println(igc_full_path);
+    journal_mode = config.journal;
+    snprintf_P(igc_full_path,sizeof(igc_full_path),PSTR("%s/lg%03u.%s"),day_folder,
+               (unsigned) (igc_file_index % 1000),journal_mode ? "bin" : "igc");
+    HAL::console().print(F("IGC path:"));
+    HAL::console().println(igc_full_path);
     if (IGC::igc_writer_ptr == NULL)
     {
-      IGC::igc_writer_ptr = new igc_file_writer(igc_full_path, true);
+      IGC::igc_writer_ptr = new igc_file_writer(igc_full_path, !journal_mode,
+                                                config.keep_file_open,
+                                                config.sync_records,
+                                                config.sync_interval,
+                                                config.grecord_deferred,
+                                                config.grecord_checkpoint);
     }
+    else
+    {
+      // next flight of this power cycle
+      IGC::igc_writer_ptr->reset(igc_full_path);
+    }
+    bIGCHeaderWritten = false;
+    BRecordCount = 0;
     return true;
 }
 
-int writeRecord(const char *data, bool sign)
+int writeRecord(const char *data)
 {
-  int len = strlen(data);
   int result = 0;
-  if (bIGCFileWrite)
+  if (bIGCFileWrite && journal_mode)
+  {
+    uint8_t entry[2 + 255];
+    uint16_t size = IGC::journalText(data, entry);
+    if (igc_writer_ptr && igc_writer_ptr->append_raw(entry, size))
+    {
+      result = 1;
+    }
+  }
+  else if (bIGCFileWrite)
   {
     char line[128];
-    memset(&line,0,sizeof(line));
-    strncpy(line,data, len);
-    strcat(line, IGC_EOL);
+    snprintf(line, sizeof(line), "%s%s", data, IGC_EOL);
     if (IGC::IGCWriteRecord(line))
     {
       result = 1;
@@ -311,54 +733,9 @@ int writeARecord()
   // see below under H Record in the line: 
   // HFFTYFRTYPE:MANUFACTURERSNAME,FRMODELNUMBER CRLF
 
-  return writeRecord("AXLK001", true);
-}
-
-int writeHRecord(const char* format, ...)
-{
-  char line[80];
-  va_list arg;
-  va_start(arg, format);
-  vsnprintf(line,sizeof(line),format,arg);
-  va_end(arg);
-  return writeRecord(line, true);
-}
-
-// NOTE: FILE IS EXPECTED TO BE STILL OPEN FOR WRITING!
-void writeGRecord(const MD5::MD5_CTX &ctx)
-{
-  MD5::MD5_CTX md5_context_tmp;
-  char line[80];
-  char part1[17];
-  char part2[17];
-  memset(&line,0,sizeof(line));
-
-  // make a copy, so we can continue with
-  // next record in case flight not done
-  memcpy(&md5_context_tmp,&ctx, sizeof(MD5::MD5_CTX));
-  unsigned char * hash = (unsigned char *) malloc(16);
-  MD5::MD5::MD5Final(hash, &md5_context_tmp);
-  char *md5str = MD5::MD5::make_digest(hash,16);
-  Serial.print("MD5 hash > ");
-  Serial.println(md5str);
-  // split in two 16 char. strings
-  memset(&part1,0,sizeof(part1));
-  memset(&part2,0,sizeof(part2));
-  memcpy(part1,md5str,16);
-  memcpy(part2,(md5str+16),16);
-
-  snprintf(line,sizeof(line),"G%s",part1);
-  igcFile.print(line);
-  igcFile.print(IGC_EOL);
-  if (igcFile.getWriteError()) 
-  {
-    Serial.println(F("Error writing G-record!"));
-  }
-  snprintf(line,sizeof(line),"G%s",part2);
-  igcFile.print(line);
-  igcFile.print(IGC_EOL);
-  free(md5str);
-  free(hash);
+  char line[8];
+  strcpy_P(line, PSTR("AXLK001"));
+  return writeRecord(line);
 }
 
 void enableIGCWrite(bool enable)
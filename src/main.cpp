@@ -4,7 +4,7 @@
 //
 // Hardware Requirements:
 // - Board AtMega2560 or compatible
-// - Any NMEA GPS on Serial1
+// - Any NMEA GPS on Serial1 (USART1, own interrupt driven receiver)
 // - BMP280 sensor on I2C bus
 // - micro SD interface
 // - Lithium Ion Batterij - 3.7v 3000mAh
@@ -24,10 +24,6 @@
 //   version=1.0.0
 //   https://github.com/mikalhart/TinyGPSPlus
 //
-// - IniFile
-//   version=1.3.0
-//   https://github.com/stevemarple/IniFile
-//
 // - DateTime - Arduino library for date and time functions
 //   version=??
 //   Copyright (c) Michael Margolis.  All right reserved.
@@ -39,17 +35,18 @@
 //
 
 #include <stdlib.h>
-#include <avr/sleep.h>
-#include <avr/power.h>
-#include <SPI.h>
-#include <Wire.h>
-#include <Adafruit_BMP280.h>
-#include <SD.h>
 #include <TinyGPS++.h>
 #include <DateTime.h>
 #include "utils.h"
 #include "config.h"
 #include "logger.h"
+#include "sd_prealloc.h"
+#include "gps_rx.h"
+#include "hal.h"
+#include "perf.h"
+#include "scheduler.h"
+#include "flight.h"
+#include "altitude.h"
 
 #define VERSION_MAJOR 1
 #define VERSION_MINOR 1
@@ -71,7 +68,6 @@ SoftwareSerial mySerial(10, 11); // RX, TX
 
 // BMP280 sensor
 #define SEALEVELPRESSURE_HPA (1013.25)
-Adafruit_BMP280 bmp;
 
 // GPS object
 TinyGPSPlus gps;
@@ -80,22 +76,20 @@ TinyGPSPlus gps;
 static int sats = 0;
 
 // use USB serial as DEBUG output
-#define DEBUG Serial
+#define DEBUG HAL::console()
 
 #ifdef PLOT
-static File plotFile;
+static HAL::File plotFile;
 //                    12345678
 static char const *plotfilename = "plot.csv";
 #endif
 
 char buffer[80];
-uint8_t loop_count = 0;
 bool tone_done = false;
 static int start_beep;
 static int duration, old_duration;
 static int timer;
 static bool inits = true;
-static bool in_flight = false;
 
 // configuration
 config_t config;
@@ -104,13 +98,24 @@ static float batt = 0.0;
 static bool bIGCFileWrite = false;
 #ifdef PLOT
 static bool bPlotFileWrite = false;
-#endif
-static unsigned long last_igc_write = 0;
 static unsigned long last_plot_write = 0;
-static unsigned long last_led_blink = 0;
+#endif
+
+#ifndef SOFTWARE_SERIAL
+void readGPS();
+void printGPSStats();
+#endif
 
 #define LED_PIN 31 // D31
 
+// stage timings are written here on shutdown (PERF_STATS builds)
+#define PERF_FILE "perf.csv"
+
+// a position older than this (ms) is no fix
+#define GPS_FIX_TIMEOUT     2000
+// m from the takeoff altitude where a stop counts as a landing
+#define LANDING_HEIGHT      50
+
 // show on LED if we have a lock or not (rate in ms)
 #define NO_LOCK_BLINK_RATE  250
 #define LOCK_BLINK_RATE     1000
@@ -126,25 +131,63 @@ void dateTime(uint16_t* date, uint16_t* time) {
  *time = FAT_TIME(gps.time.hour(), gps.time.minute(), gps.time.second());
 }
 
+// boot time breakdown in ms, printed once the first GPS byte is in
+static struct {
+  unsigned long sd;       // SD.begin
+  unsigned long config;   // readConfig
+  unsigned long baro;     // BMP280 begin
+  unsigned long ready;    // end of setup, since power on
+} boot_ms;
+
+#ifdef PERF_STATS
+// cost of the pressure to altitude conversion on this CPU: the table of
+// altitude.cpp against the powf() formula of bmp.readAltitude() it replaced
+static void printAltitudeCost()
+{
+    const uint8_t count = 100;
+    volatile float sink = 0.0f;
+    uint32_t start = HAL::micros();
+    for (uint8_t i = 0; i < count; i++)
+    {
+        const float pressure = 30000.0f + i * 700.0f;
+        sink = sink + 44330.0f * (1.0f - powf(pressure / 100.0f / SEALEVELPRESSURE_HPA, 0.1903f));
+    }
+    const uint32_t pow_us = (uint32_t) HAL::micros() - start;
+    start = HAL::micros();
+    for (uint8_t i = 0; i < count; i++)
+    {
+        sink = sink + ALTITUDE::altitude((30000UL + i * 700UL) * 256, SEALEVELPRESSURE_HPA);
+    }
+    const uint32_t table_us = (uint32_t) HAL::micros() - start;
+#ifdef F_CPU
+    // cycles per conversion
+    DEBUG.print(F("Altitude: powf() "));
+    DEBUG.print(pow_us * (F_CPU / 1000000UL) / count);
+    DEBUG.print(F(" cycles, table "));
+    DEBUG.print(table_us * (F_CPU / 1000000UL) / count);
+    DEBUG.println(F(" cycles"));
+#else
+    DEBUG.print(F("Altitude: powf() "));
+    DEBUG.print(pow_us);
+    DEBUG.print(F(" us, table "));
+    DEBUG.print(table_us);
+    DEBUG.println(F(" us per 100"));
+#endif
+}
+#endif
+
 void setup() 
 {
     pinMode(A1, OUTPUT);            // Voltage
     pinMode(LED_PIN,OUTPUT);        // LED
     digitalWrite(LED_PIN, LOW);     // turn the LED off
-    DEBUG.begin(115200);            // USB serial for debugging
-    // wait until Serial (USB) port is available
-    while(!DEBUG) {} // Wait
+    HAL::consoleBegin(115200);      // USB serial for debugging
 
     // Initialize battery voltage measure
-    // Reads the value from the specified analog pin. Arduino boards contain a multichannel, 
-    // 10-bit analog to digital converter. This means that it will map input voltages
-    // between 0 and the operating voltage(5V or 3.3V) into integer values between 0 and 1023.
-    power_adc_enable();
-    batt += (float)analogRead(A1) * (5.0/1023.0);
+    batt += HAL::readBatteryVoltage();
     DEBUG.print(F("Voltage: "));
     DEBUG.print(batt);
     DEBUG.println("V");
-    power_adc_disable();
     if (batt < 3.0)
     {
       DEBUG.print(F("BATT TOO LOW!!"));
@@ -152,7 +195,6 @@ void setup()
     }
 
     DateTime.sync(0);   // start the clock
-    Wire.begin();       // I2C for BMP280
 
     DEBUG.println();
     sprintf(buffer,"Simple IGC Logger V%d.%d", VERSION_MAJOR, VERSION_MINOR);
@@ -166,99 +208,119 @@ void setup()
 //   DEBUG.print(F("Using SD Card CS pin:"));
 //   DEBUG.println(SD_CS_PIN);
     DEBUG.print(F("Initializing SD card..."));
-    if (!SD.begin(SD_CS_PIN)) {
+    unsigned long boot_start = HAL::millis();
+    if (!HAL::fsBegin(SD_CS_PIN)) {
       DEBUG.println(F("initialization failed!"));
       fatal_error_blink(250);
     }
     DEBUG.println(F("initialization done!"));
+    sdPreallocBegin(SD_CS_PIN);
+    boot_ms.sd = HAL::millis() - boot_start;
 
     // now we have SD card, read config.ini
     DEBUG.println(F("Reading config.ini..."));
+    boot_start = HAL::millis();
     if (!readConfig("config.ini", config))
     {
       DEBUG.println(F("Error reading configuration, will run with defaults!"));
     }
+    boot_ms.config = HAL::millis() - boot_start;
     printConfig(config);
-    in_flight = !config.liftoff_detection;
 
 #ifdef SOFTWARE_SERIAL
     myDEBUG.begin(config.baudrate); // GPS
 #else
-    Serial1.begin(config.baudrate);  // GPS
+    HAL::gpsBegin(config.baudrate);  // GPS on USART1, interrupt driven
 #endif
     // init IGC logger
     IGC::initIGC();
+    IGC::setFlushInterval(config.flush_interval);
+    if (config.liftoff_detection)
+    {
+      IGC::initGroundFixes(config.adaptive_logging ? config.log_interval_min : config.log_interval);
+    }
     IGC::prepareIGCFileName();
 
     // BMP280 at I2C address 0x77
-    while(!bmp.begin())
+    boot_start = HAL::millis();
+    while(!HAL::baroBegin())
     {
         DEBUG.println(F("Could not find BMP280 pressure sensor!"));
         delay(1000);
     }
+    boot_ms.baro = HAL::millis() - boot_start;
     DEBUG.println(F("BMP280 pressure sensor found"));
-    /* Default settings from datasheet. */
-    bmp.setSampling(Adafruit_BMP280::MODE_NORMAL,     /* Operating Mode. */
-                    Adafruit_BMP280::SAMPLING_X2,     /* Temp. oversampling */
-                    Adafruit_BMP280::SAMPLING_X16,    /* Pressure oversampling */
-                    Adafruit_BMP280::FILTER_X16,      /* Filtering. */
-                    Adafruit_BMP280::STANDBY_MS_500); /* Standby time. */
 
     DEBUG.print(F("Temperature = "));
-    DEBUG.print(bmp.readTemperature());
+    DEBUG.print(HAL::baroTemperature());
     DEBUG.println(" °C");
 
     DEBUG.print(F("Pressure = "));
-    DEBUG.print(bmp.readPressure()/100);
+    DEBUG.print(HAL::baroPressure()/100);
     DEBUG.println(" hPa");
 
     DEBUG.print(F("Approx altitude = "));
-    DEBUG.print(bmp.readAltitude(SEALEVELPRESSURE_HPA)); /* MSL adjusted to standard atmosphere */
+    DEBUG.print(HAL::baroAltitude(SEALEVELPRESSURE_HPA)); /* MSL adjusted to standard atmosphere */
     DEBUG.println(" m (MSL)");
+#ifdef PERF_STATS
+    printAltitudeCost();
+#endif
 
     // set date time callback function
-    SdFile::dateTimeCallback(dateTime);
+    HAL::fsDateTimeCallback(dateTime);
+    boot_ms.ready = HAL::millis();
 }
 
-void loop() 
+static void printBootTimes(unsigned long first_byte)
+{
+    DEBUG.print(F("Boot: SD "));
+    DEBUG.print(boot_ms.sd);
+    DEBUG.print(F(" ms, config "));
+    DEBUG.print(boot_ms.config);
+    DEBUG.print(F(" ms, BMP280 "));
+    DEBUG.print(boot_ms.baro);
+    DEBUG.print(F(" ms, ready at "));
+    DEBUG.print(boot_ms.ready);
+    DEBUG.print(F(" ms, first GPS byte at "));
+    DEBUG.print(first_byte);
+    DEBUG.println(F(" ms"));
+}
+
+/*
+  loop() work is split in tasks, run by the scheduler in scheduler.cpp.
+  Every task has a period and a deadline in ms and a priority (0 = highest),
+  so B records are written on time even when the console or the SD card
+  is slow.
+*/
+
+// shared between the tasks
+static float alt(NAN);
+static float derivative;
+static FLIGHT::vario_t vario = {};
+static FLIGHT::flight_t flight = {};
+static bool new_alt = false;
+static float ground_speed = 0.0f;
+static uint8_t count_sd = 0;
+static bool gps_clock_set = false;
+static uint8_t flight_count = 0;    // flights of this power cycle
+
+// drain GPS data received since the last run, open an IGC file for
+// every flight once the GPS has date and time
+static void gpsTask(unsigned long msec)
 {
-    static bool led_state = false;
-    static unsigned long sec = 0;
-    static uint8_t minu = 0;
-    static uint8_t hour = 23;
-    static unsigned long msec = 0;
-    static unsigned long old_msec = 0;
-    static float alt(NAN), old_alt;
-    static float raw_deriv,derivative;
-    static int16_t freq;
-    static uint8_t count_lcd = 0;
-    static uint8_t count_sd = 0;
     static uint8_t count_gps = 0;
-    static float avg_batt;
-    static uint8_t avg_batt_count = 0;
-    static float ground_speed = 0.0f;
-    static int elapsed;
-    static long val = 0;
-    
-    // Update Running Time
-    msec = millis();
-    val = DateTime.now();
-    hour = numberOfHours(val);
-    minu = numberOfMinutes(val);
-    sec = numberOfSeconds(val);
-    
-    // read aprox. altitude based on MSL standard atmosphere
-    alt = bmp.readAltitude(SEALEVELPRESSURE_HPA);
 
-    // 1st time here?
-    if (inits) 
+    PERF_START(gps_start);
+#ifndef SOFTWARE_SERIAL
+    readGPS();
+#endif
+    PERF_STOP(GPS, gps_start);
+
+    static bool first_byte = true;
+    if (first_byte && gps.charsProcessed() > 0)
     {
-        old_alt = alt;
-        old_msec = msec;
-        last_igc_write = msec;
-        last_plot_write = msec;
-        last_led_blink = msec;
-        inits = false;
+      first_byte = false;
+      printBootTimes(msec);
     }
 
     // running for more than 5 seconds yet less than 10 char.
@@ -270,9 +332,10 @@ void loop()
       DEBUG.println("GPS stream dump:");
       // endless loop, blinking LED will stop to show error condition, dump GPS to serial
       while (true) {
+          HAL::idle();
 #ifndef SOFTWARE_SERIAL
-          if (Serial1.available() > 0) { // any data coming in?
-            DEBUG.write(Serial1.read());
+          if (HAL::gpsAvailable() > 0) { // any data coming in?
+            DEBUG.write(HAL::gpsRead());
 #else
           if(myDEBUG.available() > 0) {
             DEBUG.write(myDEBUG.read());
@@ -280,27 +343,146 @@ void loop()
         }
       }
     }
-    // keep track of Vario
-    elapsed = msec - old_msec;  
-    // Process Derivative every ~0.1 s
-    if (elapsed >= 100)
+
+    // get ground speed
+    if (gps.location.isValid() && gps.speed.isValid() && gps.speed.isUpdated())
     {
-        // ~ m/s
-        // delta altitude divided by elapsed time
-        raw_deriv = ((alt - old_alt) * 1000) /elapsed;
-        old_alt = alt;
-        old_msec = msec;
+      ground_speed = gps.speed.kmph();
     }
-    // 90% is old value and 10% is from raw result
-    derivative = 0.9 * derivative + 0.1 * raw_deriv;
-    // more than 1.5 m/s and valid GPS?
-    if(!in_flight && derivative > config.liftoff_threshold && gps.location.isValid())
+
+    // date and time known?
+    if (!gps_clock_set && 
+        gps.time.isValid() && gps.date.isValid() &&
+        gps.date.month()>0 && gps.date.day()>0 &&
+        gps.time.isUpdated()) 
     {
-      DEBUG.print(F("Take off! Vario="));
-      DEBUG.print(derivative);
-      DEBUG.print(F("m/s, Raw="));
-      DEBUG.println(raw_deriv);
-      in_flight = true;
+      // wait 5 runs longer
+      count_gps++;
+      if (count_gps > 5)
+      {
+        count_gps = 0;
+        gps_clock_set = true;
+        DEBUG.println(F("*******************************************"));
+        DEBUG.println(F("************* GPS clock set ***************"));
+        DEBUG.println(F("*******************************************"));
+        DEBUG.print(F("flight state = "));
+        DEBUG.println(FLIGHT::stateName(flight.state));
+        // folder and recovery of old files now, not at takeoff
+        IGC::prepareDay(gps.date.year(),gps.date.month(),gps.date.day());
+      }
+    }
+
+    // new file for every flight, closed again on landing
+    if (gps_clock_set && !bIGCFileWrite && FLIGHT::logging(flight))
+    {
+      bIGCFileWrite = IGC::createIGCFileName(gps.date.year(),gps.date.month(),gps.date.day(),config);
+      IGC::enableIGCWrite(bIGCFileWrite);
+      if (bIGCFileWrite)
+      {
+        flight_count++;
+        DEBUG.print(F("***** IGC write enabled, flight "));
+        DEBUG.print(flight_count);
+        DEBUG.println(F(" *****"));
+      }
+      else
+      {
+        DEBUG.println(F("***** ERROR enabling IGC write! *****"));
+      }
+    }
+}
+
+// read aprox. altitude based on MSL standard atmosphere, the sensor
+// only has a new sample every ~0.5 s
+static void baroTask(unsigned long msec)
+{
+    PERF_START(baro_start);
+    if (HAL::baroUpdate())
+    {
+      alt = HAL::baroAltitude(SEALEVELPRESSURE_HPA);
+      FLIGHT::varioUpdate(vario, alt, msec, config.vario_filter);
+      derivative = vario.rate;
+      new_alt = true;
+    }
+    PERF_STOP(BARO, baro_start);
+}
+
+// takeoff/landing detection, at the baro sample rate
+static void updateFlight(unsigned long msec)
+{
+    static const FLIGHT::params_t params =
+    {
+      (float) config.liftoff_threshold,
+      (float) config.takeoff_speed,
+      10,                   // s moving before takeoff is confirmed
+      (uint16_t) (config.liftoff_detection ? config.landing_time : 0),
+      LANDING_HEIGHT
+    };
+    // TinyGPS++ keeps the last position when the fix is lost
+    const FLIGHT::sample_t sample =
+    {
+      derivative,
+      vario.altitude,
+      gps.location.isValid() && gps.location.age() < GPS_FIX_TIMEOUT,
+      ground_speed,
+      (float) gps.altitude.meters()
+    };
+    if (!FLIGHT::update(flight, params, sample, msec))
+    {
+      return;
+    }
+    switch (flight.state)
+    {
+      case FLIGHT::TAKEOFF:
+        DEBUG.print(F("Take off! Vario="));
+        DEBUG.print(derivative);
+        DEBUG.print(F("m/s, Groundspeed="));
+        DEBUG.println(ground_speed);
+        break;
+      case FLIGHT::FLYING:
+        DEBUG.print(F("Flying, takeoff confirmed after "));
+        DEBUG.print(flight.takeoff_latency);
+        DEBUG.println(F(" ms"));
+        break;
+      case FLIGHT::GROUND:
+        DEBUG.println(F("On ground, waiting for takeoff"));
+        // takeoff not confirmed: no flight, the file of the false
+        // alarm is deleted and the ground fixes are collected again
+        if (bIGCFileWrite)
+        {
+          IGC::discardIGC();
+          IGC::enableIGCWrite(false);
+          bIGCFileWrite = false;
+          flight_count--;
+        }
+        break;
+      case FLIGHT::LANDED:
+        DEBUG.print(F("Landed, "));
+        DEBUG.print(flight.landing_latency);
+        DEBUG.println(F(" ms after last movement"));
+        // write the remaining records and the G record, the next
+        // takeoff opens a new file
+        if (bIGCFileWrite)
+        {
+          IGC::closeIGC();
+          IGC::enableIGCWrite(false);
+          bIGCFileWrite = false;
+        }
+#ifdef PERF_STATS
+        PERF::writeCSV(PERF_FILE);
+#endif
+        break;
+    }
+}
+
+// flight state and tone
+static void varioTask(unsigned long msec)
+{
+    static int16_t freq;
+
+    if (new_alt)
+    {
+      new_alt = false;
+      updateFlight(msec);
     }
     
     // VARIO TONE (not used)
@@ -333,19 +515,125 @@ void loop()
             tone(2, freq, duration);
 #endif
         tone_done = true;
-        start_beep = millis();
+        start_beep = msec;
         old_duration = duration;
     }
-    timer = start_beep + 2 * old_duration - millis();
+    timer = start_beep + 2 * old_duration - msec;
     if (timer < 10) 
     {
         tone_done = false;
     }
+}
+
+// write a "B" record when in flight
+// runs every log_interval s, or every log_interval_min s with adaptive
+// logging, where it only writes when the interval for the flight phase
+// has passed
+static uint32_t record_period = 1000;  // ms
+static unsigned long logging_ms = 0;    // time spent logging
+static uint32_t records_logged = 0;
+
+static void recordTask(unsigned long msec)
+{
+    static uint16_t ticks = 0;
+    static float last_course = NAN;
+    static unsigned long last_course_ms = 0;
+    static const FLIGHT::log_params_t log_params =
+    {
+      (uint16_t) config.log_interval_min,
+      (uint16_t) config.log_interval_max,
+      0.5f,       // m/s climb
+      8.0f,       // deg/s turning (circling)
+      150.0f      // m from takeoff altitude
+    };
+
+    PERF_START(log_start);
+    if (FLIGHT::logging(flight) && gps.location.isValid())
+    {
+      logging_ms += record_period;
+      uint16_t interval = config.log_interval;
+      if (config.adaptive_logging)
+      {
+        // turn rate from the GPS course over the last period
+        float turn_rate = 0.0f;
+        if (gps.course.isValid() && ground_speed > config.takeoff_speed)
+        {
+          const float course = gps.course.deg();
+          if (!isnan(last_course) && msec != last_course_ms)
+          {
+            float turn = course - last_course;
+            if (turn > 180.0f) turn -= 360.0f;
+            if (turn < -180.0f) turn += 360.0f;
+            turn_rate = turn * 1000.0f / (msec - last_course_ms);
+          }
+          last_course = course;
+          last_course_ms = msec;
+        }
+        else
+        {
+          last_course = NAN;
+        }
+        interval = FLIGHT::logInterval(flight, log_params, derivative, turn_rate,
+                                       vario.altitude - flight.takeoff_alt);
+      }
+      // count periods so scheduling jitter does not skip a record
+      ticks++;
+      if ((uint32_t) ticks * record_period >= interval * 1000UL)
+      {
+        ticks = 0;
+        count_sd += IGC::writeBRecord(gps, alt, config);
+        records_logged++;
+      }
+    }
+    else if (flight.state == FLIGHT::GROUND && gps_clock_set && gps.location.isValid())
+    {
+      // launch roll, kept in RAM until takeoff is detected
+      ticks++;
+      const uint16_t interval = config.adaptive_logging ? config.log_interval_min : config.log_interval;
+      if ((uint32_t) ticks * record_period >= interval * 1000UL)
+      {
+        ticks = 0;
+        IGC::keepGroundFix(gps, alt);
+      }
+    }
+    PERF_STOP(LOG, log_start);
+}
+
+// write queued B records when a batch is full or due
+static void sdTask(unsigned long)
+{
+    PERF_START(log_start);
+    IGC::serviceIGC();
+    PERF_STOP(LOG, log_start);
+}
+
+// show GPS lock on the LED
+static void ledTask(unsigned long msec)
+{
+    static bool led_state = false;
+    static unsigned long last_led_blink = 0;
+    unsigned long blink_freq = NO_LOCK_BLINK_RATE;
+    if (gps.location.isValid())
+    {
+      blink_freq = LOCK_BLINK_RATE;
+    }
+    if (msec - last_led_blink > blink_freq)
+    {
+      digitalWrite(LED_PIN, led_state ? LOW : HIGH);    // toggle the LED
+      led_state ^= 1;
+      last_led_blink = msec;
+    }
+}
 
-    // measure average battery voltage
-    power_adc_enable();
-    avg_batt += (float)analogRead(A1) * (5.0/1023.0);
-    power_adc_disable();
+// measure average battery voltage, shut down when low
+static void batteryTask(unsigned long)
+{
+    static float avg_batt;
+    static uint8_t avg_batt_count = 0;
+
+    PERF_START(battery_start);
+    avg_batt += HAL::readBatteryVoltage();
+    PERF_STOP(BATTERY, battery_start);
     avg_batt_count ++;
     if(avg_batt_count >= 30)
     {
@@ -364,184 +652,221 @@ void loop()
         {
           IGC::closeIGC();
         }
+#ifdef PERF_STATS
+        PERF::writeCSV(PERF_FILE);
+#endif
 #ifdef PLOT
         if (bPlotFileWrite)
         {
           plotFile.close();
         }
 #endif
-        set_sleep_mode(SLEEP_MODE_PWR_DOWN);
-        cli();
-        sleep_enable();
-        sei();
-        sleep_mode();
+        HAL::powerDown();
     }
-    
-    switch (loop_count)
-    {
-        case 1 : // Print data
-            count_lcd ++;
-            if (count_lcd == 100) // limit printing
-            {
-                // Note: this is logger running time, not GPS time!
-                sprintf(buffer,"%02d:%02d:%02d ",hour,minu,(uint8_t) sec & 0xff);
-                DEBUG.print(buffer);
-
-                // Number of GPS SATS
-                DEBUG.print(F("SATS: "));
-                if (gps.satellites.isValid())
-                {
-                  sats = gps.satellites.value();
-                  sprintf(buffer,"%02d, ",sats);
-                  DEBUG.print(buffer);
-                }
-                else
-                {
-                  DEBUG.print("**, ");
-                }
-                DEBUG.print(F("Voltage: "));
-                DEBUG.print(batt);
-                DEBUG.print("V, ");
-                DEBUG.print(F("Altitude:      "));
-                DEBUG.print(alt);
-                DEBUG.print(F(" m, "));
-
-                DEBUG.print(F("Vario:         "));
-                DEBUG.print(derivative);
-                DEBUG.print(F(" m/s"));
-                if (gps.location.isValid())
-                {
-                  DEBUG.print(F(", GPS Altitude:      "));
-                  DEBUG.print(gps.altitude.meters());
-                  DEBUG.print(F("m, Groundspeed: "));
-                  DEBUG.print(ground_speed);
-                  DEBUG.print(F(" km/h"));
-                }
-                DEBUG.println();
-                if (msec < 5000)
-                {
-                  // at startup dump the GPS stream to Serial for 5 sec.
-                  DEBUG.println(F("GPS stream dump:"));
-                  while (millis()<5000) {
+}
+
+static void printTaskStats();
+
+// print status to the debug port
+static void consoleTask(unsigned long msec)
+{
+    PERF_START(print_start);
+    // Update Running Time
+    const long val = DateTime.now();
+    const uint8_t hour = numberOfHours(val);
+    const uint8_t minu = numberOfMinutes(val);
+    const unsigned long sec = numberOfSeconds(val);
+
+    // Note: this is logger running time, not GPS time!
+    sprintf(buffer,"%02d:%02d:%02d ",hour,minu,(uint8_t) sec & 0xff);
+    DEBUG.print(buffer);
+
+    // Number of GPS SATS
+    DEBUG.print(F("SATS: "));
+    if (gps.satellites.isValid())
+    {
+      sats = gps.satellites.value();
+      sprintf(buffer,"%02d, ",sats);
+      DEBUG.print(buffer);
+    }
+    else
+    {
+      DEBUG.print("**, ");
+    }
+    DEBUG.print(F("Voltage: "));
+    DEBUG.print(batt);
+    DEBUG.print("V, ");
+    DEBUG.print(F("Altitude:      "));
+    DEBUG.print(alt);
+    DEBUG.print(F(" m, "));
+
+    DEBUG.print(F("Vario:         "));
+    DEBUG.print(derivative);
+    DEBUG.print(F(" m/s"));
+    if (gps.location.isValid())
+    {
+      DEBUG.print(F(", GPS Altitude:      "));
+      DEBUG.print(gps.altitude.meters());
+      DEBUG.print(F("m, Groundspeed: "));
+      DEBUG.print(ground_speed);
+      DEBUG.print(F(" km/h"));
+    }
+    DEBUG.println();
+    // heap must stay flat during the flight
+    printHeapReport();
+    IGC::printRecordStats();
+#ifndef SOFTWARE_SERIAL
+    printGPSStats();
+#endif
+    if (msec < 5000)
+    {
+      // at startup dump the GPS stream to Serial for 5 sec.
+      DEBUG.println(F("GPS stream dump:"));
+      while (HAL::millis()<5000) {
+        HAL::idle();
 #ifndef SOFTWARE_SERIAL
-                    if (Serial1.available() > 0) { // any data coming in?
-                      DEBUG.write(Serial1.read());
+        if (HAL::gpsAvailable() > 0) { // any data coming in?
+          const char c = HAL::gpsRead();
+          gps.encode(c);  // parsed as well, the data check in gpsTask counts it
+          DEBUG.write(c);
 #else
-                    if(myDEBUG.available() > 0) {
-                      DEBUG.write(myDEBUG.read());
+        if(myDEBUG.available() > 0) {
+          DEBUG.write(myDEBUG.read());
 #endif
-                    }
-                  }
-                  DEBUG.println();
-                }
+        }
+      }
+      DEBUG.println();
+    }
 #ifdef PLOT
-                if (bPlotFileWrite && msec - last_plot_write >= 1000)
-                {
-                  DEBUG.println(F("Writing PLOT data..."));
-                  last_plot_write = msec;
-                  plotFile.print(msec);
-                  plotFile.print(",");
-                  plotFile.print(alt);
-                  plotFile.print(",");
-                  plotFile.print(derivative);
-                  plotFile.print(",");
-                  plotFile.print(raw_deriv);
-                  plotFile.print("\n");
-                  plotFile.getWriteError();
-                }
+    if (bPlotFileWrite && msec - last_plot_write >= 1000)
+    {
+      DEBUG.println(F("Writing PLOT data..."));
+      last_plot_write = msec;
+      plotFile.print(msec);
+      plotFile.print(",");
+      plotFile.print(alt);
+      plotFile.print(",");
+      plotFile.print(derivative);
+      plotFile.print(",");
+      plotFile.print(vario.altitude);
+      plotFile.print("\n");
+      plotFile.getWriteError();
+    }
 #endif
-               count_lcd = 0;
-            }
-            break;
-        case 2: // Read GPS & Write data to SD Card
-            if (gps.location.isValid())
-            {
-              // get ground speed
-              if (gps.speed.isValid() && gps.speed.isUpdated())
-              {
-                ground_speed = gps.speed.kmph();
-              }
-
-              // in flight?
-              if (in_flight)
-              {
-                // write a "B" record to file?
-                if ((msec - last_igc_write) >= (unsigned long) (config.log_interval * 1000))
-                {
-                  last_igc_write = msec;
-                  count_sd += IGC::writeBRecord(gps, alt, config);
-                }
-              }
-            }
-            break;
-        case 3:
-            {
-              unsigned long blink_freq = NO_LOCK_BLINK_RATE;
-              if (gps.location.isValid())
-              {
-                blink_freq = LOCK_BLINK_RATE;
-              }
-              if (msec - last_led_blink > blink_freq)
-              {
-                digitalWrite(LED_PIN, led_state ? LOW : HIGH);    // toggle the LED
-                led_state ^= 1;
-                last_led_blink = msec;
-              }
-            }
-            break;
-       default:
-            // reset state machine
-            loop_count = 0;
-            break;
+    if (config.adaptive_logging && config.log_interval > 0)
+    {
+      // I/O saved by adaptive logging
+      DEBUG.print(F("B records: "));
+      DEBUG.print(records_logged);
+      DEBUG.print(F(" written, "));
+      DEBUG.print(logging_ms / (config.log_interval * 1000UL));
+      DEBUG.println(F(" at fixed log_interval"));
     }
+    printTaskStats();
+    PERF_STOP(PRINT, print_start);
+}
 
-    // date and time known?
-    if (!bIGCFileWrite && 
-        gps.time.isValid() && gps.date.isValid() &&
-        gps.date.month()>0 && gps.date.day()>0 &&
-        gps.time.isUpdated()) 
+// task table, ordered by priority
+enum
+{
+    TASK_RECORD,
+    TASK_GPS,
+    TASK_BARO,
+    TASK_VARIO,
+    TASK_SD,
+    TASK_BATTERY,
+    TASK_LED,
+    TASK_CONSOLE,
+    TASK_COUNT
+};
+
+static const char task_record[] PROGMEM = "record";
+static const char task_gps[] PROGMEM = "gps";
+static const char task_baro[] PROGMEM = "baro";
+static const char task_vario[] PROGMEM = "vario";
+static const char task_sd[] PROGMEM = "sd";
+static const char task_battery[] PROGMEM = "battery";
+static const char task_led[] PROGMEM = "led";
+static const char task_console[] PROGMEM = "console";
+
+static SCHED::task_t tasks[TASK_COUNT] =
+{
+    // name, function, period (ms), deadline (ms), priority, release, stats
+    { task_record,  recordTask,  1000, 100, 0, 0, {} }, // period from config
+    { task_gps,     gpsTask,       20,  50, 1, 0, {} },
+    { task_baro,    baroTask,     100,  50, 2, 0, {} },
+    { task_vario,   varioTask,    100,  50, 3, 0, {} },
+    { task_sd,      sdTask,       250, 500, 4, 0, {} },
+    { task_battery, batteryTask,  100, 500, 5, 0, {} },
+    { task_led,     ledTask,       50, 100, 6, 0, {} },
+    { task_console, consoleTask, 5000, 1000, 7, 0, {} },
+};
+
+static void printTaskStats()
+{
+    SCHED::printStats(tasks, TASK_COUNT);
+}
+
+void loop() 
+{
+    PERF_START(loop_start);
+#ifdef REPLAY
+    static bool replay_done = false;
+    if (replay_done)
     {
-      // wait 5 loops longer
-      count_gps++;
-      if (count_gps > 5)
-      {
-        count_gps = 0;
-        if (!bIGCFileWrite)
-        {
-            DEBUG.println(F("*******************************************"));
-            DEBUG.println(F("***** GPS clock set, enable IGC write *****"));
-            DEBUG.println(F("*******************************************"));
-            bIGCFileWrite = IGC::createIGCFileName(gps.date.year(),gps.date.month(),gps.date.day());
-            IGC::enableIGCWrite(bIGCFileWrite);
-            if (!bIGCFileWrite)
-            {
-              DEBUG.println(F("***** ERROR enabling IGC write! *****"));
-            }
-            DEBUG.print(F("in_flight = "));
-            DEBUG.println(in_flight);
-        }
-      }
+      return;
+    }
+    if (HAL::replayFinished())
+    {
+      // end of trace, sign the IGC file and report the stage timings
+      IGC::closeIGC();
+      PERF::print();
+      PERF::writeCSV(PERF_FILE);
+      DEBUG.println(F("Replay done."));
+      DEBUG.flush();
+      replay_done = true;
+      HAL::powerDown();
+      return;
+    }
+#endif
+    // 1st time here?
+    if (inits) 
+    {
+        record_period = (uint32_t) (config.adaptive_logging ?
+            config.log_interval_min : config.log_interval) * 1000;
+        tasks[TASK_RECORD].period = record_period;
+        FLIGHT::begin(flight, config.liftoff_detection, HAL::millis());
+        SCHED::start(tasks, TASK_COUNT, HAL::millis());
+        inits = false;
     }
-    loop_count++;
+    SCHED::runNext(tasks, TASK_COUNT, HAL::millis());
+#ifdef PERF_STATS
+    // 'p' on the debug port dumps the stage table
+    if (DEBUG.available() > 0 && DEBUG.read() == 'p')
+    {
+      PERF::print();
+    }
+#endif
+    PERF_STOP(LOOP, loop_start);
 }
 
 /*
-  SerialEvent occurs whenever a new data comes in the hardware serial RX. This
-  routine is run between each time loop() runs, so using delay inside loop can
-  delay response. Multiple bytes of data may be available.
+  The GPS RX interrupt stores incoming data in a ring buffer (see gps_rx.cpp),
+  so nothing is lost while loop() is busy. readGPS() is called from loop()
+  to feed the buffered data to TinyGPS++.
 */
 
 #ifndef SOFTWARE_SERIAL
-void serialEvent1(){
+void readGPS(){
     static char gps_data[128];
     static int i = 0;
-    char c;
-    while (Serial1.available() > 0) 
+    int c;
+    while ((c = HAL::gpsRead()) >= 0) 
     {
-        // read the next char.
-        c=Serial1.read();
-        // and let TinyGPS++ encode it
+        // let TinyGPS++ encode the next char.
+        PERF_START(parse_start);
         gps.encode(c);
+        PERF_STOP(PARSE, parse_start);
         // no lock yet?
         if (!gps.location.isValid()) {
           // store data in buffer
@@ -556,4 +881,20 @@ void serialEvent1(){
         }
     }
 }
+
+void printGPSStats()
+{
+    GPS_RX::gps_rx_stats_t stats;
+    GPS_RX::getStats(stats);
+    DEBUG.print(F("GPS: overruns="));
+    DEBUG.print(stats.overruns);
+    DEBUG.print(F(", framing errors="));
+    DEBUG.print(stats.framing);
+    DEBUG.print(F(", dropped="));
+    DEBUG.print(stats.dropped);
+    DEBUG.print(F(", max buffered="));
+    DEBUG.print(stats.max_used);
+    DEBUG.print(F(", checksum failures="));
+    DEBUG.println(gps.failedChecksum());
+}
 #endif
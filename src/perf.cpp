@@ -0,0 +1,125 @@
+#include <Arduino.h>
+#include "perf.h"
+
+namespace PERF
+{
+
+#ifdef PERF_STATS
+
+typedef struct
+{
+    uint32_t count;
+    uint64_t total_us;
+    uint32_t min_us;
+    uint32_t max_us;
+    uint16_t buckets[BUCKETS];
+} stage_stats_t;
+
+static stage_stats_t stats[STAGE_COUNT];
+
+static const char stage_parse[] PROGMEM = "parse";
+static const char stage_format[] PROGMEM = "format";
+static const char stage_hash[] PROGMEM = "hash";
+static const char stage_write[] PROGMEM = "write";
+static const char stage_gps[] PROGMEM = "gps";
+static const char stage_baro[] PROGMEM = "baro";
+static const char stage_battery[] PROGMEM = "battery";
+static const char stage_print[] PROGMEM = "print";
+static const char stage_log[] PROGMEM = "log";
+static const char stage_loop[] PROGMEM = "loop";
+static const char *const stage_names[STAGE_COUNT] PROGMEM =
+{
+    stage_parse, stage_format, stage_hash, stage_write,
+    stage_gps, stage_baro, stage_battery, stage_print, stage_log, stage_loop
+};
+
+void add(stage_t stage, uint32_t us)
+{
+    stage_stats_t &s = stats[stage];
+    uint8_t bucket = 0;
+    while (bucket < BUCKETS - 1 && (us >> bucket) != 0)
+    {
+        bucket++;
+    }
+    if (s.count == 0 || us < s.min_us)
+    {
+        s.min_us = us;
+    }
+    if (us > s.max_us)
+    {
+        s.max_us = us;
+    }
+    s.count++;
+    s.total_us += us;
+    if (s.buckets[bucket] < UINT16_MAX)
+    {
+        s.buckets[bucket]++;
+    }
+}
+
+void reset()
+{
+    memset(stats, 0, sizeof(stats));
+}
+
+// one csv line per stage: name,count,min,max,mean,buckets...
+static void printTable(Print &out)
+{
+    out.print(F("stage,count,min_us,max_us,mean_us"));
+    for (uint8_t b = 0; b < BUCKETS - 1; b++)
+    {
+        out.print(F(",lt"));
+        out.print(1UL << b);
+    }
+    out.println(F(",more"));
+    for (uint8_t i = 0; i < STAGE_COUNT; i++)
+    {
+        const stage_stats_t &s = stats[i];
+        out.print((const __FlashStringHelper *) pgm_read_ptr(&stage_names[i]));
+        out.print(',');
+        out.print(s.count);
+        out.print(',');
+        out.print(s.min_us);
+        out.print(',');
+        out.print(s.max_us);
+        out.print(',');
+        out.print(s.count ? (uint32_t) (s.total_us / s.count) : 0UL);
+        for (uint8_t b = 0; b < BUCKETS; b++)
+        {
+            out.print(',');
+            out.print(s.buckets[b]);
+        }
+        out.println();
+    }
+}
+
+void print()
+{
+    HAL::console().println(F("Stage latency:"));
+    printTable(HAL::console());
+}
+
+bool writeCSV(const char *path)
+{
+    HAL::File csv = HAL::fsOpen(path, O_WRITE | O_CREAT | O_TRUNC);
+    if (!csv)
+    {
+        HAL::console().print(F("Cannot create "));
+        HAL::console().println(path);
+        return false;
+    }
+    printTable(csv);
+    csv.close();
+    return true;
+}
+
+#else
+
+void add(stage_t, uint32_t) {}
+void reset() {}
+void print() {}
+bool writeCSV(const char *) { return false; }
+
+#endif
+
+} // PERF namespace
@@ -0,0 +1,82 @@
+#include <Arduino.h>
+#include "scheduler.h"
+#include "hal.h"
+
+namespace SCHED
+{
+
+void start(task_t *tasks, uint8_t count, unsigned long now)
+{
+    for (uint8_t i = 0; i < count; i++)
+    {
+        tasks[i].release = now;
+        memset(&tasks[i].stats, 0, sizeof(task_stats_t));
+    }
+}
+
+bool runNext(task_t *tasks, uint8_t count, unsigned long now)
+{
+    task_t *next = NULL;
+    for (uint8_t i = 0; i < count; i++)
+    {
+        task_t &task = tasks[i];
+        if ((long) (now - task.release) < 0)
+        {
+            continue;
+        }
+        // highest priority first, the longest waiting one on a tie
+        if (next == NULL || task.priority < next->priority ||
+            (task.priority == next->priority && (long) (task.release - next->release) < 0))
+        {
+            next = &task;
+        }
+    }
+    if (next == NULL)
+    {
+        return false;
+    }
+
+    task_stats_t &stats = next->stats;
+    const unsigned long jitter = now - next->release;
+    stats.runs++;
+    stats.jitter_total += jitter;
+    if (jitter > stats.max_jitter)
+    {
+        stats.max_jitter = (jitter > UINT16_MAX) ? UINT16_MAX : jitter;
+    }
+    if (jitter > next->deadline)
+    {
+        stats.late++;
+    }
+    // next release one period on, keep the phase but drop the releases
+    // that have passed already, a period of 0 is taken as 1 ms
+    const uint32_t period = next->period ? next->period : 1;
+    const unsigned long missed = jitter / period;
+    stats.skipped += missed;
+    next->release += (missed + 1) * period;
+
+    next->run(now);
+    return true;
+}
+
+void printStats(const task_t *tasks, uint8_t count)
+{
+    HAL::console().println(F("Tasks (runs, late, skipped, mean/max jitter ms):"));
+    for (uint8_t i = 0; i < count; i++)
+    {
+        const task_stats_t &stats = tasks[i].stats;
+        HAL::console().print((const __FlashStringHelper *) tasks[i].name);
+        HAL::console().print(F(": "));
+        HAL::console().print(stats.runs);
+        HAL::console().print(F(", "));
+        HAL::console().print(stats.late);
+        HAL::console().print(F(", "));
+        HAL::console().print(stats.skipped);
+        HAL::console().print(F(", "));
+        HAL::console().print(stats.runs ? stats.jitter_total / stats.runs : 0UL);
+        HAL::console().print('/');
+        HAL::console().println(stats.max_jitter);
+    }
+}
+
+} // SCHED namespace
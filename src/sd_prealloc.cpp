@@ -0,0 +1,137 @@
+#ifndef NATIVE
+
+#include <Arduino.h>
+#include <SD.h>
+#include "sd_prealloc.h"
+#include "hal.h"
+
+// second handle on the card, the SD library keeps its own private.
+// SdVolume's block cache is shared (static) so both stay coherent.
+static Sd2Card card;
+static SdVolume volume;
+static SdFile root;
+static bool ready = false;
+
+bool sdPreallocBegin(uint8_t cs_pin)
+{
+  ready = card.init(SPI_HALF_SPEED, cs_pin) && 
+          volume.init(&card) && 
+          root.openRoot(&volume);
+  if (!ready)
+  {
+    HAL::console().println(F("SD pre-allocation not available!"));
+  }
+  return ready;
+}
+
+// returns the directory of path (root or folder, opened), NULL on error,
+// name points to the file name in path
+static SdFile *openFolder(const char *path, SdFile &folder, const char *&name)
+{
+  char folder_name[13];
+  const char *slash = strrchr(path, '/');
+  if (!slash)
+  {
+    name = path;
+    return &root;
+  }
+  size_t len = slash - path;
+  if (len >= sizeof(folder_name))
+  {
+    return NULL;
+  }
+  memcpy(folder_name, path, len);
+  folder_name[len] = '\0';
+  name = slash + 1;
+  return folder.open(&root, folder_name, O_READ) ? &folder : NULL;
+}
+
+bool sdPreallocate(const char *path, uint32_t size)
+{
+  if (!ready)
+  {
+    return false;
+  }
+  SdFile folder;
+  SdFile file;
+  const char *name;
+  SdFile *dir = openFolder(path, folder, name);
+  if (!dir)
+  {
+    return false;
+  }
+  bool result = file.createContiguous(dir, name, size);
+  if (result)
+  {
+    file.close();
+  }
+  if (dir == &folder)
+  {
+    folder.close();
+  }
+  return result;
+}
+
+bool sdTruncate(const char *path, uint32_t size)
+{
+  if (!ready)
+  {
+    return false;
+  }
+  SdFile folder;
+  SdFile file;
+  const char *name;
+  SdFile *dir = openFolder(path, folder, name);
+  if (!dir)
+  {
+    return false;
+  }
+  bool result = file.open(dir, name, O_WRITE);
+  if (result)
+  {
+    if (file.fileSize() > size)
+    {
+      result = file.truncate(size);
+    }
+    file.close();
+  }
+  if (dir == &folder)
+  {
+    folder.close();
+  }
+  return result;
+}
+
+bool sdFileInfo(const char *path, uint32_t &size, uint32_t &stamp)
+{
+  if (!ready)
+  {
+    return false;
+  }
+  SdFile folder;
+  SdFile file;
+  const char *name;
+  SdFile *dir = openFolder(path, folder, name);
+  if (!dir)
+  {
+    return false;
+  }
+  dir_t entry;
+  bool result = file.open(dir, name, O_READ) && file.dirEntry(&entry);
+  if (result)
+  {
+    size = entry.fileSize;
+    stamp = ((uint32_t) entry.lastWriteDate << 16) | entry.lastWriteTime;
+  }
+  if (file.isOpen())
+  {
+    file.close();
+  }
+  if (dir == &folder)
+  {
+    folder.close();
+  }
+  return result;
+}
+
+#endif // NATIVE
@@ -1,6 +1,56 @@
 #include <Arduino.h>
-#include <SD.h>
 #include "utils.h"
+#include "hal.h"
+
+#ifdef NATIVE
+
+#include <malloc.h>
+
+// host build: RAM a board has left when the logger runs, so buffers sized
+// from the free memory (ground fixes) get the size they have on the board
+#define NATIVE_FREE_MEMORY 3072
+
+static size_t free_memory = NATIVE_FREE_MEMORY;
+
+void hostFreeMemory(size_t bytes)
+{
+  free_memory = bytes;
+}
+
+void fatal_error_blink(const int)
+{
+  HAL::console().println(F("Fatal error, stopped"));
+  HAL::console().flush();
+  exit(1);
+}
+
+// heap use of the whole process (glibc), so a leak in the logger shows
+// up in the host tests; the free memory is the board's
+void getHeapInfo(heap_info_t &info)
+{
+  static size_t heap_max = 0;
+  const struct mallinfo2 mi = mallinfo2();
+  info.free_memory = free_memory;
+  info.heap_used = mi.uordblks;
+  if (info.heap_used > heap_max)
+  {
+    heap_max = info.heap_used;
+  }
+  info.heap_max = heap_max;
+  info.free_list = mi.fordblks;
+  info.largest_free = free_memory;
+}
+
+#else
+
+// avr-libc malloc internals
+extern char __heap_start;
+extern char *__brkval;
+struct __freelist {
+  size_t sz;
+  struct __freelist *nx;
+};
+extern struct __freelist *__flp;
 
 void fatal_error_blink(const int d)
 {
@@ -12,3 +62,48 @@ void fatal_error_blink(const int d)
         delay(d);
       };
 }
+
+void getHeapInfo(heap_info_t &info)
+{
+  static size_t heap_max = 0;
+  char stack_top;
+  char *heap_end = __brkval ? __brkval : &__heap_start;
+
+  info.free_memory = &stack_top - heap_end;
+  info.heap_used = heap_end - &__heap_start;
+  if (info.heap_used > heap_max)
+  {
+    heap_max = info.heap_used;
+  }
+  info.heap_max = heap_max;
+  info.free_list = 0;
+  info.largest_free = info.free_memory;
+  for (struct __freelist *fp = __flp; fp; fp = fp->nx)
+  {
+    // block size + size field
+    size_t sz = fp->sz + sizeof(size_t);
+    info.free_list += sz;
+    if (sz > info.largest_free)
+    {
+      info.largest_free = sz;
+    }
+  }
+}
+
+#endif // NATIVE
+
+void printHeapReport()
+{
+  heap_info_t info;
+  getHeapInfo(info);
+  HAL::console().print(F("Heap: used="));
+  HAL::console().print(info.heap_used);
+  HAL::console().print(F(", max="));
+  HAL::console().print(info.heap_max);
+  HAL::console().print(F(", free list="));
+  HAL::console().print(info.free_list);
+  HAL::console().print(F(", free="));
+  HAL::console().print(info.free_memory);
+  HAL::console().print(F(", largest free="));
+  HAL::console().println(info.largest_free);
+}
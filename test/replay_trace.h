@@ -0,0 +1,182 @@
+#ifndef _REPLAY_TRACE_H_
+#define _REPLAY_TRACE_H_
+
+// Canned flights for the host replay tests (hal_replay.cpp): a table of
+// phases is turned into <card>/replay/gps.txt and baro.csv, the same
+// trace for every run so regressions show up in the numbers.
+
+#include <math.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <sys/stat.h>
+#include <vector>
+
+namespace TRACE
+{
+
+typedef struct
+{
+  uint16_t seconds;
+  float speed;      // km/h
+  float climb;      // m/s
+  float turn;       // deg/s
+} phase_t;
+
+// the trace, one entry per second
+typedef struct
+{
+  const phase_t *phase;
+  float alt;        // m
+} second_t;
+
+#define TRACE_PHASES(phases) phases, sizeof(phases) / sizeof(phases[0])
+
+// winch launch and landing around every flight
+#define TRACE_GROUND_START \
+  { 120,   0.0f,  0.0f,  0.0f },   /* on the ground, GPS fix */ \
+  {  20,  40.0f,  0.0f,  0.0f },   /* winch launch roll */ \
+  { 100,  90.0f,  3.0f,  0.0f }    /* climb on the winch */
+#define TRACE_GROUND_END \
+  {  80, 110.0f, -4.0f,  0.0f },   /* final glide */ \
+  {  20,  10.0f,  0.0f,  0.0f },   /* landing roll */ \
+  { 120,   0.0f,  0.0f,  0.0f }    /* on the ground */
+
+// beats along a ridge with a 180 deg turn at each end
+static const phase_t ridge[] =
+{
+  TRACE_GROUND_START,
+  { 240, 100.0f,  0.2f,  0.0f },
+  {  10,  80.0f,  0.0f, 18.0f },
+  { 240, 100.0f, -0.2f,  0.0f },
+  {  10,  80.0f,  0.0f, 18.0f },
+  { 240, 100.0f,  0.2f,  0.0f },
+  {  10,  80.0f,  0.0f, 18.0f },
+  { 240, 100.0f, -0.2f,  0.0f },
+  {  10,  80.0f,  0.0f, 18.0f },
+  { 240, 100.0f,  0.0f,  0.0f },
+  TRACE_GROUND_END,
+};
+
+// one long climb circling in a thermal
+static const phase_t thermal[] =
+{
+  TRACE_GROUND_START,
+  {  60, 100.0f, -1.0f,  0.0f },   // search
+  { 600,  80.0f,  2.0f, 12.0f },   // circling
+  { 300, 120.0f, -3.75f, 0.0f },   // glide down to the field
+  TRACE_GROUND_END,
+};
+
+// thermal, cruise, thermal, ...
+#define TRACE_LEG \
+  { 240,  80.0f,  2.5f, 12.0f },   /* circling */ \
+  { 600, 130.0f, -1.0f,  0.0f }    /* cruise */
+static const phase_t cross_country[] =
+{
+  TRACE_GROUND_START,
+  TRACE_LEG,
+  TRACE_LEG,
+  TRACE_LEG,
+  TRACE_LEG,
+  TRACE_LEG,
+  {  60, 120.0f, -1.0f,  0.0f },   // glide home
+  TRACE_GROUND_END,
+};
+
+static inline void sentence(FILE *fp, const char *body)
+{
+  uint8_t cs = 0;
+  for (const char *p = body; *p; p++)
+  {
+    cs ^= *p;
+  }
+  fprintf(fp, "$%s*%02X\r\n", body, cs);
+}
+
+static inline void coordinate(char (&out)[32], double value, bool lat)
+{
+  const double v = fabs(value);
+  const int deg = (int) v;
+  snprintf(out, sizeof(out), lat ? "%02d%07.4f,%c" : "%03d%07.4f,%c", deg, (v - deg) * 60.0,
+           lat ? (value < 0 ? 'S' : 'N') : (value < 0 ? 'W' : 'E'));
+}
+
+// RMC + GGA every second from 10:00:00 UTC on 17-08-2026, padded to 960
+// bytes (one second at 9600 Bd), baro samples every 500 ms. Returns false
+// when the files cannot be written.
+static inline bool write(const char *folder, const phase_t *phases, size_t count,
+                  std::vector<second_t> &trace)
+{
+  char path[64];
+  snprintf(path, sizeof(path), "%s/replay", folder);
+  mkdir(path, 0777);
+  snprintf(path, sizeof(path), "%s/replay/gps.txt", folder);
+  FILE *gps = fopen(path, "wb");
+  snprintf(path, sizeof(path), "%s/replay/baro.csv", folder);
+  FILE *baro = fopen(path, "wb");
+  if (!gps || !baro)
+  {
+    if (gps) fclose(gps);
+    if (baro) fclose(baro);
+    return false;
+  }
+
+  trace.clear();
+  double lat = 52.1, lng = 5.2, alt = 10.0, heading = 90.0;
+  uint32_t t = 0;
+  for (size_t p = 0; p < count; p++)
+  {
+    const phase_t &phase = phases[p];
+    for (uint16_t i = 0; i < phase.seconds; i++, t++)
+    {
+      heading = fmod(heading + phase.turn, 360.0);
+      alt = fmax(10.0, alt + phase.climb);
+      const double d = phase.speed / 3.6;
+      lat += d * cos(heading * M_PI / 180.0) / 111320.0;
+      lng += d * sin(heading * M_PI / 180.0) / (111320.0 * cos(lat * M_PI / 180.0));
+      trace.push_back({ &phase, (float) alt });
+
+      char time[16], la[32], lo[32], body[128];
+      snprintf(time, sizeof(time), "%02u%02u%02u.00", 10 + t / 3600, (t / 60) % 60, t % 60);
+      coordinate(la, lat, true);
+      coordinate(lo, lng, false);
+      const long start = ftell(gps);
+      snprintf(body, sizeof(body), "GPRMC,%s,A,%s,%s,%.1f,%.1f,170826,,,A",
+               time, la, lo, phase.speed / 1.852, heading);
+      sentence(gps, body);
+      snprintf(body, sizeof(body), "GPGGA,%s,%s,%s,1,09,0.9,%.1f,M,46.0,M,,", time, la, lo, alt + 3);
+      sentence(gps, body);
+      while (ftell(gps) - start < 960 - 70)
+      {
+        sentence(gps, "GPGSV,3,1,09,01,40,083,46,02,17,308,41,12,07,344,39,14,22,228,45");
+      }
+      while (ftell(gps) - start < 960)
+      {
+        fputc('\n', gps);
+      }
+      fprintf(baro, "%lu,%.2f\n%lu,%.2f\n", (unsigned long) t * 1000, alt,
+              (unsigned long) t * 1000 + 500, alt + phase.climb / 2);
+    }
+  }
+  fclose(gps);
+  fclose(baro);
+  return true;
+}
+
+// seconds moving, for the expected number of records
+static inline uint32_t movingSeconds(const phase_t *phases, size_t count)
+{
+  uint32_t seconds = 0;
+  for (size_t p = 0; p < count; p++)
+  {
+    if (phases[p].speed > 0)
+    {
+      seconds += phases[p].seconds;
+    }
+  }
+  return seconds;
+}
+
+} // TRACE namespace
+
+#endif
@@ -0,0 +1,142 @@
+#include <unity.h>
+#include <math.h>
+#include <stdio.h>
+#include <chrono>
+#include "altitude.h"
+
+// The interpolated ISA table against the formula it replaced
+// (Adafruit_BMP280::readAltitude()): the error over 0..9000 m, and the
+// time per conversion of both.
+
+static double exactAltitude(double pressure_pa, double sea_level_hpa)
+{
+  return 44330.0 * (1.0 - pow(pressure_pa / (sea_level_hpa * 100.0), 0.1903));
+}
+
+static double isaPressure(double altitude, double sea_level_hpa)
+{
+  return sea_level_hpa * 100.0 * pow(1.0 - altitude / 44330.0, 1.0 / 0.1903);
+}
+
+// the former code: pow() on floats
+static float powAltitude(float pressure_pa, float sea_level_hpa)
+{
+  return 44330.0f * (1.0f - powf(pressure_pa / 100.0f / sea_level_hpa, 0.1903f));
+}
+
+// max. error in m over 0..9000 m in 0.25 m steps
+static double maxError(float sea_level_hpa, double &worst_altitude)
+{
+  double max_error = 0.0;
+  for (double h = 0.0; h <= 9000.0; h += 0.25)
+  {
+    const uint32_t pressure_q8 = (uint32_t) lround(isaPressure(h, sea_level_hpa) * 256.0);
+    const double want = exactAltitude(pressure_q8 / 256.0, sea_level_hpa);
+    const double error = fabs(ALTITUDE::altitude(pressure_q8, sea_level_hpa) - want);
+    if (error > max_error)
+    {
+      max_error = error;
+      worst_altitude = h;
+    }
+  }
+  return max_error;
+}
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+}
+
+void test_table_error()
+{
+  double worst = 0.0;
+  const double error = maxError(ALTITUDE::ISA_SEA_LEVEL_HPA, worst);
+  char message[100];
+  snprintf(message, sizeof(message), "ISA 1013.25 hPa: max error %.3f m at %.0f m", error, worst);
+  TEST_MESSAGE(message);
+  TEST_ASSERT_TRUE_MESSAGE(error < 0.75, message);
+}
+
+void test_table_error_low_altitude()
+{
+  // most flights stay below 3000 m
+  double max_error = 0.0;
+  for (double h = 0.0; h <= 3000.0; h += 0.25)
+  {
+    const uint32_t pressure_q8 = (uint32_t) lround(isaPressure(h, ALTITUDE::ISA_SEA_LEVEL_HPA) * 256.0);
+    const double want = exactAltitude(pressure_q8 / 256.0, ALTITUDE::ISA_SEA_LEVEL_HPA);
+    max_error = fmax(max_error, fabs(ALTITUDE::isaAltitude(pressure_q8) / 100.0 - want));
+  }
+  char message[100];
+  snprintf(message, sizeof(message), "0..3000 m: max error %.3f m", max_error);
+  TEST_MESSAGE(message);
+  TEST_ASSERT_TRUE_MESSAGE(max_error < 0.2, message);
+}
+
+void test_table_error_sea_level_pressure()
+{
+  // another sea level pressure scales the pressure into the table
+  static const float qnh[] = { 980.0f, 1000.0f, 1030.0f, 1050.0f };
+  for (float sea_level : qnh)
+  {
+    double worst = 0.0;
+    const double error = maxError(sea_level, worst);
+    char message[100];
+    snprintf(message, sizeof(message), "%.0f hPa: max error %.3f m at %.0f m", sea_level, error, worst);
+    TEST_MESSAGE(message);
+    TEST_ASSERT_TRUE_MESSAGE(error < 0.75, message);
+  }
+}
+
+void test_monotonic()
+{
+  // a vario must not see steps backwards: lower pressure, higher altitude
+  int32_t last = ALTITUDE::isaAltitude(110000UL * 256);
+  for (uint32_t pa = 110000; pa >= 30000; pa -= 5)
+  {
+    const int32_t h = ALTITUDE::isaAltitude(pa * 256);
+    TEST_ASSERT_GREATER_OR_EQUAL(last, h);
+    last = h;
+  }
+}
+
+void test_conversion_cost()
+{
+  // host time, on the AVR the soft-float powf() costs far more than the
+  // integer interpolation
+  using namespace std::chrono;
+  const uint32_t count = 1000000;
+  volatile float sink = 0.0f;
+  const steady_clock::time_point t0 = steady_clock::now();
+  for (uint32_t i = 0; i < count; i++)
+  {
+    sink = sink + powAltitude(30000.0f + (i % 70000), 1013.25f);
+  }
+  const steady_clock::time_point t1 = steady_clock::now();
+  for (uint32_t i = 0; i < count; i++)
+  {
+    sink = sink + ALTITUDE::altitude((30000UL + (i % 70000)) * 256, 1013.25f);
+  }
+  const steady_clock::time_point t2 = steady_clock::now();
+
+  const double pow_ns = duration_cast<nanoseconds>(t1 - t0).count() / (double) count;
+  const double table_ns = duration_cast<nanoseconds>(t2 - t1).count() / (double) count;
+  char message[100];
+  snprintf(message, sizeof(message), "altitude: %.1f ns powf(), %.1f ns table (%.1fx)",
+           pow_ns, table_ns, pow_ns / table_ns);
+  TEST_MESSAGE(message);
+}
+
+int main()
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_table_error);
+  RUN_TEST(test_table_error_low_altitude);
+  RUN_TEST(test_table_error_sea_level_pressure);
+  RUN_TEST(test_monotonic);
+  RUN_TEST(test_conversion_cost);
+  return UNITY_END();
+}
@@ -0,0 +1,198 @@
+#include <unity.h>
+#include <Arduino.h>
+#include <EEPROM.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <util/crc16.h>
+#include "hal.h"
+#include "config.h"
+#include "logger.h"
+#include "eeprom_layout.h"
+
+// readConfig() on the host file system: every numeric value is clamped
+// when config.ini is parsed and when the EEPROM snapshot of the next boot
+// is used.
+
+static char card[] = "/tmp/igc_config_XXXXXX";
+
+static void writeIni(const char *text)
+{
+  const std::string path = std::string(card) + "/config.ini";
+  FILE *fp = fopen(path.c_str(), "w");
+  TEST_ASSERT_NOT_NULL(fp);
+  fputs(text, fp);
+  fclose(fp);
+}
+
+static void checkLimits(const config_t &config)
+{
+  TEST_ASSERT_EQUAL(1, config.log_interval);
+  TEST_ASSERT_EQUAL(5, config.log_interval_min);
+  TEST_ASSERT_EQUAL(5, config.log_interval_max);
+  TEST_ASSERT_EQUAL(IGC::MAX_FLUSH_INTERVAL, config.flush_interval);
+  TEST_ASSERT_TRUE(config.vario_filter == 0.1f);
+  TEST_ASSERT_TRUE(config.liftoff_threshold == 10.0f);
+  TEST_ASSERT_EQUAL(1, config.takeoff_speed);
+  TEST_ASSERT_EQUAL(3600, config.landing_time);
+  TEST_ASSERT_EQUAL(1000, config.sync_records);
+  TEST_ASSERT_EQUAL(0, config.sync_interval);
+  TEST_ASSERT_EQUAL(24, config.max_flight_hours);
+  TEST_ASSERT_EQUAL(1440, config.grecord_checkpoint);
+  TEST_ASSERT_EQUAL(115200, config.baudrate);
+}
+
+static const char bad_ini[] =
+  "[gps]\n"
+  "Baudrate=1000000\n"
+  "[config]\n"
+  "log_interval=0\n"
+  "log_interval_min=5\n"
+  "log_interval_max=2\n"
+  "flush_interval=100\n"
+  "vario_filter=0\n"
+  "liftoff_threshold=50\n"
+  "takeoff_speed=0\n"
+  "landing_time=70000\n"
+  "sync_records=100000\n"
+  "sync_interval=-1\n"
+  "max_flight_hours=1000\n"
+  "grecord_checkpoint=99999\n";
+
+void setUp()
+{
+  HAL::hostBegin(card, false);
+  memset(EEPROMClass::data(), 0xff, NATIVE_EEPROM_SIZE);
+}
+
+void tearDown()
+{
+}
+
+void test_defaults_in_range()
+{
+  writeIni("[config]\n");
+  config_t config;
+  readConfig("config.ini", config);
+  TEST_ASSERT_EQUAL(2, config.log_interval);
+  TEST_ASSERT_EQUAL(1, config.log_interval_min);
+  TEST_ASSERT_EQUAL(4, config.log_interval_max);
+  TEST_ASSERT_EQUAL(15, config.flush_interval);
+  TEST_ASSERT_TRUE(config.vario_filter == 1.5f);
+  TEST_ASSERT_TRUE(config.liftoff_threshold == 1.5f);
+  TEST_ASSERT_EQUAL(10, config.takeoff_speed);
+  TEST_ASSERT_EQUAL(30, config.landing_time);
+  TEST_ASSERT_EQUAL(10, config.sync_records);
+  TEST_ASSERT_EQUAL(30, config.sync_interval);
+  TEST_ASSERT_EQUAL(0, config.max_flight_hours);
+  TEST_ASSERT_EQUAL(5, config.grecord_checkpoint);
+  TEST_ASSERT_EQUAL(9600, config.baudrate);
+}
+
+void test_parsed_values_clamped()
+{
+  writeIni(bad_ini);
+  config_t config;
+  TEST_ASSERT_TRUE(readConfig("config.ini", config));
+  checkLimits(config);
+}
+
+// out of range values in the snapshot (written by another build, or
+// changed on the card): patch them in and fix the CRC, see
+// config_snapshot_t in config.cpp
+template <typename T>
+static void patchSnapshot(size_t offset, T value)
+{
+  uint8_t *eeprom = EEPROMClass::data() + EEPROM_CONFIG_ADDR;
+  const size_t header_size = 18;
+  uint16_t strings;
+  memcpy(&strings, eeprom + 12, sizeof(strings));
+  memcpy(eeprom + header_size + offset, &value, sizeof(value));
+  uint16_t crc = 0xffff;
+  for (size_t i = 0; i < sizeof(config_t) + strings; i++)
+  {
+    crc = _crc_ccitt_update(crc, eeprom[header_size + i]);
+  }
+  memcpy(eeprom + 14, &crc, sizeof(crc));
+}
+
+void test_snapshot_values_clamped()
+{
+  // the first boot parses and saves the snapshot, the second one loads it
+  writeIni("[config]\n");
+  config_t config;
+  TEST_ASSERT_TRUE(readConfig("config.ini", config));
+  patchSnapshot(offsetof(config_t, log_interval), 0);
+  patchSnapshot(offsetof(config_t, log_interval_min), 5);
+  patchSnapshot(offsetof(config_t, log_interval_max), 2);
+  patchSnapshot(offsetof(config_t, flush_interval), 100);
+  patchSnapshot(offsetof(config_t, vario_filter), 0.0f);
+  patchSnapshot(offsetof(config_t, liftoff_threshold), 50.0f);
+  patchSnapshot(offsetof(config_t, takeoff_speed), 0);
+  patchSnapshot(offsetof(config_t, landing_time), 70000);
+  patchSnapshot(offsetof(config_t, sync_records), 100000);
+  patchSnapshot(offsetof(config_t, sync_interval), -1);
+  patchSnapshot(offsetof(config_t, max_flight_hours), 1000);
+  patchSnapshot(offsetof(config_t, grecord_checkpoint), 99999);
+  patchSnapshot(offsetof(config_t, baudrate), 1000000UL);
+  memset(&config, 0, sizeof(config));
+  TEST_ASSERT_TRUE(readConfig("config.ini", config));
+  // from the snapshot: the patched values, clamped
+  checkLimits(config);
+}
+
+// the snapshot of a firmware with other defaults: same config.ini, but a
+// different key table CRC in the header
+void test_snapshot_of_other_defaults()
+{
+  writeIni("[config]\n");
+  config_t config;
+  TEST_ASSERT_TRUE(readConfig("config.ini", config));
+  patchSnapshot(offsetof(config_t, log_interval), 7);
+  TEST_ASSERT_TRUE(readConfig("config.ini", config));
+  // the snapshot is used
+  TEST_ASSERT_EQUAL(7, config.log_interval);
+
+  uint8_t *keys = EEPROMClass::data() + EEPROM_CONFIG_ADDR + 16;
+  const uint8_t ours = keys[0];
+  keys[0] ^= 0x01;
+  TEST_ASSERT_TRUE(readConfig("config.ini", config));
+  // parsed again with the defaults of this firmware, and saved with its CRC
+  TEST_ASSERT_EQUAL(2, config.log_interval);
+  TEST_ASSERT_EQUAL(ours, keys[0]);
+}
+
+void test_negative_and_nan()
+{
+  writeIni("[gps]\nBaudrate=0\n"
+           "[config]\nlog_interval=-3\nlog_interval_min=-1\nflush_interval=-5\nvario_filter=nan\n"
+           "liftoff_threshold=nan\ntakeoff_speed=-10\nlanding_time=-1\nsync_records=-1\n"
+           "max_flight_hours=-2\ngrecord_checkpoint=-5\n");
+  config_t config;
+  TEST_ASSERT_TRUE(readConfig("config.ini", config));
+  TEST_ASSERT_EQUAL(1, config.log_interval);
+  TEST_ASSERT_EQUAL(1, config.log_interval_min);
+  TEST_ASSERT_EQUAL(4, config.log_interval_max);
+  TEST_ASSERT_EQUAL(0, config.flush_interval);
+  TEST_ASSERT_TRUE(config.vario_filter == 0.1f);
+  TEST_ASSERT_TRUE(config.liftoff_threshold == 0.1f);
+  TEST_ASSERT_EQUAL(1, config.takeoff_speed);
+  TEST_ASSERT_EQUAL(0, config.landing_time);
+  TEST_ASSERT_EQUAL(0, config.sync_records);
+  TEST_ASSERT_EQUAL(0, config.max_flight_hours);
+  TEST_ASSERT_EQUAL(0, config.grecord_checkpoint);
+  TEST_ASSERT_EQUAL(1200, config.baudrate);
+}
+
+int main()
+{
+  UNITY_BEGIN();
+  TEST_ASSERT_NOT_NULL(mkdtemp(card));
+  RUN_TEST(test_defaults_in_range);
+  RUN_TEST(test_parsed_values_clamped);
+  RUN_TEST(test_snapshot_values_clamped);
+  RUN_TEST(test_snapshot_of_other_defaults);
+  RUN_TEST(test_negative_and_nan);
+  return UNITY_END();
+}
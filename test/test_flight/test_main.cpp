@@ -0,0 +1,280 @@
+#include <unity.h>
+#include <stdio.h>
+#include <vector>
+#include "flight.h"
+
+// Takeoff and landing detection replayed on scripted flights at the baro
+// sample rate (one conversion every ~545 ms, see hal_arduino.cpp): the
+// baro altitude goes through the vario filter, the state machine sees its
+// rate, the altitudes and the GPS speed. Every test checks the state
+// changes and reports the detection latencies.
+
+static const FLIGHT::params_t params =
+{
+  1.5f,   // liftoff_threshold, m/s
+  10.0f,  // takeoff_speed, km/h
+  10,     // s moving before takeoff is confirmed
+  30,     // landing_time, s
+  50.0f   // landing_height, m
+};
+static const float vario_filter = 1.5f;   // s
+static const unsigned long sample_ms = 545;
+// the filtered sink after a descent stays above liftoff_threshold for up
+// to this long after the stop
+static const unsigned long settle_ms = 2000;
+
+typedef struct
+{
+  uint16_t seconds;
+  float speed;      // km/h
+  float climb;      // m/s
+  bool gps_valid;
+  float drift;      // m/s, baro only (weather)
+} segment_t;
+
+typedef struct
+{
+  FLIGHT::state_t state;
+  unsigned long ms;
+} event_t;
+
+static FLIGHT::flight_t flight;
+static std::vector<event_t> events;
+
+// start of every segment, ms
+static std::vector<unsigned long> segment_start;
+
+static void replay(const segment_t *segments, size_t count)
+{
+  FLIGHT::vario_t vario = {};
+  FLIGHT::begin(flight, true, 0);
+  events.clear();
+  segment_start.clear();
+  float altitude = 100.0f;
+  float baro = altitude;
+  unsigned long now = 0;
+  for (size_t s = 0; s < count; s++)
+  {
+    const segment_t &segment = segments[s];
+    segment_start.push_back(now);
+    const unsigned long end = now + segment.seconds * 1000UL;
+    for (; now < end; now += sample_ms)
+    {
+      altitude += segment.climb * sample_ms / 1000.0f;
+      baro += (segment.climb + segment.drift) * sample_ms / 1000.0f;
+      FLIGHT::varioUpdate(vario, baro, now, vario_filter);
+      // without a fix the speed is not updated either, main.cpp keeps 0
+      const FLIGHT::sample_t sample =
+      {
+        vario.rate,
+        vario.altitude,
+        segment.gps_valid,
+        segment.gps_valid ? segment.speed : 0.0f,
+        altitude
+      };
+      if (FLIGHT::update(flight, params, sample, now))
+      {
+        events.push_back({ flight.state, now });
+      }
+    }
+  }
+  segment_start.push_back(now);
+}
+
+static unsigned long eventTime(FLIGHT::state_t state, size_t nth = 0)
+{
+  for (const event_t &event : events)
+  {
+    if (event.state == state && nth-- == 0)
+    {
+      return event.ms;
+    }
+  }
+  TEST_FAIL_MESSAGE(FLIGHT::stateName(state));
+  return 0;
+}
+
+static size_t eventCount(FLIGHT::state_t state)
+{
+  size_t n = 0;
+  for (const event_t &event : events)
+  {
+    n += event.state == state;
+  }
+  return n;
+}
+
+static void report(const char *name, long takeoff, long confirm, long landing)
+{
+  char message[160];
+  snprintf(message, sizeof(message),
+           "%s: takeoff detected after %ld ms, confirmed after %ld ms, landing detected after %ld ms",
+           name, takeoff, confirm, landing);
+  TEST_MESSAGE(message);
+}
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+}
+
+void test_winch_launch()
+{
+  static const segment_t segments[] =
+  {
+    {  60,  0.0f,  0.0f, true, 0.0f },   // waiting at the winch
+    {   3, 40.0f,  0.0f, true, 0.0f },   // ground roll
+    {  40, 90.0f, 10.0f, true, 0.0f },   // on the cable
+    { 900, 85.0f, -0.4f, true, 0.0f },   // local soaring, back at the field
+    {  15, 30.0f,  0.0f, true, 0.0f },   // landing roll
+    { 120,  0.0f,  0.0f, true, 0.0f },   // on the ground
+  };
+  replay(segments, 6);
+  const unsigned long roll = segment_start[1];
+  const unsigned long stop = segment_start[5];
+  TEST_ASSERT_EQUAL(1, eventCount(FLIGHT::TAKEOFF));
+  TEST_ASSERT_EQUAL(1, eventCount(FLIGHT::FLYING));
+  TEST_ASSERT_EQUAL(1, eventCount(FLIGHT::LANDED));
+  // the first sample above takeoff_speed, confirmed confirm_time later
+  TEST_ASSERT_EQUAL(roll, eventTime(FLIGHT::TAKEOFF));
+  TEST_ASSERT_UINT32_WITHIN(sample_ms, roll + params.confirm_time * 1000UL, eventTime(FLIGHT::FLYING));
+  TEST_ASSERT_EQUAL(eventTime(FLIGHT::FLYING) - roll, flight.takeoff_latency);
+  // landing_time after the last sample above takeoff_speed
+  TEST_ASSERT_UINT32_WITHIN(sample_ms, stop + params.landing_time * 1000UL, eventTime(FLIGHT::LANDED));
+  TEST_ASSERT_EQUAL(FLIGHT::GROUND, flight.state);
+  report("winch", eventTime(FLIGHT::TAKEOFF) - roll, eventTime(FLIGHT::FLYING) - roll,
+         eventTime(FLIGHT::LANDED) - stop);
+}
+
+void test_gps_outage_in_flight()
+{
+  // five minutes without a fix while flying: no landing, the state is
+  // held until the fix is back
+  static const segment_t segments[] =
+  {
+    {  30,  0.0f,  0.0f, true, 0.0f },
+    {  60, 90.0f,  5.0f, true, 0.0f },
+    { 300,  0.0f,  0.0f, false, 0.0f },  // fix lost, level flight
+    { 120, 90.0f, -1.0f, true, 0.0f },
+  };
+  replay(segments, 4);
+  TEST_ASSERT_EQUAL(1, eventCount(FLIGHT::FLYING));
+  TEST_ASSERT_EQUAL(0, eventCount(FLIGHT::LANDED));
+  TEST_ASSERT_EQUAL(FLIGHT::FLYING, flight.state);
+}
+
+void test_landing_during_outage()
+{
+  // the fix is lost on final approach and only back after the landing:
+  // the landing is detected on the first valid fix at low speed, near
+  // the takeoff altitude
+  static const segment_t segments[] =
+  {
+    {  30,  0.0f,  0.0f, true, 0.0f },
+    { 120, 90.0f,  3.0f, true, 0.0f },
+    {  60,  0.0f, -6.0f, false, 0.0f },  // approach without fix
+    {  30,  0.0f,  0.0f, false, 0.0f },  // landed, still no fix
+    {  60,  0.0f,  0.0f, true, 0.0f },
+  };
+  replay(segments, 5);
+  const unsigned long fix_back = segment_start[4];
+  TEST_ASSERT_EQUAL(1, eventCount(FLIGHT::LANDED));
+  TEST_ASSERT_EQUAL(fix_back, eventTime(FLIGHT::LANDED));
+  report("outage", eventTime(FLIGHT::TAKEOFF) - segment_start[1],
+         eventTime(FLIGHT::FLYING) - segment_start[1], eventTime(FLIGHT::LANDED) - segment_start[3]);
+}
+
+void test_no_takeoff_without_fix()
+{
+  // baro steps (door opened, gusts) before the first fix
+  static const segment_t segments[] =
+  {
+    { 10, 0.0f,  0.0f, false, 0.0f },
+    {  2, 0.0f,  6.0f, false, 0.0f },
+    {  2, 0.0f, -6.0f, false, 0.0f },
+    { 60, 0.0f,  0.0f, false, 0.0f },
+    { 60, 0.0f,  0.0f, true, 0.0f },
+  };
+  replay(segments, 5);
+  TEST_ASSERT_EQUAL(0, events.size());
+  TEST_ASSERT_EQUAL(FLIGHT::GROUND, flight.state);
+}
+
+void test_false_alarm()
+{
+  // pushed to the launch point: moving for less than confirm_time
+  static const segment_t segments[] =
+  {
+    { 30,  0.0f, 0.0f, true, 0.0f },
+    {  6, 15.0f, 0.0f, true, 0.0f },
+    { 60,  0.0f, 0.0f, true, 0.0f },
+  };
+  replay(segments, 3);
+  TEST_ASSERT_EQUAL(1, eventCount(FLIGHT::TAKEOFF));
+  TEST_ASSERT_EQUAL(0, eventCount(FLIGHT::FLYING));
+  TEST_ASSERT_EQUAL(1, eventCount(FLIGHT::GROUND));
+  // back on the ground confirm_time after it stopped
+  TEST_ASSERT_UINT32_WITHIN(sample_ms, segment_start[2] + params.confirm_time * 1000UL,
+                            eventTime(FLIGHT::GROUND));
+}
+
+void test_slow_soaring_is_flying()
+{
+  // ridge soaring into a strong wind, 250 m above the takeoff: ground
+  // speed below takeoff_speed and the vario within liftoff_threshold for
+  // minutes, no landing until back down at the field
+  static const segment_t segments[] =
+  {
+    {  30,  0.0f,  0.0f, true, 0.0f },
+    {  50, 80.0f,  5.0f, true, 0.0f },   // +250 m
+    { 120,  5.0f,  0.3f, true, 0.0f },
+    { 120,  6.0f, -0.5f, true, 0.0f },
+    { 120,  4.0f,  0.5f, true, 0.0f },
+    { 120,  5.0f,  0.0f, true, 0.0f },
+    { 120,  5.0f, -0.3f, true, 0.0f },
+    { 105, 50.0f, -2.0f, true, 0.0f },   // down to the field
+    {  60,  0.0f,  0.0f, true, 0.0f },
+  };
+  replay(segments, 9);
+  TEST_ASSERT_EQUAL(1, eventCount(FLIGHT::FLYING));
+  TEST_ASSERT_EQUAL(1, eventCount(FLIGHT::LANDED));
+  const unsigned long stop = segment_start[8];
+  TEST_ASSERT_UINT32_WITHIN(settle_ms, stop + params.landing_time * 1000UL + settle_ms,
+                            eventTime(FLIGHT::LANDED));
+  report("ridge", eventTime(FLIGHT::TAKEOFF) - segment_start[1],
+         eventTime(FLIGHT::FLYING) - segment_start[1], eventTime(FLIGHT::LANDED) - stop);
+}
+
+void test_baro_drift_gps_agrees()
+{
+  // the pressure fell during the flight: the baro reads 90 m above the
+  // field after the landing, the GPS altitude is back at the takeoff
+  static const segment_t segments[] =
+  {
+    {  30,  0.0f,   0.0f, true, 0.0f },
+    {  30, 90.0f,  10.0f, true, 0.0f },
+    { 600, 80.0f,   0.0f, true, 0.15f },
+    { 100, 80.0f,  -3.0f, true, 0.0f },
+    {  60,  0.0f,   0.0f, true, 0.0f },
+  };
+  replay(segments, 5);
+  TEST_ASSERT_EQUAL(1, eventCount(FLIGHT::LANDED));
+  TEST_ASSERT_UINT32_WITHIN(settle_ms, segment_start[4] + params.landing_time * 1000UL + settle_ms,
+                            eventTime(FLIGHT::LANDED));
+}
+
+int main()
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_winch_launch);
+  RUN_TEST(test_gps_outage_in_flight);
+  RUN_TEST(test_landing_during_outage);
+  RUN_TEST(test_no_takeoff_without_fix);
+  RUN_TEST(test_false_alarm);
+  RUN_TEST(test_slow_soaring_is_flying);
+  RUN_TEST(test_baro_drift_gps_agrees);
+  return UNITY_END();
+}
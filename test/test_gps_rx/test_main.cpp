@@ -0,0 +1,152 @@
+#include <unity.h>
+#include <Arduino.h>
+#include <TinyGPS++.h>
+#include <string>
+#include "gps_rx.h"
+
+// GPS receive ring fed like the RX interrupt does at the GPS baud rate,
+// with loop() stalled by the SD card in the middle of an NMEA burst.
+
+// one second of NMEA output of a 1 Hz receiver, a burst of ~460 bytes
+static std::string nmeaBurst(uint32_t second)
+{
+  static const char *const bodies[] =
+  {
+    "GPRMC,%02u%02u%02u.00,A,5206.0000,N,00512.0000,E,48.6,90.0,170826,,,A",
+    "GPGGA,%02u%02u%02u.00,5206.0000,N,00512.0000,E,1,09,0.9,1200.0,M,46.0,M,,",
+    "GPGSA,A,3,01,02,12,14,15,17,19,24,32,,,,1.6,0.9,1.3",
+    "GPGSV,3,1,09,01,40,083,46,02,17,308,41,12,07,344,39,14,22,228,45",
+    "GPGSV,3,2,09,15,51,150,47,17,25,052,42,19,63,269,48,24,11,190,38",
+    "GPGSV,3,3,09,32,33,120,44",
+    "GPVTG,90.0,T,,M,48.6,N,90.0,K,A",
+    "GPGLL,5206.0000,N,00512.0000,E,%02u%02u%02u.00,A,A",
+  };
+  const uint32_t t = 36000 + second;
+  std::string burst;
+  for (const char *format : bodies)
+  {
+    char body[128], sentence[140];
+    snprintf(body, sizeof(body), format, t / 3600, t / 60 % 60, t % 60);
+    uint8_t cs = 0;
+    for (const char *p = body; *p; p++)
+    {
+      cs ^= *p;
+    }
+    snprintf(sentence, sizeof(sentence), "$%s*%02X\r\n", body, cs);
+    burst += sentence;
+  }
+  return burst;
+}
+
+typedef struct
+{
+  uint32_t sentences;   // passed the checksum
+  uint32_t failed;      // failed the checksum
+  GPS_RX::gps_rx_stats_t rx;
+} result_t;
+
+// seconds of bursts at baud, every second loop() stalls for stall_ms
+// starting stall_at ms after the start of the burst
+static result_t replay(unsigned long baud, uint32_t seconds, uint32_t stall_at, uint32_t stall_ms)
+{
+  GPS_RX::hostReset();
+  TinyGPSPlus gps;
+  const double bytes_per_ms = baud / 10.0 / 1000.0;
+  for (uint32_t s = 0; s < seconds; s++)
+  {
+    const std::string burst = nmeaBurst(s);
+    double sent = 0;
+    for (uint32_t ms = 0; ms < 1000; ms++)
+    {
+      // interrupt side: bytes of the burst that arrived during this ms
+      const double until = std::min((double) burst.size(), (ms + 1) * bytes_per_ms);
+      const uint16_t n = (uint16_t) until - (uint16_t) sent;
+      GPS_RX::hostReceive((const uint8_t *) burst.data() + (uint16_t) sent, n);
+      sent = until;
+      // loop() side
+      if (ms >= stall_at && ms < stall_at + stall_ms)
+      {
+        continue;
+      }
+      int c;
+      while ((c = GPS_RX::read()) >= 0)
+      {
+        gps.encode(c);
+      }
+    }
+  }
+  result_t result;
+  result.sentences = gps.passedChecksum();
+  result.failed = gps.failedChecksum();
+  GPS_RX::getStats(result.rx);
+  return result;
+}
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+}
+
+void test_burst_without_stall()
+{
+  const result_t r = replay(38400, 60, 0, 0);
+  TEST_ASSERT_EQUAL(60 * 8, r.sentences);
+  TEST_ASSERT_EQUAL(0, r.failed);
+  TEST_ASSERT_EQUAL(0, r.rx.dropped);
+  // the interrupt side sees the ring fill up within a ms
+  TEST_ASSERT_GREATER_THAN(0, r.rx.max_used);
+  TEST_ASSERT_LESS_THAN(8, r.rx.max_used);
+}
+
+void test_card_stall_during_burst()
+{
+  // the whole burst arrives while loop() waits 250 ms for the card
+  const result_t r = replay(38400, 60, 0, 250);
+  TEST_ASSERT_EQUAL(60 * 8, r.sentences);
+  TEST_ASSERT_EQUAL(0, r.rx.dropped);
+  TEST_ASSERT_GREATER_THAN(nmeaBurst(0).size() - 8, r.rx.max_used);
+  char message[80];
+  snprintf(message, sizeof(message), "250 ms stall: max %u of %u bytes used",
+           r.rx.max_used, GPS_RX_BUFFER_SIZE);
+  TEST_MESSAGE(message);
+}
+
+void test_overflow_is_counted()
+{
+  // a stall longer than the ring covers: bytes are dropped and counted,
+  // sentences hit by the loss fail their checksum or are lost, the rest
+  // still parse
+  GPS_RX::hostReset();
+  std::string data;
+  for (uint32_t s = 0; s < 4; s++)
+  {
+    data += nmeaBurst(s);
+  }
+  TEST_ASSERT_GREATER_THAN(GPS_RX_BUFFER_SIZE, data.size());
+  GPS_RX::hostReceive((const uint8_t *) data.data(), data.size());
+  GPS_RX::gps_rx_stats_t stats;
+  GPS_RX::getStats(stats);
+  TEST_ASSERT_EQUAL(GPS_RX_BUFFER_SIZE - 1, stats.max_used);
+  TEST_ASSERT_EQUAL(data.size() - (GPS_RX_BUFFER_SIZE - 1), stats.dropped);
+  TEST_ASSERT_EQUAL(GPS_RX_BUFFER_SIZE - 1, GPS_RX::available());
+  TinyGPSPlus gps;
+  int c;
+  while ((c = GPS_RX::read()) >= 0)
+  {
+    gps.encode(c);
+  }
+  TEST_ASSERT_EQUAL(0, GPS_RX::available());
+  TEST_ASSERT_GREATER_THAN(0, gps.passedChecksum());
+}
+
+int main()
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_burst_without_stall);
+  RUN_TEST(test_card_stall_during_burst);
+  RUN_TEST(test_overflow_is_counted);
+  return UNITY_END();
+}
@@ -0,0 +1,175 @@
+#include <unity.h>
+#include <Arduino.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+#include <TinyGPS++.h>
+#include "hal.h"
+#include "config.h"
+#include "index.h"
+#include "logger.h"
+#include "utils.h"
+
+// The ring of fixes kept on the ground, through the logger API: fixes are
+// kept once a second from 10:00:00 UTC, the takeoff writes the header,
+// the kept fixes oldest first and then the first live B record.
+
+static char card[] = "/tmp/igc_ground_XXXXXX";
+static config_t config;
+static TinyGPSPlus gps;
+
+static void sentence(const char *body)
+{
+  uint8_t cs = 0;
+  for (const char *p = body; *p; p++)
+  {
+    cs ^= *p;
+  }
+  char line[128];
+  snprintf(line, sizeof(line), "$%s*%02X\r\n", body, cs);
+  for (const char *p = line; *p; p++)
+  {
+    gps.encode(*p);
+  }
+}
+
+// RMC + GGA of second t after 10:00:00 on 17-08-2026
+static void fix(uint32_t t)
+{
+  char time[16], body[128];
+  snprintf(time, sizeof(time), "%02u%02u%02u.00", 10 + t / 3600, (t / 60) % 60, t % 60);
+  snprintf(body, sizeof(body), "GPRMC,%s,A,5206.0000,N,00512.0000,E,0.0,0.0,170826,,,A", time);
+  sentence(body);
+  snprintf(body, sizeof(body), "GPGGA,%s,5206.0000,N,00512.0000,E,1,09,0.9,10.0,M,46.0,M,,", time);
+  sentence(body);
+}
+
+// keep ground fixes at seconds 0..kept-1, take off at second kept and
+// close the file; returns the seconds of the B records in the file
+static std::vector<uint32_t> flight(uint32_t kept)
+{
+  for (uint32_t t = 0; t < kept; t++)
+  {
+    fix(t);
+    IGC::keepGroundFix(gps, 100.0f);
+  }
+  char path[32];
+  snprintf(path, sizeof(path), "20260817/lg%03lu.igc", (unsigned long) (ReadFileCounter() % 1000));
+  TEST_ASSERT_TRUE(IGC::createIGCFileName(2026, 8, 17, config));
+  IGC::enableIGCWrite(true);
+  fix(kept);
+  TEST_ASSERT_EQUAL(1, IGC::writeBRecord(gps, 100.0f, config));
+  IGC::closeIGC();
+  IGC::enableIGCWrite(false);
+
+  std::vector<uint32_t> seconds;
+  HAL::File igc = HAL::fsOpen(path);
+  TEST_ASSERT_TRUE(igc);
+  char line[100];
+  size_t len = 0;
+  bool header = true;
+  int c;
+  while ((c = igc.read()) >= 0)
+  {
+    if (len < sizeof(line) - 1)
+    {
+      line[len++] = c;
+    }
+    if (c != '\n')
+    {
+      continue;
+    }
+    line[len] = '\0';
+    len = 0;
+    if (line[0] == 'B')
+    {
+      header = false;
+      seconds.push_back(((line[3] - '0') * 10 + line[4] - '0') * 60 +
+                        (line[5] - '0') * 10 + line[6] - '0');
+    }
+    else if (line[0] != 'G')
+    {
+      // A and H records before the first B record
+      TEST_ASSERT_TRUE_MESSAGE(header, line);
+    }
+  }
+  igc.close();
+  return seconds;
+}
+
+void setUp()
+{
+  hostFreeMemory(3072);
+}
+
+void tearDown()
+{
+}
+
+void test_wrap_around()
+{
+  // one fix every 10 s of ground_window (60 s): 6 slots, 20 fixes kept
+  IGC::initGroundFixes(10);
+  const std::vector<uint32_t> seconds = flight(20);
+  TEST_ASSERT_EQUAL(7, seconds.size());
+  for (uint32_t i = 0; i < 6; i++)
+  {
+    // the last 6, oldest first
+    TEST_ASSERT_EQUAL(14 + i, seconds[i]);
+  }
+  // then the first live record
+  TEST_ASSERT_EQUAL(20, seconds[6]);
+  TEST_ASSERT_EQUAL(6, IGC::getRecordStats().pre_takeoff);
+}
+
+void test_partly_filled()
+{
+  // fewer fixes than slots, nothing wrapped
+  IGC::initGroundFixes(10);
+  const std::vector<uint32_t> seconds = flight(3);
+  TEST_ASSERT_EQUAL(4, seconds.size());
+  for (uint32_t i = 0; i < 4; i++)
+  {
+    TEST_ASSERT_EQUAL(i, seconds[i]);
+  }
+}
+
+void test_ring_emptied_on_takeoff()
+{
+  // the next flight of the power cycle gets only its own ground fixes
+  IGC::initGroundFixes(10);
+  flight(10);
+  const std::vector<uint32_t> seconds = flight(0);
+  TEST_ASSERT_EQUAL(1, seconds.size());
+}
+
+void test_no_memory_for_the_ring()
+{
+  // not even the IGC writer and the stack reserve fit: no ring, the
+  // flight starts with the live record
+  hostFreeMemory(256);
+  IGC::initGroundFixes(1);
+  const std::vector<uint32_t> seconds = flight(30);
+  TEST_ASSERT_EQUAL(1, seconds.size());
+  TEST_ASSERT_EQUAL(30, seconds[0]);
+}
+
+int main()
+{
+  UNITY_BEGIN();
+  TEST_ASSERT_NOT_NULL(mkdtemp(card));
+  HAL::hostBegin(card, false);
+  const std::string ini = std::string(card) + "/config.ini";
+  FILE *fp = fopen(ini.c_str(), "w");
+  TEST_ASSERT_NOT_NULL(fp);
+  fputs("[config]\n", fp);
+  fclose(fp);
+  readConfig("config.ini", config);
+  IGC::initIGC();
+  RUN_TEST(test_wrap_around);
+  RUN_TEST(test_partly_filled);
+  RUN_TEST(test_ring_emptied_on_takeoff);
+  RUN_TEST(test_no_memory_for_the_ring);
+  return UNITY_END();
+}
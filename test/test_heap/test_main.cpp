@@ -0,0 +1,86 @@
+#include <unity.h>
+#include <Arduino.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "hal.h"
+#include "utils.h"
+#include "../replay_trace.h"
+
+// A 10 hour flight through the whole logger on the host: the heap in use
+// is sampled every simulated minute once the IGC file is open and must
+// not move until the landing. getHeapInfo() reports the glibc heap of
+// the process on the host.
+
+void setup();
+void loop();
+
+static char card[] = "/tmp/igc_heap_XXXXXX";
+
+#define HEAP_LEG \
+  { 1200,  80.0f,  1.5f, 12.0f },  /* circling */ \
+  { 2400, 120.0f, -0.75f, 0.0f }   /* cruise */
+
+static const TRACE::phase_t flight[] =
+{
+  TRACE_GROUND_START,
+  HEAP_LEG, HEAP_LEG, HEAP_LEG, HEAP_LEG, HEAP_LEG,
+  HEAP_LEG, HEAP_LEG, HEAP_LEG, HEAP_LEG, HEAP_LEG,
+  TRACE_GROUND_END,
+};
+
+// after the takeoff (file created, writer allocated) and before the
+// landing, s of trace time
+static const unsigned long flight_start = 120 + 20 + 100 + 600;
+static const unsigned long flight_end = flight_start + 10 * 3600UL - 1200;
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+}
+
+void test_heap_flat_for_10_hours()
+{
+  TEST_ASSERT_NOT_NULL(mkdtemp(card));
+  std::vector<TRACE::second_t> trace;
+  TEST_ASSERT_TRUE(TRACE::write(card, TRACE_PHASES(flight), trace));
+  HAL::hostBegin(card, false);
+  setup();
+
+  heap_info_t info;
+  size_t low = (size_t) -1;
+  size_t high = 0;
+  uint32_t samples = 0;
+  unsigned long next = flight_start * 1000UL;
+  while (!HAL::hostHalted() && HAL::millis() < 20UL * 3600 * 1000)
+  {
+    loop();
+    HAL::idle();
+    if (HAL::millis() >= next && HAL::millis() < flight_end * 1000UL)
+    {
+      getHeapInfo(info);
+      low = info.heap_used < low ? info.heap_used : low;
+      high = info.heap_used > high ? info.heap_used : high;
+      samples++;
+      next += 60000;
+    }
+  }
+  TEST_ASSERT_TRUE_MESSAGE(HAL::hostHalted(), "replay did not finish");
+  TEST_ASSERT_TRUE(HAL::fsExists("20260817/lg000.igc"));
+
+  char message[120];
+  snprintf(message, sizeof(message), "%lu samples in flight: heap in use %lu..%lu bytes",
+           (unsigned long) samples, (unsigned long) low, (unsigned long) high);
+  TEST_MESSAGE(message);
+  TEST_ASSERT_GREATER_THAN(500, samples);
+  TEST_ASSERT_EQUAL(low, high);
+}
+
+int main()
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_heap_flat_for_10_hours);
+  return UNITY_END();
+}
@@ -0,0 +1,282 @@
+#include <unity.h>
+#include <Arduino.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include "hal.h"
+#include "igc_file_writer.h"
+#include "igc_format.h"
+#include "igc_grecord.h"
+
+// igc_file_writer on the host file system, which counts the card
+// operations (HAL::hostFsStats) like a fake SD card.
+
+static char card[] = "/tmp/igc_writer_XXXXXX";
+
+static const char header[] = "AXLK001\r\n";
+
+typedef char record_t[sizeof(IGC::igc_t) + 2];
+
+static void bRecord(record_t &record, uint32_t i)
+{
+  IGC::fix_t fix = {};
+  const uint32_t time = 36000 + i;
+  fix.hour = time / 3600;
+  fix.minute = time / 60 % 60;
+  fix.second = time % 60;
+  fix.lat = 52 * 60000UL + i * 7;
+  fix.lng = 5 * 60000UL + i * 11;
+  fix.pAlt = 500 + i % 300;
+  fix.gAlt = 540 + i % 300;
+  fix.fxa = 5;
+  fix.siu = 9;
+  IGC::igc_t b;
+  IGC::formatBRecord(fix, b);
+  snprintf(record, sizeof(record), "%s\r\n", b.raw);
+}
+
+static void createFile(const char *path)
+{
+  HAL::File f = HAL::fsOpen(path, O_WRITE | O_CREAT | O_TRUNC);
+  TEST_ASSERT_TRUE(f);
+  f.close();
+}
+
+static std::string readFile(const char *path)
+{
+  HAL::File f = HAL::fsOpen(path);
+  TEST_ASSERT_TRUE(f);
+  std::string data(f.size(), '\0');
+  // read() takes 16 bit sizes like the SD library
+  for (size_t pos = 0; pos < data.size(); pos += 32768)
+  {
+    const size_t count = std::min<size_t>(32768, data.size() - pos);
+    TEST_ASSERT_EQUAL(count, f.read(&data[pos], count));
+  }
+  f.close();
+  return data;
+}
+
+// write a flight of records with one record per second on the virtual
+// clock, returns the host time per record in us
+static double writeFlight(igc_file_writer &writer, uint32_t records)
+{
+  using namespace std::chrono;
+  const steady_clock::time_point start = steady_clock::now();
+  writer.append(header);
+  for (uint32_t i = 0; i < records; i++)
+  {
+    record_t record;
+    bRecord(record, i);
+    TEST_ASSERT_TRUE(writer.append(record));
+    HAL::hostAdvance(1000);
+  }
+  writer.close();
+  return duration_cast<nanoseconds>(steady_clock::now() - start).count() / 1000.0 / records;
+}
+
+static void report(const char *name, const HAL::fs_stats_t &stats, uint32_t records, double us)
+{
+  char message[200];
+  snprintf(message, sizeof(message),
+           "%s: per record %.3f opens, %.3f seeks, %.3f writes, %.3f syncs, %.1f bytes, %.2f us",
+           name, (double) stats.opens / records, (double) stats.seeks / records,
+           (double) stats.writes / records, (double) stats.syncs / records,
+           (double) stats.bytes_written / records, us);
+  TEST_MESSAGE(message);
+}
+
+void setUp()
+{
+  HAL::hostBegin(card, false);
+  HAL::hostFsWriteDelay(0);
+}
+
+void tearDown()
+{
+}
+
+void test_keep_open_writes_same_file()
+{
+  // open/close per record against one handle for the flight:
+  // same file, one open and a tenth of the syncs
+  const uint32_t records = 600;
+  HAL::fs_stats_t per_record, kept_open;
+
+  createFile("a.igc");
+  HAL::hostFsResetStats();
+  {
+    igc_file_writer writer("a.igc", true);
+    const double us = writeFlight(writer, records);
+    HAL::hostFsStats(per_record);
+    report("open per record", per_record, records, us);
+  }
+  createFile("b.igc");
+  HAL::hostFsResetStats();
+  {
+    igc_file_writer writer("b.igc", true, true, 10, 30);
+    const double us = writeFlight(writer, records);
+    HAL::hostFsStats(kept_open);
+    report("keep_file_open ", kept_open, records, us);
+  }
+
+  TEST_ASSERT_TRUE(readFile("a.igc") == readFile("b.igc"));
+  TEST_ASSERT_EQUAL(records + 1, per_record.opens);
+  TEST_ASSERT_EQUAL(1, kept_open.opens);
+  TEST_ASSERT_EQUAL(1, kept_open.closes);
+  // every close syncs, with the handle kept open every 10 records
+  TEST_ASSERT_EQUAL(records + 1, per_record.syncs);
+  TEST_ASSERT_UINT32_WITHIN(2, records / 10, kept_open.syncs);
+}
+
+void test_deferred_grecord_same_file()
+{
+  // G-record only at the checkpoints and on close: same signed file,
+  // a few G-record writes instead of one per record
+  const uint32_t records = 600;
+  createFile("c.igc");
+  createFile("d.igc");
+  igc_file_writer every("c.igc", true, true, 10, 30);
+  writeFlight(every, records);
+  igc_file_writer deferred("d.igc", true, true, 10, 30, true, 5);
+  writeFlight(deferred, records);
+
+  TEST_ASSERT_TRUE(readFile("c.igc") == readFile("d.igc"));
+  TEST_ASSERT_EQUAL(records + 1, every.stats().grecords);
+  // 10 min of records: two checkpoints and the one on close
+  TEST_ASSERT_EQUAL(3, deferred.stats().grecords);
+}
+
+void test_write_errors_are_reported()
+{
+  // a failing card shows in the return values, staged records included
+  createFile("e.igc");
+  igc_file_writer writer("e.igc", true, true, 0, 0, true, 0);
+  record_t record;
+  bRecord(record, 0);
+  TEST_ASSERT_TRUE(writer.append(header));
+  TEST_ASSERT_TRUE(writer.append(record));
+  TEST_ASSERT_TRUE(writer.sync());
+
+  HAL::hostFsFailWrites(true);
+  // staged in RAM, the card is not touched until the sector is full
+  TEST_ASSERT_TRUE(writer.append(record));
+  TEST_ASSERT_FALSE(writer.sync());
+  // the card is back, the stage is written again with the next sync
+  HAL::hostFsFailWrites(false);
+  TEST_ASSERT_TRUE(writer.sync());
+
+  // a full sector that cannot be written is lost, the record that
+  // completed it reports the error
+  HAL::hostFsFailWrites(true);
+  bool failed = false;
+  for (uint32_t i = 1; i < 20; i++)
+  {
+    bRecord(record, i);
+    failed = !writer.append(record) || failed;
+  }
+  TEST_ASSERT_TRUE_MESSAGE(failed, "full sector written without error");
+  HAL::hostFsFailWrites(false);
+  writer.close();
+}
+
+static void writeFile(const char *path, const std::string &data)
+{
+  HAL::File f = HAL::fsOpen(path, O_WRITE | O_CREAT | O_TRUNC);
+  TEST_ASSERT_TRUE(f);
+  TEST_ASSERT_EQUAL(data.size(), f.write((const uint8_t *) data.data(), data.size()));
+  f.close();
+}
+
+static void reportRecover(const char *name, const HAL::fs_stats_t &stats, size_t size)
+{
+  char message[160];
+  snprintf(message, sizeof(message), "recover %s: %lu of %lu bytes read in %lu reads, %lu writes",
+           name, (unsigned long) stats.bytes_read, (unsigned long) size,
+           (unsigned long) stats.reads, (unsigned long) stats.writes);
+  TEST_MESSAGE(message);
+}
+
+void test_recover()
+{
+  // an hour of records, closed by the writer
+  createFile("f.igc");
+  {
+    igc_file_writer writer("f.igc", true, true, 10, 30, true, 5);
+    writeFlight(writer, 3600);
+  }
+  const std::string signed_file = readFile("f.igc");
+  const std::string records = signed_file.substr(0, signed_file.size() - 4 * IGC::G_RECORD_SIZE);
+  TEST_ASSERT_TRUE(igc_file_writer::verify("f.igc"));
+  HAL::fs_stats_t stats;
+
+  // signed: only the G-record block is read, nothing written
+  HAL::hostFsResetStats();
+  TEST_ASSERT_FALSE(igc_file_writer::recover("f.igc"));
+  HAL::hostFsStats(stats);
+  reportRecover("signed  ", stats, signed_file.size());
+  TEST_ASSERT_EQUAL(0, stats.writes);
+  TEST_ASSERT_LESS_OR_EQUAL(4 * IGC::G_RECORD_SIZE + 1, stats.bytes_read);
+  TEST_ASSERT_TRUE(readFile("f.igc") == signed_file);
+
+  // power lost in the middle of a record: re-hashed in sectors, the
+  // partial record is replaced by the G-record
+  writeFile("g.igc", records + "B1000");
+  HAL::hostFsResetStats();
+  TEST_ASSERT_TRUE(igc_file_writer::recover("g.igc"));
+  HAL::hostFsStats(stats);
+  reportRecover("unsigned", stats, records.size() + 5);
+  TEST_ASSERT_TRUE(readFile("g.igc") == signed_file);
+  TEST_ASSERT_LESS_OR_EQUAL(records.size() / 512 + 3, stats.reads);
+
+  // pre-allocated and never truncated
+  writeFile("h.igc", records + std::string(65536, '\0'));
+  TEST_ASSERT_TRUE(igc_file_writer::recover("h.igc"));
+  TEST_ASSERT_TRUE(readFile("h.igc") == signed_file);
+
+  // a wrong G-record is not repaired, but fails verify()
+  std::string forged = signed_file;
+  forged[100] = 'X';
+  writeFile("i.igc", forged);
+  TEST_ASSERT_FALSE(igc_file_writer::recover("i.igc"));
+  TEST_ASSERT_FALSE(igc_file_writer::verify("i.igc"));
+}
+
+void test_discard()
+{
+  // takeoff not confirmed: the file goes, staged records and G-record
+  // are not written
+  createFile("j.igc");
+  igc_file_writer writer("j.igc", true, true, 0, 0, true, 0);
+  record_t record;
+  bRecord(record, 0);
+  TEST_ASSERT_TRUE(writer.append(header));
+  TEST_ASSERT_TRUE(writer.sync());
+  TEST_ASSERT_TRUE(writer.append(record));
+  HAL::hostFsResetStats();
+  writer.discard();
+  HAL::fs_stats_t stats;
+  HAL::hostFsStats(stats);
+  TEST_ASSERT_EQUAL(0, stats.writes);
+  TEST_ASSERT_FALSE(HAL::fsExists("j.igc"));
+
+  // the next flight with the same writer
+  createFile("k.igc");
+  writer.reset("k.igc");
+  TEST_ASSERT_FALSE(HAL::fsExists("j.igc"));
+  writeFlight(writer, 10);
+  TEST_ASSERT_TRUE(igc_file_writer::verify("k.igc"));
+}
+
+int main()
+{
+  UNITY_BEGIN();
+  TEST_ASSERT_NOT_NULL(mkdtemp(card));
+  RUN_TEST(test_keep_open_writes_same_file);
+  RUN_TEST(test_deferred_grecord_same_file);
+  RUN_TEST(test_write_errors_are_reported);
+  RUN_TEST(test_recover);
+  RUN_TEST(test_discard);
+  return UNITY_END();
+}
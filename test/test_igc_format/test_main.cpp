@@ -0,0 +1,169 @@
+#include <unity.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include "igc_format.h"
+
+// Fixed-point B record formatting against the sprintf() version it
+// replaced: random fixes over the whole range of every field must give
+// the same record, and the time per record is reported.
+
+// "%0<width>d" and keep the first width chars, like the memcpy() of the
+// former sprintf() code
+static void printField(char *dst, uint8_t width, long value)
+{
+  char tmp[16];
+  snprintf(tmp, sizeof(tmp), "%0*ld", width, value);
+  memcpy(dst, tmp, width);
+}
+
+static void printPosition(char *dst, uint8_t width, uint32_t milli_minutes, char hemisphere)
+{
+  const uint32_t deg = milli_minutes / 60000;
+  const uint32_t rest = milli_minutes % 60000;
+  printField(dst, width, deg);
+  printField(dst + width, 2, rest / 1000);
+  printField(dst + width + 2, 3, rest % 1000);
+  dst[width + 5] = hemisphere;
+}
+
+static void sprintfBRecord(const IGC::fix_t &fix, IGC::igc_t &igc)
+{
+  memset(&igc, 0, sizeof(igc));
+  igc.b = 'B';
+  printField(&igc.time[0], 2, fix.hour);
+  printField(&igc.time[2], 2, fix.minute);
+  printField(&igc.time[4], 2, fix.second);
+  printPosition(igc.lat, 2, fix.lat, (fix.flags & IGC::FIX_SOUTH) ? 'S' : 'N');
+  printPosition(igc.lng, 3, fix.lng, (fix.flags & IGC::FIX_WEST) ? 'W' : 'E');
+  igc.a = 'A';
+  printField(igc.pAlt, 5, fix.pAlt);
+  printField(igc.gAlt, 5, fix.gAlt);
+  printField(igc.fxa, 3, fix.fxa);
+  printField(igc.siu, 2, fix.siu);
+}
+
+static IGC::fix_t randomFix()
+{
+  IGC::fix_t fix;
+  fix.hour = rand() % 24;
+  fix.minute = rand() % 60;
+  fix.second = rand() % 60;
+  fix.flags = rand() % 4;
+  fix.lat = rand() % (90 * 60000 + 1);
+  fix.lng = rand() % (180 * 60000 + 1);
+  // whole int16/uint16/uint8 range, including values wider than the field
+  fix.pAlt = (int16_t) rand();
+  fix.gAlt = (int16_t) rand();
+  fix.fxa = (uint16_t) rand();
+  fix.siu = (uint8_t) rand();
+  return fix;
+}
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+}
+
+void test_fuzz_against_sprintf()
+{
+  srand(1);
+  for (uint32_t i = 0; i < 200000; i++)
+  {
+    const IGC::fix_t fix = randomFix();
+    IGC::igc_t want, got;
+    sprintfBRecord(fix, want);
+    memset(&got, 0x55, sizeof(got));
+    IGC::formatBRecord(fix, got);
+    TEST_ASSERT_EQUAL_STRING(want.raw, got.raw);
+  }
+}
+
+void test_field_limits()
+{
+  static const int16_t alts[] = { 0, 1, -1, 9, -9, 9999, -9999, 10000, 20000, -10000, 32767, -32768 };
+  static const uint16_t fxas[] = { 0, 1, 999, 1000, 65535 };
+  static const uint32_t positions[] = { 0, 1, 59999, 60000, 89 * 60000 + 59999, 90 * 60000,
+                                        179 * 60000 + 59999, 180 * 60000 };
+  for (int16_t alt : alts)
+  {
+    for (uint16_t fxa : fxas)
+    {
+      for (uint32_t pos : positions)
+      {
+        IGC::fix_t fix = { 23, 59, 59, IGC::FIX_SOUTH | IGC::FIX_WEST,
+                           pos % (90 * 60000 + 1), pos, alt, (int16_t) -alt, fxa, 99 };
+        IGC::igc_t want, got;
+        sprintfBRecord(fix, want);
+        IGC::formatBRecord(fix, got);
+        TEST_ASSERT_EQUAL_STRING(want.raw, got.raw);
+        TEST_ASSERT_EQUAL(sizeof(got.raw) - 1, strlen(got.raw));
+      }
+    }
+  }
+}
+
+void test_degrees_to_milli_minutes()
+{
+  // truncated, not rounded: 52.999999999 deg is 52 deg 59.999 min
+  TEST_ASSERT_EQUAL_UINT32(52 * 60000 + 59999, IGC::degreesToMilliMinutes(52, 999999999));
+  TEST_ASSERT_EQUAL_UINT32(0, IGC::degreesToMilliMinutes(0, 16666));
+  TEST_ASSERT_EQUAL_UINT32(1, IGC::degreesToMilliMinutes(0, 16667));
+  srand(2);
+  for (uint32_t i = 0; i < 200000; i++)
+  {
+    const uint16_t deg = rand() % 181;
+    const uint32_t billionths = rand() % 1000000000;
+    const uint32_t want = deg * 60000 + (uint32_t) ((uint64_t) billionths * 60000 / 1000000000);
+    TEST_ASSERT_EQUAL_UINT32(want, IGC::degreesToMilliMinutes(deg, billionths));
+  }
+}
+
+void test_format_cost()
+{
+  using namespace std::chrono;
+  const uint32_t records = 100000;
+  static IGC::fix_t fixes[1024];
+  srand(3);
+  for (IGC::fix_t &fix : fixes)
+  {
+    fix = randomFix();
+  }
+  IGC::igc_t igc;
+  uint32_t check = 0;
+  const steady_clock::time_point t0 = steady_clock::now();
+  for (uint32_t i = 0; i < records; i++)
+  {
+    sprintfBRecord(fixes[i % 1024], igc);
+    check += igc.raw[i % 40];
+  }
+  const steady_clock::time_point t1 = steady_clock::now();
+  for (uint32_t i = 0; i < records; i++)
+  {
+    IGC::formatBRecord(fixes[i % 1024], igc);
+    check -= igc.raw[i % 40];
+  }
+  const steady_clock::time_point t2 = steady_clock::now();
+  TEST_ASSERT_EQUAL_UINT32(0, check);
+
+  const double printf_ns = duration_cast<nanoseconds>(t1 - t0).count() / (double) records;
+  const double fixed_ns = duration_cast<nanoseconds>(t2 - t1).count() / (double) records;
+  char message[120];
+  snprintf(message, sizeof(message), "B record: %.0f ns sprintf, %.0f ns fixed point (%.1fx)",
+           printf_ns, fixed_ns, printf_ns / fixed_ns);
+  TEST_MESSAGE(message);
+}
+
+int main()
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_fuzz_against_sprintf);
+  RUN_TEST(test_field_limits);
+  RUN_TEST(test_degrees_to_milli_minutes);
+  RUN_TEST(test_format_cost);
+  return UNITY_END();
+}
@@ -0,0 +1,179 @@
+#include <unity.h>
+#include <Arduino.h>
+#include <EEPROM.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <sys/stat.h>
+#include "hal.h"
+#include "index.h"
+#include "eeprom_layout.h"
+
+// The IGC file counter over thousands of simulated boots: every boot reads
+// the counter, every flight reserves a number, creates the file and
+// commits the number when the file is closed. The card operations come
+// from HAL::hostFsStats(), the EEPROM writes from comparing the EEPROM
+// before and after (EEPROM.put() only writes the bytes that change).
+
+static char card[] = "/tmp/igc_index_XXXXXX";
+
+static uint32_t cell_writes[NATIVE_EEPROM_SIZE];
+static uint8_t before[NATIVE_EEPROM_SIZE];
+
+static void snapshot()
+{
+  memcpy(before, EEPROMClass::data(), NATIVE_EEPROM_SIZE);
+}
+
+// EEPROM bytes written since snapshot()
+static uint32_t countWrites()
+{
+  uint32_t writes = 0;
+  for (uint16_t i = 0; i < NATIVE_EEPROM_SIZE; i++)
+  {
+    if (EEPROMClass::data()[i] != before[i])
+    {
+      cell_writes[i]++;
+      writes++;
+    }
+  }
+  return writes;
+}
+
+// the flight's file, created on the host so it does not count
+static void createFlight(const char *folder, int index)
+{
+  char path[80];
+  snprintf(path, sizeof(path), "%s/%s", card, folder);
+  mkdir(path, 0777);
+  snprintf(path, sizeof(path), "%s/%s/lg%03d.igc", card, folder, index);
+  FILE *fp = fopen(path, "w");
+  TEST_ASSERT_NOT_NULL(fp);
+  fclose(fp);
+}
+
+void setUp()
+{
+  HAL::hostBegin(card, false);
+  memset(EEPROMClass::data(), 0xff, NATIVE_EEPROM_SIZE);
+  memset(cell_writes, 0, sizeof(cell_writes));
+}
+
+void tearDown()
+{
+}
+
+void test_boots_and_flights()
+{
+  // 5000 boots, a flight on every other one, three flights a day
+  const uint32_t boots = 5000;
+  uint32_t flights = 0;
+  uint32_t boot_writes = 0;
+  uint32_t flight_writes = 0;
+  int last = -1;
+  HAL::fs_stats_t stats;
+  HAL::hostFsResetStats();
+  for (uint32_t boot = 0; boot < boots; boot++)
+  {
+    snapshot();
+    const uint32_t counter = ReadFileCounter();
+    boot_writes += countWrites();
+    TEST_ASSERT_EQUAL(flights, counter);
+    if (boot % 2)
+    {
+      continue;
+    }
+    char folder[16];
+    snprintf(folder, sizeof(folder), "2026%04lu", (unsigned long) (flights / 3));
+    snapshot();
+    const int index = ReserveFileIndex(folder);
+    createFlight(folder, index);
+    CommitFileIndex();
+    flight_writes += countWrites();
+    TEST_ASSERT_EQUAL((last + 1) % 1000, index);
+    last = index;
+    flights++;
+  }
+  HAL::hostFsStats(stats);
+
+  uint32_t max_cell = 0;
+  for (uint32_t writes : cell_writes)
+  {
+    max_cell = writes > max_cell ? writes : max_cell;
+  }
+  char message[200];
+  snprintf(message, sizeof(message),
+           "%lu boots, %lu flights: %lu EEPROM bytes written at boot, %.1f per flight, "
+           "max %lu writes per cell; card %lu writes, %.1f opens per flight",
+           (unsigned long) boots, (unsigned long) flights, (unsigned long) boot_writes,
+           (double) flight_writes / flights, (unsigned long) max_cell,
+           (unsigned long) stats.writes, (double) stats.opens / flights);
+  TEST_MESSAGE(message);
+
+  // reading the counter writes nothing, a flight one slot, spread over
+  // all slots; the card is only read
+  TEST_ASSERT_EQUAL(0, boot_writes);
+  TEST_ASSERT_LESS_OR_EQUAL(flights * sizeof(uint32_t) * 2, flight_writes);
+  TEST_ASSERT_LESS_OR_EQUAL(flights / EEPROM_INDEX_SLOTS + 1, max_cell);
+  TEST_ASSERT_EQUAL(0, stats.writes);
+  TEST_ASSERT_FALSE(HAL::fsExists("index.txt"));
+}
+
+void test_taken_numbers_are_skipped()
+{
+  // counter lost (new EEPROM) on a day with flights: one folder scan,
+  // the first free number
+  for (int i = 0; i < 5; i++)
+  {
+    createFlight("20260817", i);
+  }
+  HAL::hostFsResetStats();
+  TEST_ASSERT_EQUAL(5, ReserveFileIndex("20260817"));
+  CommitFileIndex();
+  TEST_ASSERT_EQUAL(6, ReadFileCounter());
+  createFlight("20260817", 5);
+  TEST_ASSERT_EQUAL(6, ReserveFileIndex("20260817"));
+  HAL::fs_stats_t stats;
+  HAL::hostFsStats(stats);
+  TEST_ASSERT_EQUAL(0, stats.writes);
+}
+
+void test_index_file_fallback()
+{
+  // index.txt of older firmware continues the count
+  HAL::File index = HAL::fsOpen("index.txt", O_WRITE | O_CREAT | O_TRUNC);
+  TEST_ASSERT_TRUE(index);
+  index.println(41);
+  index.close();
+  TEST_ASSERT_EQUAL(41, ReadFileCounter());
+  TEST_ASSERT_EQUAL(41, ReserveFileIndex("20260818"));
+  CommitFileIndex();
+  TEST_ASSERT_EQUAL(42, ReadFileCounter());
+  HAL::fsRemove("index.txt");
+}
+
+void test_uncommitted_number_is_reused()
+{
+  // false alarm: the file is deleted and the counter not written, the
+  // next takeoff gets the same number
+  snapshot();
+  TEST_ASSERT_EQUAL(0, ReserveFileIndex("20260819"));
+  TEST_ASSERT_EQUAL(0, countWrites());
+  TEST_ASSERT_EQUAL(0, ReserveFileIndex("20260819"));
+  // power lost in flight: the file is there, the counter not written
+  createFlight("20260819", 0);
+  TEST_ASSERT_EQUAL(1, ReserveFileIndex("20260819"));
+  CommitFileIndex();
+  TEST_ASSERT_EQUAL(2, ReadFileCounter());
+}
+
+int main()
+{
+  UNITY_BEGIN();
+  TEST_ASSERT_NOT_NULL(mkdtemp(card));
+  RUN_TEST(test_boots_and_flights);
+  RUN_TEST(test_taken_numbers_are_skipped);
+  RUN_TEST(test_index_file_fallback);
+  RUN_TEST(test_uncommitted_number_is_reused);
+  return UNITY_END();
+}
@@ -0,0 +1,322 @@
+#include <unity.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <chrono>
+#include <string>
+#include <vector>
+#include "igc_journal.h"
+#include "igc_format.h"
+#include "igc_grecord.h"
+#include "journal_igc.h"
+
+// Flight journal round trip: fixes encoded like the logger does in
+// journal mode, expanded by bin2igc's converter, must give the B records
+// the text mode writes, byte for byte. Also reports size and speed.
+
+static const char *const header[] =
+{
+  "AXLK001",
+  "HFDTE170826",
+  "HFGTYGLIDERTYPE:ASK-21, $*!~",
+  "I023638FXA3940SIU",
+};
+
+// position in signed thousandths of minutes, north/east positive
+typedef struct
+{
+  long lat;
+  long lng;
+} position_t;
+
+static IGC::fix_t makeFix(uint32_t time, const position_t &pos, int pAlt, int gAlt,
+                          uint16_t fxa, uint8_t siu)
+{
+  IGC::fix_t fix;
+  time %= 86400UL;
+  fix.hour = time / 3600;
+  fix.minute = time / 60 % 60;
+  fix.second = time % 60;
+  fix.flags = (pos.lat < 0 ? IGC::FIX_SOUTH : 0) | (pos.lng < 0 ? IGC::FIX_WEST : 0);
+  fix.lat = labs(pos.lat);
+  fix.lng = labs(pos.lng);
+  fix.pAlt = pAlt;
+  fix.gAlt = gAlt;
+  fix.fxa = fxa;
+  fix.siu = siu;
+  return fix;
+}
+
+// cruise and thermal flying at a fixed interval, 1 m = 0.54 thousandths
+// of a minute of latitude
+static void cruiseAndThermal(std::vector<IGC::fix_t> &fixes, uint32_t count,
+                             uint32_t interval, uint32_t time = 36000)
+{
+  position_t pos = { 52 * 60000L, 5 * 60000L };
+  double heading = 0, alt = 500;
+  for (uint32_t i = 0; i < count; i++, time += interval)
+  {
+    const bool thermal = (i / 300) % 2;
+    heading += thermal ? 20.0 * interval : 0.2 * interval;
+    alt += (thermal ? 2.0 : -1.0) * interval;
+    const double d = 25.0 * interval * 0.54;
+    pos.lat += lround(d * cos(heading * M_PI / 180));
+    pos.lng += lround(d * sin(heading * M_PI / 180) / cos(52 * M_PI / 180));
+    fixes.push_back(makeFix(time, pos, (int) alt, (int) alt + 40, 3 + i % 4, 9 + (i / 100) % 3));
+  }
+}
+
+// the awkward cases: crossing the equator and the prime meridian (sign
+// flips, keyframes), jumps larger than any varint byte count, extreme
+// altitudes, step changes, a long gap and midnight
+static void edgeCases(std::vector<IGC::fix_t> &fixes)
+{
+  position_t pos = { -30, -30 };
+  uint32_t time = 86400UL - 200;
+  for (int i = 0; i < 200; i++)
+  {
+    pos.lat += 1;
+    pos.lng += 1;
+    time += (i % 50 == 49) ? 4 : 1;
+    fixes.push_back(makeFix(time, pos, -20 + i, 30 - i, 5, 8));
+  }
+  static const position_t jumps[] =
+  {
+    { 89 * 60000L + 59999, 179 * 60000L + 59999 },
+    { -89 * 60000L, -179 * 60000L },
+    { 45 * 60000L, 179 * 60000L },
+    { 45 * 60000L + 1, -179 * 60000L - 1 },
+    { 0, 0 },
+  };
+  static const int alts[] = { 9999, -9999, 0, 32767, -32768 };
+  for (size_t i = 0; i < sizeof(jumps) / sizeof(jumps[0]); i++)
+  {
+    time += 400;
+    fixes.push_back(makeFix(time, jumps[i], alts[i], -alts[i], 999, 99));
+    fixes.push_back(makeFix(time + 1, jumps[i], alts[i], alts[i], 1, 0));
+  }
+  // more than JOURNAL_KEY_INTERVAL fixes without a sign change
+  for (int i = 0; i < 3 * IGC::JOURNAL_KEY_INTERVAL + 7; i++)
+  {
+    pos.lat += (i % 2) ? 1000 : -999;
+    pos.lng += (i % 3) ? 50000 : -70000;
+    time += 1 + (i % 7 == 0);
+    fixes.push_back(makeFix(time, pos, 1000 + 1000 * (i % 2), 1000, 10 + (i % 2), 12));
+  }
+}
+
+static std::vector<uint8_t> encode(const std::vector<IGC::fix_t> &fixes)
+{
+  std::vector<uint8_t> data(IGC::JOURNAL_HEADER_SIZE);
+  IGC::journalHeader(data.data());
+  for (const char *line : header)
+  {
+    uint8_t entry[2 + 255];
+    const uint16_t size = IGC::journalText(line, entry);
+    data.insert(data.end(), entry, entry + size);
+  }
+  IGC::journal_t journal;
+  IGC::journalBegin(journal);
+  for (const IGC::fix_t &fix : fixes)
+  {
+    uint8_t entry[IGC::JOURNAL_FIX_MAX];
+    const uint8_t size = IGC::journalFix(journal, fix, entry);
+    TEST_ASSERT_LESS_OR_EQUAL(IGC::JOURNAL_FIX_MAX, size);
+    data.insert(data.end(), entry, entry + size);
+  }
+  return data;
+}
+
+// the IGC file of the text mode: records formatted from the fixes,
+// hashed in one piece
+static std::string textMode(const std::vector<IGC::fix_t> &fixes)
+{
+  std::string igc;
+  for (const char *line : header)
+  {
+    igc += line;
+    igc += "\r\n";
+  }
+  for (const IGC::fix_t &fix : fixes)
+  {
+    IGC::igc_t b;
+    IGC::formatBRecord(fix, b);
+    igc += b.raw;
+    igc += "\r\n";
+  }
+  MD5::MD5_CTX md5[4];
+  IGC::initGRecord(md5[0], md5[1], md5[2], md5[3]);
+  void *const lanes[4] = { &md5[0], &md5[1], &md5[2], &md5[3] };
+  IGC::cleanRecord(&igc[0], igc.size(), lanes);
+  for (const MD5::MD5_CTX &ctx : md5)
+  {
+    char line[IGC::G_RECORD_SIZE + 1];
+    IGC::formatGRecord(ctx, line);
+    igc += line;
+  }
+  return igc;
+}
+
+// B records of an IGC file, one string per record
+static std::vector<std::string> bRecords(const std::string &igc)
+{
+  std::vector<std::string> records;
+  size_t pos = 0, end;
+  while ((end = igc.find("\r\n", pos)) != std::string::npos)
+  {
+    if (igc[pos] == 'B')
+    {
+      records.push_back(igc.substr(pos, end - pos));
+    }
+    pos = end + 2;
+  }
+  return records;
+}
+
+static void roundTrip(const std::vector<IGC::fix_t> &fixes)
+{
+  std::string igc;
+  IGC::journal_stats_t stats;
+  TEST_ASSERT_TRUE(IGC::journalToIgc(encode(fixes), igc, stats));
+  TEST_ASSERT_EQUAL(sizeof(header) / sizeof(header[0]), stats.records);
+  TEST_ASSERT_EQUAL(fixes.size(), stats.fixes);
+  TEST_ASSERT_EQUAL(0, stats.skipped);
+
+  const std::string expected = textMode(fixes);
+  const std::vector<std::string> want = bRecords(expected);
+  const std::vector<std::string> got = bRecords(igc);
+  TEST_ASSERT_EQUAL(want.size(), got.size());
+  for (size_t i = 0; i < want.size(); i++)
+  {
+    TEST_ASSERT_EQUAL_STRING_MESSAGE(want[i].c_str(), got[i].c_str(), "B record");
+  }
+  // headers and G-record as well
+  TEST_ASSERT_TRUE(expected == igc);
+}
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+}
+
+void test_round_trip_cruise_thermal()
+{
+  for (uint32_t interval : { 1, 2, 4 })
+  {
+    std::vector<IGC::fix_t> fixes;
+    cruiseAndThermal(fixes, 1000, interval);
+    roundTrip(fixes);
+  }
+}
+
+void test_round_trip_edge_cases()
+{
+  std::vector<IGC::fix_t> fixes;
+  edgeCases(fixes);
+  roundTrip(fixes);
+}
+
+void test_keyframes()
+{
+  // a keyframe for the first fix, every JOURNAL_KEY_INTERVAL fixes and on
+  // every hemisphere change
+  std::vector<IGC::fix_t> fixes;
+  edgeCases(fixes);
+  IGC::journal_t journal;
+  IGC::journalBegin(journal);
+  uint16_t since_key = 0;
+  for (size_t i = 0; i < fixes.size(); i++)
+  {
+    uint8_t entry[IGC::JOURNAL_FIX_MAX];
+    IGC::journalFix(journal, fixes[i], entry);
+    const bool key = i == 0 || since_key >= IGC::JOURNAL_KEY_INTERVAL ||
+                     fixes[i].flags != fixes[i - 1].flags;
+    TEST_ASSERT_EQUAL(key, entry[0] == IGC::JOURNAL_KEY);
+    since_key = key ? 0 : since_key + 1;
+  }
+}
+
+void test_damaged_journal_resyncs()
+{
+  std::vector<IGC::fix_t> fixes;
+  cruiseAndThermal(fixes, 4 * IGC::JOURNAL_KEY_INTERVAL, 1);
+  std::vector<uint8_t> data = encode(fixes);
+  // overwrite a few bytes in the second key interval
+  const size_t damage = data.size() * 3 / 8;
+  memset(&data[damage], 0xFF, 6);
+
+  std::string igc;
+  IGC::journal_stats_t stats;
+  TEST_ASSERT_TRUE(IGC::journalToIgc(data, igc, stats));
+  TEST_ASSERT_GREATER_THAN(0, stats.skipped);
+  TEST_ASSERT_LESS_THAN(fixes.size(), stats.fixes);
+  // the fixes before the damage are decoded, and after it decoding goes on
+  // at the next keyframe: the first and the last key interval are intact
+  const std::vector<std::string> want = bRecords(textMode(fixes));
+  const std::vector<std::string> got = bRecords(igc);
+  TEST_ASSERT_GREATER_OR_EQUAL(2 * IGC::JOURNAL_KEY_INTERVAL, got.size());
+  for (size_t i = 0; i < IGC::JOURNAL_KEY_INTERVAL; i++)
+  {
+    TEST_ASSERT_EQUAL_STRING(want[i].c_str(), got[i].c_str());
+    TEST_ASSERT_EQUAL_STRING(want[want.size() - 1 - i].c_str(), got[got.size() - 1 - i].c_str());
+  }
+}
+
+void test_padding_ends_journal()
+{
+  // pre-allocated file: zeros after the last entry
+  std::vector<IGC::fix_t> fixes;
+  cruiseAndThermal(fixes, 100, 1);
+  std::vector<uint8_t> data = encode(fixes);
+  data.resize(data.size() + 4096, 0);
+  std::string igc;
+  IGC::journal_stats_t stats;
+  TEST_ASSERT_TRUE(IGC::journalToIgc(data, igc, stats));
+  TEST_ASSERT_EQUAL(100, stats.fixes);
+  TEST_ASSERT_EQUAL(0, stats.skipped);
+}
+
+void test_size_and_speed()
+{
+  using namespace std::chrono;
+  for (uint32_t interval : { 1, 2, 4 })
+  {
+    std::vector<IGC::fix_t> fixes;
+    cruiseAndThermal(fixes, 36000, interval);
+
+    const steady_clock::time_point t0 = steady_clock::now();
+    std::vector<uint8_t> data = encode(fixes);
+    const steady_clock::time_point t1 = steady_clock::now();
+    std::string igc;
+    IGC::journal_stats_t stats;
+    TEST_ASSERT_TRUE(IGC::journalToIgc(data, igc, stats));
+    const steady_clock::time_point t2 = steady_clock::now();
+    TEST_ASSERT_EQUAL(fixes.size(), stats.fixes);
+
+    const double per_fix = (double) (data.size() - IGC::JOURNAL_HEADER_SIZE) / fixes.size();
+    char message[160];
+    snprintf(message, sizeof(message),
+             "interval %lu s: %.2f bytes per fix (B record %u), encode %.0f ns, bin2igc %.0f ns per fix",
+             (unsigned long) interval, per_fix, (unsigned) (sizeof(IGC::igc_t) - 1 + 2),
+             duration_cast<nanoseconds>(t1 - t0).count() / (double) fixes.size(),
+             duration_cast<nanoseconds>(t2 - t1).count() / (double) fixes.size());
+    TEST_MESSAGE(message);
+    // the journal is meant to be several times smaller than the text
+    TEST_ASSERT_LESS_THAN(8.0, per_fix);
+  }
+}
+
+int main()
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_round_trip_cruise_thermal);
+  RUN_TEST(test_round_trip_edge_cases);
+  RUN_TEST(test_keyframes);
+  RUN_TEST(test_damaged_journal_resyncs);
+  RUN_TEST(test_padding_ends_journal);
+  RUN_TEST(test_size_and_speed);
+  return UNITY_END();
+}
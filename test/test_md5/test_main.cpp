@@ -0,0 +1,300 @@
+#include <unity.h>
+#include <string.h>
+#include <stdio.h>
+#include <chrono>
+#include "MD5.h"
+#include "igc_grecord.h"
+
+// MD5 library (decode, rounds, MD5Update4) against the RFC 1321 test
+// suite, and the LK8000 G-record of a reference IGC file.
+
+static const char *const rfc1321[][2] =
+{
+  { "", "d41d8cd98f00b204e9800998ecf8427e" },
+  { "a", "0cc175b9c0f1b6a831c399e269772661" },
+  { "abc", "900150983cd24fb0d6963f7d28e17f72" },
+  { "message digest", "f96b697d7cb7938d525a2f31aaf161d0" },
+  { "abcdefghijklmnopqrstuvwxyz", "c3fcd3d76192e4007dfb496cca67e13b" },
+  { "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789",
+    "d174ab98d277d9f5a5611c2c9f419d9f" },
+  { "12345678901234567890123456789012345678901234567890123456789012345678901234567890",
+    "57edf4a22be3c955ac49da2e2107b67a" },
+};
+
+// reference flight, signed by an independent MD5 implementation with the
+// LK8000 start values. The GTY header holds characters that are not valid
+// in IGC files, they are hashed as spaces.
+static const char reference_igc[] =
+  "AXLK001\r\n"
+  "HFDTE170826\r\n"
+  "HFFXA035\r\n"
+  "HFPLTPILOTINCHARGE:Jan de Vries\r\n"
+  "HFGTYGLIDERTYPE:ASK-21, $*!~\r\n"
+  "HFGIDGLIDERID:PH-123\r\n"
+  "HFDTM100GPSDATUM:WGS-1984\r\n"
+  "HFRFWFIRMWAREVERSION:1.0\r\n"
+  "HFRHWHARDWAREVERSION:1.0\r\n"
+  "HFFTYFRTYPE:Simple IGC Logger\r\n"
+  "HFGPS:uBlox NEO-6M,50,max9000m\r\n"
+  "HFPRSPRESSALTSENSOR:Bosch,BMP280,9000m\r\n"
+  "I023638FXA3940SIU\r\n"
+  "B1000005206000N00512000EA001200016003509\r\n"
+  "B1000025206000N00512000EA001230016303509\r\n"
+  "B1000045206000N00512000EA001260016603509\r\n"
+  "B1000065206000N00512000EA001290016903509\r\n"
+  "B1000085206000N00512000EA001320017203509\r\n"
+  "B1000105206000N00512000EA001350017503509\r\n"
+  "B1000125206000N00512000EA001380017803509\r\n"
+  "B1000145206000N00512000EA001410018103509\r\n"
+  "B1000165206000N00512000EA001440018403509\r\n"
+  "B1000185206000N00512000EA001470018703509\r\n"
+  "B1000205206000N00512000EA001500019003509\r\n"
+  "B1000225206000N00512000EA001530019303509\r\n"
+  "B1000245206000N00512000EA001560019603509\r\n"
+  "B1000265206000N00512000EA001590019903509\r\n"
+  "B1000285206000N00512000EA001620020203509\r\n"
+  "B1000305206000N00512000EA001650020503509\r\n"
+  "B1000325206000N00512000EA001680020803509\r\n"
+  "B1000345206000N00512000EA001710021103509\r\n"
+  "B1000365206000N00512000EA001740021403509\r\n"
+  "B1000385206000N00512000EA001770021703509\r\n"
+  "B1000405206000N00512000EA001800022003509\r\n"
+  "B1000425206000N00512000EA001830022303509\r\n"
+  "B1000445206000N00512000EA001860022603509\r\n"
+  "B1000465206000N00512000EA001890022903509\r\n"
+  "B1000485206000N00512000EA001920023203509\r\n"
+  "B1000505206000N00512000EA001950023503509\r\n"
+  "B1000525206000N00512000EA001980023803509\r\n"
+  "B1000545206000N00512000EA002010024103509\r\n"
+  "B1000565206000N00512000EA002040024403509\r\n"
+  "B1000585206000N00512000EA002070024703509\r\n"
+  "B1001005206000N00512000EA002100025003509\r\n"
+  "B1001025206000N00512000EA002130025303509\r\n"
+  "B1001045206000N00512000EA002160025603509\r\n"
+  "B1001065206000N00512000EA002190025903509\r\n"
+  "B1001085206000N00512000EA002220026203509\r\n"
+  "B1001105206000N00512000EA002250026503509\r\n"
+  "B1001125206000N00512000EA002280026803509\r\n"
+  "B1001145206000N00512000EA002310027103509\r\n"
+  "B1001165206000N00512000EA002340027403509\r\n"
+  "B1001185206000N00512000EA002370027703509\r\n";
+
+static const char reference_grecord[] =
+  "G58e527032b4e1e14\r\n"
+  "Ge7aa6c4284108fad\r\n"
+  "G06b5db9293b6c00b\r\n"
+  "G4541f762d0c995be\r\n"
+  "G361620f9fe1dccd7\r\n"
+  "Gfab8c0e413cf2bff\r\n"
+  "Ge4014b293e7545d5\r\n"
+  "G74c626966ec78251\r\n";
+
+static void digest(char (&md5str)[33], MD5::MD5_CTX &ctx)
+{
+  unsigned char hash[16];
+  MD5::MD5::MD5Final(hash, &ctx);
+  MD5::MD5::make_digest(md5str, hash, 16);
+}
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+}
+
+void test_rfc1321_vectors()
+{
+  for (const auto &v : rfc1321)
+  {
+    unsigned char hash[16];
+    char md5str[33];
+    MD5::MD5::make_hash(hash, v[0], strlen(v[0]));
+    MD5::MD5::make_digest(md5str, hash, 16);
+    TEST_ASSERT_EQUAL_STRING_MESSAGE(v[1], md5str, v[0]);
+  }
+}
+
+void test_rfc1321_vectors_chunked()
+{
+  // every split of the input into two updates, so the buffered and the
+  // block-wise paths of MD5Update both run
+  for (const auto &v : rfc1321)
+  {
+    const size_t len = strlen(v[0]);
+    for (size_t split = 0; split <= len; split++)
+    {
+      MD5::MD5_CTX ctx;
+      char md5str[33];
+      MD5::MD5::MD5Init(&ctx);
+      MD5::MD5::MD5Update(&ctx, v[0], split);
+      MD5::MD5::MD5Update(&ctx, v[0] + split, len - split);
+      digest(md5str, ctx);
+      TEST_ASSERT_EQUAL_STRING_MESSAGE(v[1], md5str, v[0]);
+    }
+  }
+}
+
+void test_update4_matches_update()
+{
+  // four differently seeded contexts fed in uneven chunks by MD5Update4
+  // must give the same digests as four separate MD5Update runs
+  static const size_t chunks[] = { 1, 63, 64, 65, 7, 128, 0, 200, 3, 57 };
+  char data[700];
+  for (size_t i = 0; i < sizeof(data); i++)
+  {
+    data[i] = (char) (i * 31 + 7);
+  }
+  MD5::MD5_CTX lane[4], single[4];
+  IGC::initGRecord(lane[0], lane[1], lane[2], lane[3]);
+  IGC::initGRecord(single[0], single[1], single[2], single[3]);
+  void *const lanes[4] = { &lane[0], &lane[1], &lane[2], &lane[3] };
+  size_t pos = 0;
+  for (size_t chunk : chunks)
+  {
+    MD5::MD5::MD5Update4(lanes, data + pos, chunk);
+    for (MD5::MD5_CTX &ctx : single)
+    {
+      MD5::MD5::MD5Update(&ctx, data + pos, chunk);
+    }
+    pos += chunk;
+  }
+  TEST_ASSERT_LESS_OR_EQUAL(sizeof(data), pos);
+  for (int i = 0; i < 4; i++)
+  {
+    char a[33], b[33];
+    digest(a, lane[i]);
+    digest(b, single[i]);
+    TEST_ASSERT_EQUAL_STRING(b, a);
+  }
+}
+
+// G-record of the reference file, hashed record by record like the logger
+// or in one piece like recover()
+static void signReference(char *grecord, bool per_record)
+{
+  char igc[sizeof(reference_igc)];
+  memcpy(igc, reference_igc, sizeof(igc));
+  MD5::MD5_CTX md5[4];
+  IGC::initGRecord(md5[0], md5[1], md5[2], md5[3]);
+  void *const lanes[4] = { &md5[0], &md5[1], &md5[2], &md5[3] };
+  if (per_record)
+  {
+    char *record = igc;
+    char *end;
+    while ((end = strchr(record, '\n')) != NULL)
+    {
+      IGC::cleanRecord(record, end + 1 - record, lanes);
+      record = end + 1;
+    }
+  }
+  else
+  {
+    IGC::cleanRecord(igc, strlen(igc), lanes);
+  }
+  grecord[0] = '\0';
+  for (const MD5::MD5_CTX &ctx : md5)
+  {
+    char line[IGC::G_RECORD_SIZE + 1];
+    IGC::formatGRecord(ctx, line);
+    strcat(grecord, line);
+  }
+}
+
+void test_lk8000_grecord_per_record()
+{
+  char grecord[4 * IGC::G_RECORD_SIZE + 1];
+  signReference(grecord, true);
+  TEST_ASSERT_EQUAL_STRING(reference_grecord, grecord);
+}
+
+void test_lk8000_grecord_whole_file()
+{
+  char grecord[4 * IGC::G_RECORD_SIZE + 1];
+  signReference(grecord, false);
+  TEST_ASSERT_EQUAL_STRING(reference_grecord, grecord);
+}
+
+void test_grecord_continues_after_checkpoint()
+{
+  // formatGRecord() must not finalise the context: a checkpoint G-record
+  // in the middle of the file leaves the final one unchanged
+  char igc[sizeof(reference_igc)];
+  memcpy(igc, reference_igc, sizeof(igc));
+  MD5::MD5_CTX md5[4];
+  IGC::initGRecord(md5[0], md5[1], md5[2], md5[3]);
+  void *const lanes[4] = { &md5[0], &md5[1], &md5[2], &md5[3] };
+  const size_t half = strchr(igc + sizeof(igc) / 2, '\n') + 1 - igc;
+  IGC::cleanRecord(igc, half, lanes);
+  char line[IGC::G_RECORD_SIZE + 1];
+  IGC::formatGRecord(md5[2], line);
+  IGC::cleanRecord(igc + half, strlen(igc + half), lanes);
+  IGC::formatGRecord(md5[0], line);
+  TEST_ASSERT_EQUAL_MEMORY(reference_grecord, line, IGC::G_RECORD_SIZE);
+}
+
+void test_blockwise_hash_cost()
+{
+  // per character (four 1-byte MD5Update calls, as the writer did before)
+  // against cleanRecord() with one MD5Update4 per record: same G-record,
+  // time per B record on the host
+  using namespace std::chrono;
+  static const char record[] = "B1000005206000N00512000EA001200016003509\r\n";
+  const uint32_t records = 20000;
+  MD5::MD5_CTX bytewise[4], blockwise[4];
+  IGC::initGRecord(bytewise[0], bytewise[1], bytewise[2], bytewise[3]);
+  IGC::initGRecord(blockwise[0], blockwise[1], blockwise[2], blockwise[3]);
+  void *const lanes[4] = { &blockwise[0], &blockwise[1], &blockwise[2], &blockwise[3] };
+
+  const steady_clock::time_point t0 = steady_clock::now();
+  for (uint32_t i = 0; i < records; i++)
+  {
+    for (const char *p = record; *p; p++)
+    {
+      if (*p != 0x0D && *p != 0x0A)
+      {
+        const char c = IGC::cleanChar(*p);
+        for (MD5::MD5_CTX &ctx : bytewise)
+        {
+          MD5::MD5::MD5Update(&ctx, &c, 1);
+        }
+      }
+    }
+  }
+  const steady_clock::time_point t1 = steady_clock::now();
+  for (uint32_t i = 0; i < records; i++)
+  {
+    char line[sizeof(record)];
+    memcpy(line, record, sizeof(line));
+    IGC::cleanRecord(line, sizeof(line) - 1, lanes);
+  }
+  const steady_clock::time_point t2 = steady_clock::now();
+
+  for (int i = 0; i < 4; i++)
+  {
+    char a[33], b[33];
+    digest(a, bytewise[i]);
+    digest(b, blockwise[i]);
+    TEST_ASSERT_EQUAL_STRING(a, b);
+  }
+  const double bytes = duration_cast<nanoseconds>(t1 - t0).count() / (double) records;
+  const double blocks = duration_cast<nanoseconds>(t2 - t1).count() / (double) records;
+  char message[120];
+  snprintf(message, sizeof(message), "G-record hash per B record: %.0f ns bytewise, %.0f ns blockwise (%.1fx)",
+           bytes, blocks, bytes / blocks);
+  TEST_MESSAGE(message);
+}
+
+int main()
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_rfc1321_vectors);
+  RUN_TEST(test_rfc1321_vectors_chunked);
+  RUN_TEST(test_update4_matches_update);
+  RUN_TEST(test_lk8000_grecord_per_record);
+  RUN_TEST(test_lk8000_grecord_whole_file);
+  RUN_TEST(test_grecord_continues_after_checkpoint);
+  RUN_TEST(test_blockwise_hash_cost);
+  return UNITY_END();
+}
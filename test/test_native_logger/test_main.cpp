@@ -0,0 +1,127 @@
+#include <unity.h>
+#include <Arduino.h>
+#include <stdlib.h>
+#include "hal.h"
+#include "logger.h"
+#include "igc_file_writer.h"
+#include "../replay_trace.h"
+
+// The whole logger on the host: setup() and loop() replay a synthetic
+// flight from <card>/replay, the IGC file must come out signed. The card
+// is a slow one, every write and sync takes card_delay ms.
+
+void setup();
+void loop();
+
+static char card[] = "/tmp/igc_native_XXXXXX";
+
+static const TRACE::phase_t flight[] =
+{
+  { 120,   0.0f,  0.0f,  0.0f },   // on the ground, GPS fix
+  {  20,  40.0f,  0.0f,  0.0f },   // winch launch roll
+  { 300,  90.0f,  3.0f,  0.0f },   // climb
+  { 300,  80.0f,  2.0f, 12.0f },   // thermal
+  { 300, 110.0f, -5.0f,  0.0f },   // glide down to the field
+  {  20,  10.0f,  0.0f,  0.0f },   // landing roll
+  { 120,   0.0f,  0.0f,  0.0f },   // on the ground
+};
+
+static const unsigned long card_delay = 30;
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+}
+
+void test_replay_runs_to_end()
+{
+  TEST_ASSERT_NOT_NULL(mkdtemp(card));
+  std::vector<TRACE::second_t> trace;
+  TEST_ASSERT_TRUE(TRACE::write(card, TRACE_PHASES(flight), trace));
+  HAL::hostBegin(card, false);
+  HAL::hostFsWriteDelay(card_delay);
+  setup();
+  // trace time plus a margin on the virtual clock
+  const unsigned long limit = 2000000;
+  while (!HAL::hostHalted() && HAL::millis() < limit)
+  {
+    loop();
+    HAL::idle();
+  }
+  TEST_ASSERT_TRUE_MESSAGE(HAL::hostHalted(), "replay did not finish");
+}
+
+void test_igc_file_signed()
+{
+  // GPS date 17-08-2026, first file of the day
+  TEST_ASSERT_TRUE(HAL::fsExists("20260817/lg000.igc"));
+  TEST_ASSERT_TRUE(igc_file_writer::verify("20260817/lg000.igc"));
+  TEST_ASSERT_FALSE(HAL::fsExists("20260817/lg001.igc"));
+}
+
+void test_records_cover_flight()
+{
+  HAL::File igc = HAL::fsOpen("20260817/lg000.igc");
+  TEST_ASSERT_TRUE(igc);
+  char line[100];
+  uint32_t records = 0;
+  uint32_t lines = 0;
+  size_t len = 0;
+  int c;
+  while ((c = igc.read()) >= 0)
+  {
+    if (len < sizeof(line) - 1)
+    {
+      line[len++] = c;
+    }
+    if (c == '\n')
+    {
+      line[len] = '\0';
+      if (lines++ == 0)
+      {
+        TEST_ASSERT_EQUAL_STRING("AXLK001\r\n", line);
+      }
+      if (line[0] == 'B')
+      {
+        // B HHMMSS DDMMmmmN DDDMMmmmE A PPPPP GGGGG FXA SIU
+        TEST_ASSERT_EQUAL(42, len);
+        records++;
+      }
+      len = 0;
+    }
+  }
+  igc.close();
+  // every 2 s (default log_interval) while moving, less the takeoff and
+  // landing detection times, plus the fixes kept from before takeoff
+  const uint32_t flight_seconds = TRACE::movingSeconds(TRACE_PHASES(flight));
+  TEST_ASSERT_GREATER_THAN(flight_seconds / 2 - 60, records);
+  TEST_ASSERT_LESS_THAN(flight_seconds / 2 + 60, records);
+}
+
+void test_slow_card_loses_no_records()
+{
+  // the B record queue absorbs the card latency: nothing dropped, nothing
+  // waits longer than twice the flush interval
+  const IGC::record_stats_t &stats = IGC::getRecordStats();
+  TEST_ASSERT_GREATER_THAN(0, stats.written);
+  TEST_ASSERT_EQUAL(stats.queued, stats.written);
+  TEST_ASSERT_EQUAL(0, stats.dropped);
+  TEST_ASSERT_EQUAL(0, stats.late);
+  char message[100];
+  snprintf(message, sizeof(message), "%lu ms per card access: max flush %lu ms, max queued %u bytes",
+           card_delay, stats.max_flush_ms, stats.max_used);
+  TEST_MESSAGE(message);
+}
+
+int main()
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_replay_runs_to_end);
+  RUN_TEST(test_igc_file_signed);
+  RUN_TEST(test_records_cover_flight);
+  RUN_TEST(test_slow_card_loses_no_records);
+  return UNITY_END();
+}
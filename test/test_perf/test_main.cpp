@@ -0,0 +1,168 @@
+#include <unity.h>
+#include <Arduino.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <chrono>
+#include "hal.h"
+#include "perf.h"
+#include "../replay_trace.h"
+
+// The stage timings through perf.csv: the statistics and buckets of
+// PERF::add(), and PERF_START/PERF_STOP across the 2^32 us wrap of
+// micros(), on its own and in a replayed flight.
+
+void setup();
+void loop();
+
+static char card[] = "/tmp/igc_perf_XXXXXX";
+
+// columns of a stage in perf.csv
+typedef struct
+{
+  unsigned long count;
+  unsigned long min_us;
+  unsigned long max_us;
+  unsigned long mean_us;
+  unsigned long buckets[PERF::BUCKETS];
+} stage_row_t;
+
+static bool readStage(const char *name, stage_row_t &row)
+{
+  const std::string path = std::string(card) + "/perf.csv";
+  FILE *fp = fopen(path.c_str(), "r");
+  TEST_ASSERT_NOT_NULL(fp);
+  char line[256];
+  bool found = false;
+  while (!found && fgets(line, sizeof(line), fp))
+  {
+    char *field = strchr(line, ',');
+    if (field == NULL || (size_t) (field - line) != strlen(name) ||
+        strncmp(line, name, field - line) != 0)
+    {
+      continue;
+    }
+    unsigned long values[4 + PERF::BUCKETS];
+    for (uint8_t i = 0; i < 4 + PERF::BUCKETS; i++)
+    {
+      TEST_ASSERT_NOT_NULL(field);
+      values[i] = strtoul(field + 1, &field, 10);
+    }
+    row.count = values[0];
+    row.min_us = values[1];
+    row.max_us = values[2];
+    row.mean_us = values[3];
+    memcpy(row.buckets, values + 4, sizeof(row.buckets));
+    found = true;
+  }
+  fclose(fp);
+  return found;
+}
+
+// busy wait, micros() is the real clock
+static void spin(unsigned long us)
+{
+  using namespace std::chrono;
+  const steady_clock::time_point end = steady_clock::now() + microseconds(us);
+  while (steady_clock::now() < end)
+  {
+  }
+}
+
+void setUp()
+{
+  PERF::reset();
+  HAL::hostMicros(0);
+}
+
+void tearDown()
+{
+}
+
+void test_statistics_and_buckets()
+{
+  // bucket n counts less than 2^n us, the last one everything longer
+  PERF::add(PERF::WRITE, 0);
+  PERF::add(PERF::WRITE, 1);
+  PERF::add(PERF::WRITE, 3);
+  PERF::add(PERF::WRITE, 1000);
+  PERF::add(PERF::WRITE, 100000);
+  TEST_ASSERT_TRUE(PERF::writeCSV("perf.csv"));
+  stage_row_t row;
+  TEST_ASSERT_TRUE(readStage("write", row));
+  TEST_ASSERT_EQUAL(5, row.count);
+  TEST_ASSERT_EQUAL(0, row.min_us);
+  TEST_ASSERT_EQUAL(100000, row.max_us);
+  TEST_ASSERT_EQUAL(20200, row.mean_us);
+  const unsigned long buckets[PERF::BUCKETS] = { 1, 1, 1, 0, 0, 0, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1 };
+  for (uint8_t b = 0; b < PERF::BUCKETS; b++)
+  {
+    TEST_ASSERT_EQUAL(buckets[b], row.buckets[b]);
+  }
+  TEST_ASSERT_TRUE(readStage("loop", row));
+  TEST_ASSERT_EQUAL(0, row.count);
+}
+
+void test_stage_across_the_wrap()
+{
+  HAL::hostMicros(0xffffffffUL - 100);
+  PERF_START(start);
+  spin(500);
+  TEST_ASSERT_TRUE(HAL::micros() < start);
+  PERF_STOP(HASH, start);
+  TEST_ASSERT_TRUE(PERF::writeCSV("perf.csv"));
+  stage_row_t row;
+  TEST_ASSERT_TRUE(readStage("hash", row));
+  TEST_ASSERT_EQUAL(1, row.count);
+  TEST_ASSERT_TRUE(row.min_us >= 500);
+  // not 2^32 - 100 or more
+  TEST_ASSERT_TRUE(row.max_us < 100000);
+  TEST_ASSERT_EQUAL(0, row.buckets[PERF::BUCKETS - 1]);
+}
+
+void test_replay_across_the_wrap()
+{
+  // a short flight, micros() wraps within the first ms of setup()
+  static const TRACE::phase_t flight[] =
+  {
+    TRACE_GROUND_START,
+    { 300, 100.0f, 0.0f, 0.0f },
+    TRACE_GROUND_END,
+  };
+  std::vector<TRACE::second_t> trace;
+  TEST_ASSERT_TRUE(TRACE::write(card, TRACE_PHASES(flight), trace));
+  HAL::hostBegin(card, false);
+  HAL::hostMicros(0xffffffffUL - 1000);
+  setup();
+  while (!HAL::hostHalted() && HAL::millis() < 3600UL * 1000)
+  {
+    loop();
+    HAL::idle();
+  }
+  TEST_ASSERT_TRUE_MESSAGE(HAL::hostHalted(), "replay did not finish");
+  TEST_ASSERT_TRUE(HAL::micros() < 0x80000000UL);
+
+  // perf.csv of the end of the replay
+  stage_row_t row;
+  const char *const stages[] = { "gps", "log", "loop" };
+  for (const char *stage : stages)
+  {
+    TEST_ASSERT_TRUE_MESSAGE(readStage(stage, row), stage);
+    TEST_ASSERT_TRUE_MESSAGE(row.count > 0, stage);
+    // no sample of about 2^32 us from a start before the wrap
+    TEST_ASSERT_TRUE_MESSAGE(row.max_us < 1000000UL, stage);
+    TEST_ASSERT_TRUE_MESSAGE(row.min_us <= row.mean_us && row.mean_us <= row.max_us, stage);
+  }
+}
+
+int main()
+{
+  UNITY_BEGIN();
+  TEST_ASSERT_NOT_NULL(mkdtemp(card));
+  HAL::hostBegin(card, false);
+  RUN_TEST(test_statistics_and_buckets);
+  RUN_TEST(test_stage_across_the_wrap);
+  RUN_TEST(test_replay_across_the_wrap);
+  return UNITY_END();
+}
@@ -0,0 +1,166 @@
+#include <unity.h>
+#include <Arduino.h>
+#include <stdlib.h>
+#include <string>
+#include "hal.h"
+#include "config.h"
+#include "logger.h"
+#include "igc_file_writer.h"
+#include "igc_format.h"
+#include "igc_journal.h"
+#include "sd_prealloc.h"
+
+// Pre-allocation on the host file system, which counts the clusters a
+// file grows into (FAT updates during the flight): a flight of
+// max_flight_hours at the shortest interval must fit the reserved file.
+
+static char card[] = "/tmp/igc_prealloc_XXXXXX";
+
+static const char header[] = "AXLK001\r\nHFDTE170826\r\n";
+
+static config_t flightConfig(int hours, int interval)
+{
+  config_t config = {};
+  config.max_flight_hours = hours;
+  config.log_interval = interval;
+  config.log_interval_min = interval;
+  config.log_interval_max = 4;
+  return config;
+}
+
+// fix i of a cruise at 1 s, 25 m/s to the north east
+static IGC::fix_t fixAt(uint32_t i)
+{
+  IGC::fix_t fix = {};
+  const uint32_t time = 36000 + i;
+  fix.hour = time / 3600 % 24;
+  fix.minute = time / 60 % 60;
+  fix.second = time % 60;
+  fix.lat = 52 * 60000UL + i * 10;
+  fix.lng = 5 * 60000UL + i * 16;
+  fix.pAlt = 1000 + (i / 60) % 500;
+  fix.gAlt = 1040 + (i / 60) % 500;
+  fix.fxa = 3 + i % 4;
+  fix.siu = 9;
+  return fix;
+}
+
+// write a flight of count fixes in text or journal format, returns the
+// clusters the file grew into
+static uint32_t writeFlight(const char *path, uint32_t prealloc_size, uint32_t count, bool journal)
+{
+  HAL::fsRemove(path);
+  HAL::hostFsResetStats();
+  igc_file_writer writer(path, !journal, true, 10, 30, true, 5);
+  if (prealloc_size > 0)
+  {
+    TEST_ASSERT_TRUE(sdPreallocate(path, prealloc_size));
+    writer.set_preallocated();
+  }
+  else
+  {
+    HAL::File f = HAL::fsOpen(path, O_WRITE | O_CREAT | O_TRUNC);
+    f.close();
+  }
+  IGC::journal_t state;
+  IGC::journalBegin(state);
+  if (journal)
+  {
+    uint8_t entry[IGC::JOURNAL_HEADER_SIZE];
+    TEST_ASSERT_TRUE(writer.append_raw(entry, IGC::journalHeader(entry)));
+  }
+  else
+  {
+    TEST_ASSERT_TRUE(writer.append(header));
+  }
+  for (uint32_t i = 0; i < count; i++)
+  {
+    const IGC::fix_t fix = fixAt(i);
+    if (journal)
+    {
+      uint8_t entry[IGC::JOURNAL_FIX_MAX];
+      TEST_ASSERT_TRUE(writer.append_raw(entry, IGC::journalFix(state, fix, entry)));
+    }
+    else
+    {
+      IGC::igc_t b;
+      char record[sizeof(b.raw) + 2];
+      IGC::formatBRecord(fix, b);
+      snprintf(record, sizeof(record), "%s\r\n", b.raw);
+      TEST_ASSERT_TRUE(writer.append(record));
+    }
+    HAL::hostAdvance(1000);
+  }
+  writer.close();
+  HAL::fs_stats_t stats;
+  HAL::hostFsStats(stats);
+  return stats.clusters;
+}
+
+static uint32_t fileSize(const char *path)
+{
+  uint32_t size, stamp;
+  TEST_ASSERT_TRUE(sdFileInfo(path, size, stamp));
+  return size;
+}
+
+void setUp()
+{
+  HAL::hostBegin(card, false);
+}
+
+void tearDown()
+{
+}
+
+void test_size_follows_interval_and_format()
+{
+  config_t config = flightConfig(10, 2);
+  TEST_ASSERT_EQUAL_UINT32(0, IGC::preallocSize(flightConfig(0, 2), false));
+  const uint32_t text = IGC::preallocSize(config, false);
+  // 18060 records of 42 bytes, header and G-record
+  TEST_ASSERT_UINT32_WITHIN(2048, 18060UL * 42, text);
+  // adaptive logging writes at log_interval_min while climbing
+  config.adaptive_logging = true;
+  config.log_interval_min = 1;
+  const uint32_t adaptive = IGC::preallocSize(config, false);
+  TEST_ASSERT_UINT32_WITHIN(2048, 2 * text, adaptive);
+  // the journal needs a fraction of the text
+  TEST_ASSERT_LESS_THAN(adaptive / 4, IGC::preallocSize(config, true));
+}
+
+void test_text_flight_needs_no_fat_update()
+{
+  // an hour at 1 s plus the minute before takeoff
+  const uint32_t fixes = 3600 + 60;
+  const uint32_t size = IGC::preallocSize(flightConfig(1, 1), false);
+  const uint32_t grown = writeFlight("grown.igc", 0, fixes, false);
+  const uint32_t reserved = writeFlight("prealloc.igc", size, fixes, false);
+  char message[100];
+  snprintf(message, sizeof(message), "text: %lu clusters allocated in flight, %lu pre-allocated",
+           (unsigned long) grown, (unsigned long) reserved);
+  TEST_MESSAGE(message);
+  TEST_ASSERT_GREATER_THAN(0, grown);
+  TEST_ASSERT_EQUAL_UINT32(0, reserved);
+  // cut to the records on close, same file as without pre-allocation
+  TEST_ASSERT_EQUAL_UINT32(fileSize("grown.igc"), fileSize("prealloc.igc"));
+  TEST_ASSERT_LESS_THAN(size, fileSize("prealloc.igc"));
+}
+
+void test_journal_flight_needs_no_fat_update()
+{
+  const uint32_t fixes = 3600 + 60;
+  const uint32_t size = IGC::preallocSize(flightConfig(1, 1), true);
+  TEST_ASSERT_EQUAL_UINT32(0, writeFlight("prealloc.bin", size, fixes, true));
+  TEST_ASSERT_LESS_THAN(size, fileSize("prealloc.bin"));
+}
+
+int main()
+{
+  UNITY_BEGIN();
+  TEST_ASSERT_NOT_NULL(mkdtemp(card));
+  RUN_TEST(test_size_follows_interval_and_format);
+  RUN_TEST(test_text_flight_needs_no_fat_update);
+  RUN_TEST(test_journal_flight_needs_no_fat_update);
+  return UNITY_END();
+}
@@ -0,0 +1,68 @@
+#include <unity.h>
+#include <Arduino.h>
+#include "igc_record_ring.h"
+#include "logger.h"
+
+// B record queue: FIFO order across the end of the buffer, and the 16-bit
+// queue time stamps for every age the flush interval allows.
+
+static const char record[] = "B1000005206000N00512000EA001200016003509\r\n";
+static const uint8_t record_len = sizeof(record) - 1;
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+}
+
+void test_fifo_wraps_around()
+{
+  igc_record_ring ring;
+  char out[64];
+  uint32_t pushed = 0, popped = 0;
+  for (int round = 0; round < 100; round++)
+  {
+    while (ring.push(record, record_len, pushed))
+    {
+      pushed++;
+    }
+    TEST_ASSERT_LESS_THAN(record_len + igc_record_ring::entry_overhead, ring.available());
+    // take a few, so head and tail go around the buffer at different places
+    for (int i = 0; i < 1 + round % 7 && !ring.empty(); i++)
+    {
+      TEST_ASSERT_EQUAL(popped, ring.oldest(popped));
+      TEST_ASSERT_EQUAL(record_len, ring.pop(out, sizeof(out)));
+      TEST_ASSERT_EQUAL_MEMORY(record, out, record_len);
+      popped++;
+    }
+  }
+  TEST_ASSERT_EQUAL(pushed - popped, ring.count());
+}
+
+void test_time_stamp_within_flush_interval()
+{
+  // the oldest record may wait twice the max. flush interval, across the
+  // 16-bit and the 32-bit wrap of millis()
+  static const unsigned long starts[] = { 0, 65000, 65535, 0xFFFFFFFFUL - 30000 };
+  const unsigned long max_age = 2000UL * IGC::MAX_FLUSH_INTERVAL;
+  TEST_ASSERT_LESS_THAN(65536UL, max_age);
+  for (unsigned long start : starts)
+  {
+    for (unsigned long age = 0; age <= max_age; age += 997)
+    {
+      igc_record_ring ring;
+      TEST_ASSERT_TRUE(ring.push(record, record_len, start));
+      TEST_ASSERT_EQUAL_UINT32(start, ring.oldest(start + age));
+    }
+  }
+}
+
+int main()
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_fifo_wraps_around);
+  RUN_TEST(test_time_stamp_within_flush_interval);
+  return UNITY_END();
+}
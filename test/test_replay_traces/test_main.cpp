@@ -0,0 +1,269 @@
+#include <unity.h>
+#include <Arduino.h>
+#include <stdlib.h>
+#include <string>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "hal.h"
+#include "igc_file_writer.h"
+#include "../replay_trace.h"
+
+// The canned flights of replay_trace.h through the whole logger, once at
+// the fixed log_interval and once with adaptive logging. Every run is a
+// fork of this process, setup() and loop() keep their state in statics.
+// The adaptive interval must be log_interval_min while climbing, circling
+// or low and log_interval_max in straight cruise.
+
+void setup();
+void loop();
+
+static const uint16_t log_interval = 2;
+static const uint16_t log_interval_min = 1;
+static const uint16_t log_interval_max = 4;
+// the thresholds main.cpp passes to FLIGHT::logInterval()
+static const float fast_climb = 0.5f;
+static const float fast_turn = 8.0f;
+static const float low_height = 150.0f;
+
+typedef struct
+{
+  uint32_t records;
+  uint32_t first;       // time of the first B record, s
+  uint32_t bytes;
+  uint32_t writes;      // card writes
+  uint32_t fast;        // intervals in fast phases
+  uint32_t fast_ok;     // ... at log_interval_min
+  uint32_t slow;        // intervals in straight cruise
+  uint32_t slow_ok;     // ... at log_interval_max
+} run_t;
+
+// replay the trace in <card> in a child process, false when it did not
+// run to the end
+static bool replay(const char *card)
+{
+  fflush(stdout);
+  const pid_t pid = fork();
+  if (pid == 0)
+  {
+    HAL::hostBegin(card, false);
+    setup();
+    while (!HAL::hostHalted() && HAL::millis() < 20000000UL)
+    {
+      loop();
+      HAL::idle();
+    }
+    HAL::fs_stats_t stats;
+    HAL::hostFsStats(stats);
+    const std::string path = std::string(card) + "/writes.txt";
+    FILE *fp = fopen(path.c_str(), "w");
+    if (fp)
+    {
+      fprintf(fp, "%lu\n", (unsigned long) stats.writes);
+      fclose(fp);
+    }
+    _exit(HAL::hostHalted() && fp ? 0 : 1);
+  }
+  int status = 0;
+  return pid > 0 && waitpid(pid, &status, 0) == pid && WIFEXITED(status) &&
+         WEXITSTATUS(status) == 0;
+}
+
+static uint32_t bTime(const char *line)
+{
+  const uint32_t hour = (line[1] - '0') * 10 + line[2] - '0';
+  const uint32_t minute = (line[3] - '0') * 10 + line[4] - '0';
+  const uint32_t second = (line[5] - '0') * 10 + line[6] - '0';
+  return (hour - 10) * 3600 + minute * 60 + second;
+}
+
+static bool fastPhase(const std::vector<TRACE::second_t> &trace, uint32_t t)
+{
+  const TRACE::phase_t &phase = *trace[t].phase;
+  return phase.climb > fast_climb || fabsf(phase.turn) > fast_turn ||
+         trace[t].alt - trace.front().alt < low_height;
+}
+
+static void runTrace(const char *name, const TRACE::phase_t *phases, size_t count,
+                     bool adaptive, run_t &run)
+{
+  char card[] = "/tmp/igc_trace_XXXXXX";
+  TEST_ASSERT_NOT_NULL(mkdtemp(card));
+  std::vector<TRACE::second_t> trace;
+  TEST_ASSERT_TRUE(TRACE::write(card, phases, count, trace));
+  const std::string ini = std::string(card) + "/config.ini";
+  FILE *fp = fopen(ini.c_str(), "w");
+  TEST_ASSERT_NOT_NULL(fp);
+  fprintf(fp, "[config]\nlog_interval=%u\nadaptive_logging=%s\nlog_interval_min=%u\nlog_interval_max=%u\n",
+          log_interval, adaptive ? "true" : "false", log_interval_min, log_interval_max);
+  fclose(fp);
+
+  TEST_ASSERT_TRUE_MESSAGE(replay(card), name);
+
+  HAL::hostBegin(card, false);
+  TEST_ASSERT_TRUE(HAL::fsExists("20260817/lg000.igc"));
+  TEST_ASSERT_TRUE_MESSAGE(igc_file_writer::verify("20260817/lg000.igc"), "IGC file not signed");
+  TEST_ASSERT_TRUE(HAL::fsExists("perf.csv"));
+
+  memset(&run, 0, sizeof(run));
+  fp = fopen((std::string(card) + "/writes.txt").c_str(), "r");
+  TEST_ASSERT_NOT_NULL(fp);
+  unsigned long writes = 0;
+  TEST_ASSERT_EQUAL(1, fscanf(fp, "%lu", &writes));
+  fclose(fp);
+  run.writes = writes;
+
+  HAL::File igc = HAL::fsOpen("20260817/lg000.igc");
+  TEST_ASSERT_TRUE(igc);
+  run.bytes = igc.size();
+  char line[100];
+  size_t len = 0;
+  int32_t last = -1;
+  int c;
+  while ((c = igc.read()) >= 0)
+  {
+    if (len < sizeof(line) - 1)
+    {
+      line[len++] = c;
+    }
+    if (c != '\n')
+    {
+      continue;
+    }
+    line[len] = '\0';
+    len = 0;
+    if (line[0] != 'B')
+    {
+      continue;
+    }
+    const uint32_t t = bTime(line);
+    if (run.records++ == 0)
+    {
+      run.first = t;
+    }
+    TEST_ASSERT_LESS_THAN(trace.size(), t);
+    // the interval is chosen from the phase at its end, the fixes kept
+    // from before takeoff are left out
+    if (last >= 0 && trace[t].phase->speed > 0 && trace[last].phase->speed > 0)
+    {
+      const uint32_t dt = t - last;
+      if (fastPhase(trace, t))
+      {
+        run.fast++;
+        run.fast_ok += dt == log_interval_min;
+      }
+      else
+      {
+        run.slow++;
+        run.slow_ok += dt == log_interval_max;
+      }
+    }
+    last = t;
+  }
+  igc.close();
+
+  char message[200];
+  int n = snprintf(message, sizeof(message), "%-13s %-8s: %5u B records, %7u bytes, %6u card writes",
+                   name, adaptive ? "adaptive" : "fixed", run.records, run.bytes, run.writes);
+  if (adaptive)
+  {
+    snprintf(message + n, sizeof(message) - n, ", interval ok %u/%u fast, %u/%u cruise",
+             run.fast_ok, run.fast, run.slow_ok, run.slow);
+  }
+  TEST_MESSAGE(message);
+}
+
+static void checkTrace(const char *name, const TRACE::phase_t *phases, size_t count)
+{
+  run_t fixed, adaptive;
+  runTrace(name, phases, count, false, fixed);
+  runTrace(name, phases, count, true, adaptive);
+
+  // fixed: one record every log_interval while moving, less the takeoff
+  // and landing detection times
+  const uint32_t moving = TRACE::movingSeconds(phases, count);
+  TEST_ASSERT_UINT32_WITHIN(60, moving / log_interval, fixed.records);
+  // adaptive: the interval follows the flight phase, a few records around
+  // the phase changes excepted
+  TEST_ASSERT_GREATER_THAN(0, adaptive.fast);
+  TEST_ASSERT_GREATER_OR_EQUAL(adaptive.fast * 9 / 10, adaptive.fast_ok);
+  TEST_ASSERT_GREATER_OR_EQUAL(adaptive.slow * 9 / 10, adaptive.slow_ok);
+  TEST_ASSERT_UINT32_WITHIN(60, adaptive.fast * log_interval_min + adaptive.slow * log_interval_max,
+                            moving);
+}
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+}
+
+void test_ridge()
+{
+  // long straight beats: mostly log_interval_max
+  checkTrace("ridge", TRACE_PHASES(TRACE::ridge));
+}
+
+void test_thermal()
+{
+  // circling most of the flight: mostly log_interval_min
+  checkTrace("thermal", TRACE_PHASES(TRACE::thermal));
+}
+
+void test_cross_country()
+{
+  checkTrace("cross-country", TRACE_PHASES(TRACE::cross_country));
+}
+
+void test_false_alarm()
+{
+  // pushed to the launch for less than confirm_time: that file is
+  // deleted, the flight gets its number and starts with the fixes kept
+  // before the real launch
+  static const TRACE::phase_t phases[] =
+  {
+    { 120,  0.0f,  0.0f,  0.0f },
+    {   6, 15.0f,  0.0f,  0.0f },   // pushed to the winch
+    TRACE_GROUND_START,
+    { 300, 100.0f, 0.0f,  0.0f },
+    TRACE_GROUND_END,
+  };
+  run_t run;
+  runTrace("false alarm", TRACE_PHASES(phases), false, run);
+  TEST_ASSERT_FALSE(HAL::fsExists("20260817/lg001.igc"));
+  // nothing of the push, the fixes kept on the ground end at the launch
+  const uint32_t launch = 120 + 6 + 120;
+  TEST_ASSERT_GREATER_THAN(120 + 6, run.first);
+  TEST_ASSERT_LESS_THAN(launch, run.first);
+}
+
+void test_slow_ridge_one_file()
+{
+  // ridge soaring into the wind at walking ground speed, the vario
+  // within liftoff_threshold: one flight, one file
+  static const TRACE::phase_t phases[] =
+  {
+    TRACE_GROUND_START,
+    { 120,   6.0f,  0.3f,  0.0f },
+    { 120,   5.0f, -0.3f,  0.0f },
+    { 120,   6.0f,  0.3f,  0.0f },
+    { 120,   5.0f, -0.3f,  0.0f },
+    TRACE_GROUND_END,
+  };
+  run_t run;
+  runTrace("slow ridge", TRACE_PHASES(phases), false, run);
+  TEST_ASSERT_FALSE(HAL::fsExists("20260817/lg001.igc"));
+  TEST_ASSERT_UINT32_WITHIN(60, TRACE::movingSeconds(TRACE_PHASES(phases)) / log_interval, run.records);
+}
+
+int main()
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_ridge);
+  RUN_TEST(test_thermal);
+  RUN_TEST(test_cross_country);
+  RUN_TEST(test_false_alarm);
+  RUN_TEST(test_slow_ridge_one_file);
+  return UNITY_END();
+}
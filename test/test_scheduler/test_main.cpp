@@ -0,0 +1,147 @@
+#include <unity.h>
+#include <Arduino.h>
+#include "scheduler.h"
+
+// The scheduler on a fake clock: the tasks advance the clock by their run
+// time, the loop below by 1 ms when nothing was due, like HAL::idle().
+
+static unsigned long now_ms;
+
+typedef struct
+{
+  unsigned long run_time;     // ms the task takes
+  uint32_t runs;
+  unsigned long last_start;
+} fake_task_t;
+
+static fake_task_t fake[4];
+
+template <uint8_t N> static void fakeTask(unsigned long now)
+{
+  TEST_ASSERT_EQUAL(now_ms, now);
+  fake[N].runs++;
+  fake[N].last_start = now;
+  now_ms += fake[N].run_time;
+}
+
+static const char name_a[] PROGMEM = "a";
+static const char name_b[] PROGMEM = "b";
+static const char name_c[] PROGMEM = "c";
+static const char name_d[] PROGMEM = "d";
+
+static void runFor(SCHED::task_t *tasks, uint8_t count, unsigned long ms)
+{
+  const unsigned long end = now_ms + ms;
+  while (now_ms < end)
+  {
+    if (!SCHED::runNext(tasks, count, now_ms))
+    {
+      now_ms++;
+    }
+  }
+}
+
+void setUp()
+{
+  now_ms = 0;
+  memset(fake, 0, sizeof(fake));
+}
+
+void tearDown()
+{
+}
+
+void test_every_task_runs_once_per_period()
+{
+  SCHED::task_t tasks[] =
+  {
+    { name_a, fakeTask<0>, 1000, 100, 0, 0, {} },
+    { name_b, fakeTask<1>,   50,  20, 1, 0, {} },
+    { name_c, fakeTask<2>,  500, 500, 2, 0, {} },
+  };
+  fake[0].run_time = 5;
+  fake[1].run_time = 2;
+  fake[2].run_time = 30;
+  SCHED::start(tasks, 3, now_ms);
+  runFor(tasks, 3, 60000);
+
+  TEST_ASSERT_UINT32_WITHIN(1, 60, fake[0].runs);
+  TEST_ASSERT_UINT32_WITHIN(1, 1200, fake[1].runs);
+  TEST_ASSERT_UINT32_WITHIN(1, 120, fake[2].runs);
+  for (const SCHED::task_t &task : tasks)
+  {
+    TEST_ASSERT_EQUAL(0, task.stats.late);
+    TEST_ASSERT_EQUAL(0, task.stats.skipped);
+    TEST_ASSERT_EQUAL(task.stats.runs, fake[&task - tasks].runs);
+  }
+  // a task waits at most for the longest one that started before it
+  TEST_ASSERT_LESS_OR_EQUAL(30, tasks[0].stats.max_jitter);
+  TEST_ASSERT_LESS_OR_EQUAL(30, tasks[1].stats.max_jitter);
+}
+
+void test_priority_order()
+{
+  // all released at the same time: highest priority first
+  SCHED::task_t tasks[] =
+  {
+    { name_a, fakeTask<0>, 1000, 1000, 2, 0, {} },
+    { name_b, fakeTask<1>, 1000, 1000, 0, 0, {} },
+    { name_c, fakeTask<2>, 1000, 1000, 1, 0, {} },
+  };
+  fake[0].run_time = fake[1].run_time = fake[2].run_time = 10;
+  SCHED::start(tasks, 3, now_ms);
+  runFor(tasks, 3, 100);
+  TEST_ASSERT_EQUAL(0, fake[1].last_start);
+  TEST_ASSERT_EQUAL(10, fake[2].last_start);
+  TEST_ASSERT_EQUAL(20, fake[0].last_start);
+}
+
+void test_slow_task_delays_others()
+{
+  // a 1.5 s stall (SD card) makes the fast tasks late and drops the
+  // releases that passed, the phase is kept
+  SCHED::task_t tasks[] =
+  {
+    { name_a, fakeTask<0>,  100,  50, 0, 0, {} },
+    { name_b, fakeTask<1>, 5000, 5000, 3, 0, {} },
+  };
+  fake[0].run_time = 1;
+  fake[1].run_time = 1500;
+  SCHED::start(tasks, 2, now_ms);
+  runFor(tasks, 2, 10000);
+
+  TEST_ASSERT_EQUAL(2, fake[1].runs);
+  // two stalls, each one late start and 14 releases dropped
+  TEST_ASSERT_EQUAL(2, tasks[0].stats.late);
+  TEST_ASSERT_EQUAL(2 * 14, tasks[0].stats.skipped);
+  TEST_ASSERT_EQUAL(10000 / 100 - 2 * 14, fake[0].runs);
+  TEST_ASSERT_EQUAL(1401, tasks[0].stats.max_jitter);
+  TEST_ASSERT_EQUAL(0, tasks[0].release % 100);
+}
+
+void test_period_zero()
+{
+  // a zero period (log_interval=0 in config.ini) runs every ms instead
+  // of dividing by zero
+  SCHED::task_t tasks[] =
+  {
+    { name_a, fakeTask<0>, 0, 10, 0, 0, {} },
+    { name_d, fakeTask<3>, 100, 10, 1, 0, {} },
+  };
+  SCHED::start(tasks, 2, now_ms);
+  runFor(tasks, 2, 1000);
+  TEST_ASSERT_UINT32_WITHIN(1, 1000, fake[0].runs);
+  TEST_ASSERT_EQUAL(0, tasks[0].stats.skipped);
+  // the lower priority task gets the ms the first one leaves
+  TEST_ASSERT_GREATER_THAN(0, fake[3].runs);
+}
+
+int main()
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_every_task_runs_once_per_period);
+  RUN_TEST(test_priority_order);
+  RUN_TEST(test_slow_task_delays_others);
+  RUN_TEST(test_period_zero);
+  return UNITY_END();
+}
@@ -0,0 +1,80 @@
+/*
+  bin2igc: expand a flight journal (lgNNN.bin, config journal=true) into
+  the IGC file the logger would have written in text mode, G-record
+  included.
+
+  Build on the PC, from the repository root:
+    g++ -O2 -Iinclude -Ilib/MD5 -o bin2igc tools/bin2igc.cpp tools/journal_igc.cpp \
+        src/igc_journal.cpp src/igc_format.cpp src/igc_grecord.cpp lib/MD5/MD5.cpp
+
+  Usage:
+    bin2igc lg001.bin [lg001.igc]
+*/
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include "journal_igc.h"
+#include "igc_journal.h"
+
+static bool readFile(const char *path, std::vector<uint8_t> &data)
+{
+  FILE *f = fopen(path, "rb");
+  if (!f)
+  {
+    return false;
+  }
+  uint8_t buffer[4096];
+  size_t n;
+  while ((n = fread(buffer, 1, sizeof(buffer), f)) > 0)
+  {
+    data.insert(data.end(), buffer, buffer + n);
+  }
+  fclose(f);
+  return true;
+}
+
+int main(int argc, char *argv[])
+{
+  if (argc < 2)
+  {
+    fprintf(stderr, "usage: %s journal.bin [out.igc]\n", argv[0]);
+    return 2;
+  }
+  std::string out_path;
+  if (argc > 2)
+  {
+    out_path = argv[2];
+  }
+  else
+  {
+    out_path = argv[1];
+    size_t dot = out_path.find_last_of('.');
+    out_path = out_path.substr(0, dot) + ".igc";
+  }
+
+  std::vector<uint8_t> data;
+  if (!readFile(argv[1], data))
+  {
+    fprintf(stderr, "cannot read %s\n", argv[1]);
+    return 1;
+  }
+  std::string igc;
+  IGC::journal_stats_t stats;
+  if (!IGC::journalToIgc(data, igc, stats))
+  {
+    fprintf(stderr, "%s is not a flight journal (version %u)\n", argv[1], IGC::JOURNAL_VERSION);
+    return 1;
+  }
+
+  FILE *f = fopen(out_path.c_str(), "wb");
+  if (!f || fwrite(igc.data(), 1, igc.size(), f) != igc.size())
+  {
+    fprintf(stderr, "cannot write %s\n", out_path.c_str());
+    return 1;
+  }
+  fclose(f);
+  printf("%s: %u records, %u fixes, %zu -> %zu bytes\n", out_path.c_str(),
+         stats.records, stats.fixes, data.size(), igc.size());
+  return 0;
+}
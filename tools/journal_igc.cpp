@@ -0,0 +1,93 @@
+#include <stdio.h>
+#include <string.h>
+#include "journal_igc.h"
+#include "igc_journal.h"
+#include "igc_format.h"
+#include "igc_grecord.h"
+
+namespace IGC
+{
+
+// only zeros (unused part of a pre-allocated file) from pos on
+static bool isPadding(const std::vector<uint8_t> &data, size_t pos)
+{
+  for (size_t i = pos; i < data.size(); i++)
+  {
+    if (data[i] != 0)
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+// sanitise and hash a record like igc_file_writer does, then add CR/LF
+static void addRecord(std::string &out, const char *record, size_t len, void *const md5[4])
+{
+  std::string line(record, len);
+  line += "\r\n";
+  cleanRecord(&line[0], line.size(), md5);
+  out += line;
+}
+
+bool journalToIgc(const std::vector<uint8_t> &data, std::string &igc,
+                  journal_stats_t &stats)
+{
+  memset(&stats, 0, sizeof(stats));
+  igc.clear();
+  if (!journalCheckHeader(data.data(), data.size()))
+  {
+    return false;
+  }
+
+  MD5::MD5_CTX md5_a, md5_b, md5_c, md5_d;
+  initGRecord(md5_a, md5_b, md5_c, md5_d);
+  void *const md5[] = { &md5_a, &md5_b, &md5_c, &md5_d };
+
+  journal_t journal;
+  journalBegin(journal);
+  size_t pos = JOURNAL_HEADER_SIZE;
+  while (pos < data.size())
+  {
+    journal_entry_t entry;
+    size_t size = journalDecode(journal, &data[pos], data.size() - pos, entry);
+    if (size == 0)
+    {
+      if (isPadding(data, pos))
+      {
+        // end of a pre-allocated file, or cut off by a power loss
+        break;
+      }
+      // damaged data, continue at the next keyframe
+      size_t skip = journalResync(&data[pos], data.size() - pos);
+      fprintf(stderr, "warning: %zu bytes at offset %zu not decoded\n", skip, pos);
+      stats.skipped += skip;
+      pos += skip;
+      journalBegin(journal);
+      continue;
+    }
+    pos += size;
+    if (entry.type == JOURNAL_TEXT)
+    {
+      addRecord(igc, entry.text, entry.length, md5);
+      stats.records++;
+    }
+    else if (entry.type == JOURNAL_FIX)
+    {
+      igc_t b;
+      formatBRecord(entry.fix, b);
+      addRecord(igc, b.raw, strlen(b.raw), md5);
+      stats.fixes++;
+    }
+  }
+  const MD5::MD5_CTX *contexts[] = { &md5_a, &md5_b, &md5_c, &md5_d };
+  for (const MD5::MD5_CTX *ctx : contexts)
+  {
+    char line[G_RECORD_SIZE + 1];
+    formatGRecord(*ctx, line);
+    igc.append(line, G_RECORD_SIZE);
+  }
+  return true;
+}
+
+}
@@ -0,0 +1,24 @@
+#ifndef _JOURNAL_IGC_H_
+#define _JOURNAL_IGC_H_
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+// host side expansion of a flight journal into the IGC file the logger
+// would have written in text mode, G-record included (bin2igc, tests)
+namespace IGC
+{
+    typedef struct
+    {
+        unsigned records;   // A, H, ... records
+        unsigned fixes;     // B records
+        unsigned skipped;   // damaged bytes, decoding went on at the next keyframe
+    } journal_stats_t;
+
+    // false if data is not a journal of this version
+    bool journalToIgc(const std::vector<uint8_t> &data, std::string &igc,
+                      journal_stats_t &stats);
+}
+
+#endif